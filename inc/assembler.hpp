@@ -10,9 +10,18 @@
 
 namespace assembler
 {
+  extern bool isText;
+  // Writes the text dump of the object file instead of the binary format
+  void setText();
   void setIOFiles(std::string inputFileName,std::string outputFileName);
   void assemble();
-  void handleLineFirstPass(Line line);
+  void handleLine(const Line &line);
+
+  // Used by the parser to build the lines
+  uint32_t stringToUnsignedInt(const std::string &value);
+  int16_t stringToSignedInt(const std::string &value);
+  uint8_t getGprIndex(const std::string &regCode);
+  uint8_t getCsrIndex(const std::string &regCode);
 };
 
 
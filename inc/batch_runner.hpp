@@ -0,0 +1,81 @@
+#ifndef _BATCH_RUNNER_HPP_
+#define _BATCH_RUNNER_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include "emulator.hpp"
+#include "lane_group.hpp"
+
+struct BatchJob
+{
+  std::string imageFileName;
+  uint64_t maxInstructions;
+  // Replace the initial values of registers and memory words, by register index and by address
+  std::vector<std::pair<uint16_t, uint32_t>> registers;
+  std::vector<std::pair<uint32_t, uint32_t>> words;
+};
+
+struct BatchResult
+{
+  StopReason stopReason;
+  std::string message;
+  uint64_t instructionCount;
+  // Register dump in the format printed after halt
+  std::string state;
+  // Everything the guest wrote to term_out
+  std::string output;
+};
+
+// Runs many guest images on a pool of threads. Every image is loaded once and shared, and
+// every thread reuses one EmulatorCore for all of its jobs. Jobs are dealt out round-robin, and a thread that runs out of its own jobs
+// steals from the back of the other queues, so a few long jobs don't leave threads idle.
+// With lanes, jobs of the same image are grouped LaneGroup::LANES at a time and each group
+// runs in a LaneGroup. Jobs the lanes can't finish run again on the thread's core.
+class BatchRunner
+{
+public:
+  static const uint64_t DEFAULT_MAX_INSTRUCTIONS = 1000000000;
+
+  BatchRunner(uint32_t threadCount, bool useJit, bool useLanes = false);
+
+  // Reads one job per line, "image.hex [maxInstructions] [rN=value | 0xaddress=value ...]".
+  // Lines starting with # are skipped. Returns false if the manifest can't be read or a line is invalid.
+  bool loadManifest(const std::string &manifestFileName);
+  void addJob(const BatchJob &job);
+
+  void run();
+
+  const std::vector<BatchJob> &getJobs() const;
+  const std::vector<BatchResult> &getResults() const;
+  // Prints every result in manifest order, returns the number of jobs that didn't halt
+  uint32_t printResults(std::ostream &out) const;
+
+private:
+  struct WorkQueue
+  {
+    std::mutex lock;
+    std::deque<uint32_t> groups;
+  };
+
+  void runWorker(uint32_t worker);
+  bool takeGroup(uint32_t worker, uint32_t &group);
+  void runJob(EmulatorCore &core, uint32_t job);
+  void runLanes(LaneGroup &lanes, EmulatorCore &core, const std::vector<uint32_t> &group);
+
+  uint32_t threadCount;
+  bool useJit;
+  bool useLanes;
+  std::vector<BatchJob> jobs;
+  // Jobs that run together, a single job each without lanes
+  std::vector<std::vector<uint32_t>> groups;
+  std::vector<BatchResult> results;
+  std::vector<WorkQueue> queues;
+  // Loaded images by file name, images that failed to load are missing
+  std::unordered_map<std::string, std::shared_ptr<const Memory>> images;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef _CACHE_MODEL_HPP_
+#define _CACHE_MODEL_HPP_
+
+#include <cstdint>
+#include <vector>
+
+// Hits and misses of a set associative cache with LRU replacement, with one way it is
+// direct mapped. Only the tags are kept, data always comes from guest memory.
+// Writes allocate like reads.
+class CacheModel
+{
+public:
+  // Sizes are in bytes, the number of sets and the line size must be powers of two
+  CacheModel(uint32_t size, uint32_t lineSize, uint32_t ways);
+
+  // Returns true on a hit, a miss replaces the least recently used line of the set
+  bool access(uint32_t addr);
+  // Invalidates every line and the counts
+  void clear();
+
+  uint32_t getSize() const;
+  uint32_t getLineSize() const;
+  uint32_t getWays() const;
+  uint64_t getHits() const;
+  uint64_t getMisses() const;
+
+  // Whether a cache of this geometry can be modeled
+  static bool isValid(uint32_t size, uint32_t lineSize, uint32_t ways);
+
+private:
+  struct Line
+  {
+    // The line address, addr >> lineBits
+    uint32_t tag;
+    bool valid;
+    uint64_t lastUse;
+  };
+
+  uint32_t lineBits;
+  uint32_t setMask;
+  uint32_t ways;
+  // Every way of set 0, then set 1 and so on
+  std::vector<Line> lines;
+  uint64_t time;
+  uint64_t hits;
+  uint64_t misses;
+};
+
+#endif
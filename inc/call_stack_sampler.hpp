@@ -0,0 +1,81 @@
+#ifndef _CALL_STACK_SAMPLER_HPP_
+#define _CALL_STACK_SAMPLER_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <vector>
+#include <map>
+
+class SymbolMap;
+
+// Follows guest calls, returns and interrupts on a shadow call stack and counts how often
+// every stack was seen when sampled. A frame is known by the address it was entered at.
+class CallStackSampler
+{
+public:
+  // Frames past this depth aren't tracked, deep recursion only loses its innermost calls
+  static const uint32_t MAX_DEPTH = 256;
+
+  explicit CallStackSampler(uint64_t interval);
+
+  // Instructions between two samples
+  uint64_t getInterval() const;
+  // Drops the stack and the samples and starts over with a single frame at entry
+  void reset(uint32_t entry);
+
+  // A call or an interrupt, returnAddress is the PC that was pushed
+  void enter(uint32_t entry, uint32_t returnAddress)
+  {
+    if (stack.size() < MAX_DEPTH)
+    {
+      stack.push_back({entry, returnAddress});
+    }
+    else
+    {
+      ++overflowDepth;
+    }
+  }
+
+  // PC was popped off the guest stack, by ret or iret. Returns to the frame that pushed it,
+  // a pop that doesn't match any frame leaves the stack alone.
+  void leave(uint32_t returnAddress)
+  {
+    if (overflowDepth)
+    {
+      --overflowDepth;
+      return;
+    }
+    if (stack.size() > 1 && stack.back().returnAddress == returnAddress)
+    {
+      stack.pop_back();
+      return;
+    }
+    unwind(returnAddress);
+  }
+
+  void sample();
+  uint64_t getSampleCount() const;
+
+  // One line per distinct stack, the frames from the outermost separated by ';' and then the
+  // number of samples. Frames are named by the symbol map, or by address without one.
+  void writeFoldedStacks(std::ostream &out, const SymbolMap *symbols) const;
+
+private:
+  struct Frame
+  {
+    uint32_t entry;
+    uint32_t returnAddress;
+  };
+
+  void unwind(uint32_t returnAddress);
+
+  uint64_t interval;
+  std::vector<Frame> stack;
+  // Calls made past MAX_DEPTH that haven't returned yet
+  uint32_t overflowDepth;
+  // Keyed by the entries of the frames, from the outermost
+  std::map<std::vector<uint32_t>, uint64_t> samples;
+  uint64_t sampleCount;
+};
+
+#endif
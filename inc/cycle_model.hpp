@@ -0,0 +1,105 @@
+#ifndef _CYCLE_MODEL_HPP_
+#define _CYCLE_MODEL_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "decode_cache.hpp"
+#include "cache_model.hpp"
+
+class SymbolMap;
+
+// Estimates the cycles a guest program takes on a simple in-order processor with split
+// instruction and data caches. Every instruction costs the cycles of its operation, plus the
+// miss penalty for every cache miss it causes and a penalty when it changes the flow of
+// control. Loads from the literal pool, which the assembler uses for ld $imm and for every
+// branch and call target, also stall until the loaded value can be used.
+class CycleModel
+{
+public:
+  struct Config
+  {
+    uint32_t cycles[isa::OPERATION_COUNT];
+    uint32_t instructionCacheSize;
+    uint32_t instructionCacheLineSize;
+    uint32_t instructionCacheWays;
+    uint32_t dataCacheSize;
+    uint32_t dataCacheLineSize;
+    uint32_t dataCacheWays;
+    uint32_t missPenalty;
+    uint32_t takenBranchPenalty;
+    uint32_t literalStall;
+
+    // One cycle for every instruction but mul and div, 4 KB caches with 16 byte lines,
+    // the instruction cache direct mapped and the data cache two way
+    Config();
+    // Overrides the defaults with the lines of a configuration file, each one of
+    //   cycles <instruction> <cycles>
+    //   icache <size> <line size> <ways>
+    //   dcache <size> <line size> <ways>
+    //   miss-penalty <cycles>
+    //   taken-branch <cycles>
+    //   literal-stall <cycles>
+    // Instructions are named as in isa::FORMS. Text after # is a comment.
+    // Returns false if the file can't be read or a line is invalid.
+    bool load(const std::string &configFileName);
+    bool load(std::istream &input);
+  };
+
+  // Number of entries in the ranking of misses
+  static const uint32_t REPORT_LENGTH = 20;
+
+  explicit CycleModel(const Config &config);
+
+  // A data read or write of the running instruction, device registers aren't cached
+  void accessData(uint32_t addr)
+  {
+    if (!dataCache.access(addr))
+    {
+      ++pendingMisses;
+      firstAccessMissed |= !dataAccesses;
+    }
+    ++dataAccesses;
+  }
+  // Counts the cycles of the instruction at pc and its data accesses, nextPc is PC after it executed
+  void record(const DecodedInstruction &instruction, uint32_t pc, uint32_t nextPc);
+  void clear();
+
+  uint64_t getInstructionCount() const;
+  uint64_t getCycleCount() const;
+
+  // Writes the CPI, the cycles by instruction, the hit rates of both caches, the cycles lost
+  // to each kind of stall and the instructions that missed most
+  void writeReport(std::ostream &out, const SymbolMap *symbols) const;
+
+private:
+  struct Misses
+  {
+    uint64_t fetch;
+    uint64_t data;
+  };
+
+  static bool isLiteralLoad(const DecodedInstruction &instruction);
+
+  Config config;
+  CacheModel instructionCache;
+  CacheModel dataCache;
+  // Data accesses of the running instruction
+  uint32_t dataAccesses;
+  uint32_t pendingMisses;
+  bool firstAccessMissed;
+  uint64_t instructionCount;
+  uint64_t cycleCount;
+  uint64_t missCycles;
+  uint64_t branchCycles;
+  uint64_t literalLoads;
+  uint64_t literalMisses;
+  uint64_t literalCycles;
+  uint64_t operationCounts[isa::OPERATION_COUNT];
+  uint64_t operationCycles[isa::OPERATION_COUNT];
+  // Keyed by the PC of the instruction that missed
+  std::unordered_map<uint32_t, Misses> misses;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef _DECODE_CACHE_HPP_
+#define _DECODE_CACHE_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <vector>
+#include "memory.hpp"
+#include "isa.hpp"
+
+struct DecodedInstruction;
+class EmulatorCore;
+
+typedef void (*InstructionHandler)(EmulatorCore &core, const DecodedInstruction &instruction);
+// Returns how many of the fused instructions it executed
+typedef uint32_t (*FusedHandler)(EmulatorCore &core, const DecodedInstruction &instruction);
+
+// An instruction with every field extracted once, ready for dispatch
+struct DecodedInstruction
+{
+  InstructionHandler execute;
+  // Executes this instruction and the fusedLength - 1 entries after it as one, nullptr if
+  // it starts no fused sequence. Only cached entries are fused.
+  FusedHandler fused;
+  uint8_t fusedLength;
+  isa::Operation operation;
+  uint8_t opCode;
+  uint8_t mod;
+  uint8_t regA;
+  uint8_t regB;
+  uint8_t regC;
+  int32_t disp; // sign extended
+};
+
+// Decoded instructions keyed by PC. Entries are grouped the same way as the pages of
+// guest memory, a page of entries is only allocated once code from that page executes.
+// An entry whose handler is nullptr has not been decoded yet.
+class DecodeCache
+{
+public:
+  static const uint32_t ENTRIES_PER_PAGE = Memory::PAGE_SIZE / 4;
+  static const uint32_t MAX_FUSED_LENGTH = 3;
+
+  DecodeCache();
+  ~DecodeCache();
+  DecodeCache(const DecodeCache &) = delete;
+  DecodeCache &operator=(const DecodeCache &) = delete;
+
+  // Returns the entry for the instruction at addr, or nullptr for unaligned addresses
+  DecodedInstruction *getEntry(uint32_t addr)
+  {
+    if (addr & 0x3)
+    {
+      return nullptr;
+    }
+    DecodedInstruction *page = pageTable[addr >> Memory::PAGE_BITS];
+    if (!page)
+    {
+      page = allocatePage(addr >> Memory::PAGE_BITS);
+    }
+    return &page[(addr & Memory::PAGE_MASK) >> 2];
+  }
+
+  // Drops the entry covering the byte at addr and every fused sequence it is part of,
+  // must be called for every write to guest memory
+  void invalidate(uint32_t addr)
+  {
+    DecodedInstruction *page = pageTable[addr >> Memory::PAGE_BITS];
+    if (page)
+    {
+      uint32_t index = (addr & Memory::PAGE_MASK) >> 2;
+      page[index].execute = nullptr;
+      // Fused sequences never cross a page
+      for (uint32_t back = 1; back < MAX_FUSED_LENGTH && back <= index; ++back)
+      {
+        if (page[index - back].fusedLength > back)
+        {
+          page[index - back].execute = nullptr;
+        }
+      }
+    }
+  }
+
+  // Whether the instruction covering the byte at addr was decoded and not dropped since
+  bool isDecoded(uint32_t addr) const
+  {
+    const DecodedInstruction *page = pageTable[addr >> Memory::PAGE_BITS];
+    return page && page[(addr & Memory::PAGE_MASK) >> 2].execute;
+  }
+
+  // Drops every entry
+  void clear();
+
+private:
+  DecodedInstruction *allocatePage(uint32_t pageNumber);
+
+  DecodedInstruction **pageTable;
+  std::vector<uint32_t> allocatedPages;
+};
+
+#endif
@@ -3,11 +3,292 @@
 
 #include <iostream>
 #include <cstdint>
+#include <memory>
+#include <unordered_set>
+#include "memory.hpp"
+#include "decode_cache.hpp"
+#include "event_queue.hpp"
+#include "cycle_model.hpp"
 
-namespace emulator
+class Jit;
+class TranslatedProgram;
+class TraceWriter;
+class Terminal;
+class Profiler;
+class CallStackSampler;
+class EventLog;
+
+enum class StopReason
+{
+  NONE,
+  HALT,
+  INSTRUCTION_LIMIT,
+  INVALID_OPCODE,
+  INVALID_MODIFIER,
+  LOCKSTEP_MISMATCH,
+  LOAD_ERROR,
+  BREAKPOINT
+};
+
+std::string StopReasonToString(StopReason reason);
+
+// A single emulated processor that owns its registers, CSRs and memory. Cores share no state,
+// so a host process can run any number of guests, one after another or side by side.
+// Nothing is printed and nothing exits, every run ends with a stop reason.
+class EmulatorCore
 {
-  void run();
-  void setInputFile(std::string inputFileName);
+public:
+  static const uint32_t START_ADDRESS = 0x40000000;
+  // Device registers, the linker keeps sections below MMIO_START
+  static const uint32_t MMIO_START = 0xFFFFFF00;
+  static const uint32_t TERM_OUT = 0xFFFFFF00;
+  static const uint32_t TERM_IN = 0xFFFFFF04;
+  static const uint32_t TIM_CFG = 0xFFFFFF10;
+  // Guest time is counted in executed instructions
+  static const uint64_t INSTRUCTIONS_PER_MILLISECOND = 10000;
+  static const uint64_t TERMINAL_POLL_INTERVAL = INSTRUCTIONS_PER_MILLISECOND;
+  // A loop is checked for idleness once its backward branch was taken this many times in a row
+  static const uint32_t IDLE_LOOP_ITERATIONS = 1000;
+  // Longest loop body, in instructions, that is checked for idleness
+  static const uint32_t IDLE_LOOP_MAX_LENGTH = 64;
+
+  static const uint32_t CAUSE_TIMER = 2;
+  static const uint32_t CAUSE_TERMINAL = 3;
+  static const uint32_t CAUSE_SOFTWARE = 4;
+  static const uint32_t STATUS_TIMER_MASK = 0x1;
+  static const uint32_t STATUS_TERMINAL_MASK = 0x2;
+  static const uint32_t STATUS_INTERRUPT_MASK = 0x4;
+
+  EmulatorCore();
+  ~EmulatorCore();
+  EmulatorCore(const EmulatorCore &) = delete;
+  EmulatorCore &operator=(const EmulatorCore &) = delete;
+
+  // Loads a program image produced by the linker, either the text hex format or the
+  // binary format. Returns false and stops with LOAD_ERROR if it can't be read.
+  bool load(const std::string &inputFileName);
+  bool load(std::istream &input);
+  // Clears the registers and CSRs, moves PC back to the start address and drops every
+  // memory page the guest wrote. Memory goes back to the shared image, or to zero without one.
+  void reset();
+  // Turns the loaded program into an image that any number of cores can start from,
+  // this core included. Nothing is copied.
+  std::shared_ptr<const Memory> shareImage();
+  // Starts over from a shared image instead of loading the file again. Costs one table
+  // entry per image page, the guest only gets its own copy of the pages it writes.
+  void loadShared(std::shared_ptr<const Memory> image);
+  // Writes the registers, CSRs, device state and every written memory page to a snapshot.
+  // Returns false if the file can't be written.
+  bool saveSnapshot(const std::string &snapshotFileName) const;
+  // Continues from a snapshot instead of a program image. Returns false and stops with
+  // LOAD_ERROR if it can't be read.
+  bool restoreSnapshot(const std::string &snapshotFileName);
+
+  // Runs translated code where possible
+  void setJit();
+  // Runs translated code and checks every block against the interpreter
+  void setLockstep();
+  // Runs the blocks of a program the translator turned into C++, in place of the JIT.
+  // The program must come from the image this core loaded and outlive the core.
+  void setTranslatedProgram(TranslatedProgram *program);
+  // Writes every instruction to out before executing it
+  void setTrace(std::ostream &out);
+  // Connects term_out and term_in to the host, without a terminal output is dropped.
+  // The terminal is polled for input and flushed every TERMINAL_POLL_INTERVAL instructions.
+  void setTerminal(Terminal *terminal);
+  // Logs every interrupt taken from a device and every input byte, with the instruction count
+  void setRecording(EventLog *log);
+  // Delivers the interrupts and input of a recorded run at the same instruction counts instead of
+  // taking them from the devices, so the run repeats exactly. Replays always run in the interpreter.
+  void setReplay(EventLog *log);
+  // A loop that keeps repeating the same state without storing anything, like a guest waiting
+  // for an interrupt, is fast-forwarded to the next device event by whole iterations. The
+  // result is the same as executing it, only tracing, profiling and breakpoints see the
+  // difference, so the interpreter doesn't skip while they are on. On by default.
+  void setIdleLoopSkipping(bool enabled);
+  // Counts executions of every instruction, by opcode and taken branches
+  void setProfile();
+  // Estimates the cycles of every instruction with a cache and pipeline model
+  void setCycleModel(const CycleModel::Config &config);
+  // Samples the guest call stack every interval instructions
+  void setSampling(uint64_t interval);
+  // Stops with BREAKPOINT before executing the instruction at addr, the next run continues past it
+  void addBreakpoint(uint32_t addr);
+  void removeBreakpoint(uint32_t addr);
+  // Tracing, profiling, the cycle model, sampling and breakpoints run in the interpreter even if the JIT
+  // or a translated program is on, and lockstep mode ignores them
+
+  // Executes a single instruction, or a single translated block when the JIT is on.
+  // Returns NONE if the guest can continue.
+  StopReason step();
+  // Executes until the guest stops or maxInstructions were executed, the JIT can overshoot
+  // the limit by up to one block. Returns INSTRUCTION_LIMIT if the guest can continue.
+  StopReason run(uint64_t maxInstructions = UINT64_MAX);
+
+  StopReason getStopReason() const;
+  // Details about the last stop, empty for halt and the instruction limit
+  const std::string &getStopMessage() const;
+  uint64_t getInstructionCount() const;
+  // nullptr unless profiling
+  const Profiler *getProfiler() const;
+  const CycleModel *getCycleModel() const;
+  const CallStackSampler *getSampler() const;
+  uint32_t getRegister(uint16_t index) const;
+  void setRegister(uint16_t index, uint32_t value);
+  uint32_t getCsr(uint16_t index) const;
+  Memory &getMemory();
+  // Prints the register file in the format used after halt
+  void printState(std::ostream &out) const;
+  void printMemoryContent(std::ostream &out) const;
+
+  static DecodedInstruction decodeInstruction(uint32_t instruction);
+  // Prints 16 registers in the format of printState
+  static void printRegisters(std::ostream &out, const uint32_t *registers);
+
+private:
+  struct NoTrace;
+  struct TraceInstructions;
+  struct NoProfile;
+  struct ProfileInstructions;
+  struct NoBreakpoints;
+  struct CheckBreakpoints;
+
+  template <void (EmulatorCore::*handler)(const DecodedInstruction &)>
+  static void dispatch(EmulatorCore &core, const DecodedInstruction &instruction)
+  {
+    (core.*handler)(instruction);
+  }
+
+  template <uint32_t (EmulatorCore::*handler)(const DecodedInstruction &)>
+  static uint32_t dispatchFused(EmulatorCore &core, const DecodedInstruction &instruction)
+  {
+    return (core.*handler)(instruction);
+  }
+
+  static InstructionHandler selectHandler(isa::Operation operation);
+  static void writeWordFromTranslatedCode(void *core, uint32_t addr, uint32_t word);
+
+  uint32_t readWord(uint32_t addr);
+  void writeWord(uint32_t addr, uint32_t word);
+  void pushReg(uint32_t value);
+  void popReg(uint32_t &reg);
+  bool loadImage(const char *image, size_t size);
+  bool loadBinaryImage(const char *image, size_t size);
+  bool loadHexImage(const char *image, size_t size);
+  bool restoreImage(const char *image, size_t size);
+  void scheduleEvents();
+  void stop(StopReason reason, const std::string &message);
+  void endSlice();
+  void writeDevice(uint32_t addr, uint32_t word);
+  void raiseInterrupt(uint32_t cause);
+  void processEvents();
+  void pollTerminal();
+  void acceptInterrupt();
+  void replayEvents();
+  void branchTo(uint32_t target);
+  void noteBackwardBranch(uint32_t branchPc, uint32_t target);
+  bool isIdleLoopBody(uint32_t start, uint32_t end);
+
+  void printInt();
+  void printCall(const DecodedInstruction &instruction);
+  void printBranch(const DecodedInstruction &instruction);
+  void printXchg(const DecodedInstruction &instruction);
+  void printRegisterOp(const DecodedInstruction &instruction);
+  void printStore(const DecodedInstruction &instruction);
+  void printLoad(const DecodedInstruction &instruction);
+  void printInstruction(const DecodedInstruction &instruction);
+
+  void executeInvalidOpCode(const DecodedInstruction &instruction);
+  void executeInvalidModifier(const DecodedInstruction &instruction);
+  void executeHalt(const DecodedInstruction &instruction);
+  void executeInt(const DecodedInstruction &instruction);
+  void executeCall(const DecodedInstruction &instruction);
+  void executeJmp(const DecodedInstruction &instruction);
+  void executeBeq(const DecodedInstruction &instruction);
+  void executeBne(const DecodedInstruction &instruction);
+  void executeBgt(const DecodedInstruction &instruction);
+  void executeXchg(const DecodedInstruction &instruction);
+  void executeAdd(const DecodedInstruction &instruction);
+  void executeSub(const DecodedInstruction &instruction);
+  void executeMul(const DecodedInstruction &instruction);
+  void executeDiv(const DecodedInstruction &instruction);
+  void executeNot(const DecodedInstruction &instruction);
+  void executeAnd(const DecodedInstruction &instruction);
+  void executeOr(const DecodedInstruction &instruction);
+  void executeXor(const DecodedInstruction &instruction);
+  void executeShl(const DecodedInstruction &instruction);
+  void executeShr(const DecodedInstruction &instruction);
+  void executeStore(const DecodedInstruction &instruction);
+  void executeStoreIndirect(const DecodedInstruction &instruction);
+  void executePush(const DecodedInstruction &instruction);
+  void executeLoad(const DecodedInstruction &instruction);
+  void executePop(const DecodedInstruction &instruction);
+  void executePopCsr(const DecodedInstruction &instruction);
+  void executeCsrRead(const DecodedInstruction &instruction);
+  void executeCsrWrite(const DecodedInstruction &instruction);
+  void executeAddDisp(const DecodedInstruction &instruction);
+
+  uint32_t executeFusedIret(const DecodedInstruction &instruction);
+  uint32_t executeFusedLoadMemory(const DecodedInstruction &instruction);
+  uint32_t executeFusedPushes(const DecodedInstruction &instruction);
+  uint32_t executeFusedPops(const DecodedInstruction &instruction);
+  void fuseInstructions(DecodedInstruction *first, uint32_t pc);
+
+  template <class Trace, class Profile>
+  void interpretInstruction(const DecodedInstruction &instruction);
+  const DecodedInstruction &fetchInstruction(DecodedInstruction &uncached);
+  template <class Trace, class Profile, class Breakpoints>
+  void interpretLoop(bool resumeAtBreakpoint);
+  template <class Trace, class Profile>
+  void interpretWithProfile(bool resumeAtBreakpoint);
+  template <class Trace>
+  void interpretWithTrace(bool resumeAtBreakpoint);
+  void interpret(bool resumeAtBreakpoint);
+  void runJit();
+  void runTranslated();
+  void runLockstep();
+  void syncShadow();
+  bool checkLockstep(uint32_t blockPc);
+  bool checkLockstepMemory();
+
+  Memory mem;
+  DecodeCache decodeCache;
+  uint32_t r[16];
+  uint32_t csr[3];
+  StopReason stopReason;
+  std::string stopMessage;
+  uint64_t instructionCount;
+  // The running slice returns once instructionCount reaches it
+  uint64_t sliceEnd;
+  bool idleLoopSkipping;
+  // Whether the running slice may skip idle loops
+  bool skipIdleLoops;
+  // The backward branch taken last, how often it was taken in a row, and the state after
+  // the IDLE_LOOP_ITERATIONS-th time
+  uint32_t idleBranch;
+  uint32_t idleIterations;
+  uint64_t idleStart;
+  uint32_t idleRegisters[16];
+  uint32_t idleCsr[3];
+  EventQueue events;
+  // One bit for every interrupt cause
+  uint32_t pendingInterrupts;
+  uint32_t timerConfig;
+  // Incremented on every timer configuration, older timer events are ignored
+  uint32_t timerGeneration;
+  bool timerRestart;
+  Terminal *terminal;
+  EventLog *recording;
+  EventLog *replay;
+  std::unique_ptr<TraceWriter> trace;
+  std::unique_ptr<Profiler> profiler;
+  std::unique_ptr<CycleModel> cycleModel;
+  std::unique_ptr<CallStackSampler> sampler;
+  std::unordered_set<uint32_t> breakpoints;
+  std::unique_ptr<Jit> jit;
+  TranslatedProgram *translated;
+  // Runs the translated code next to this core in lockstep mode
+  std::unique_ptr<EmulatorCore> shadow;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,63 @@
+#ifndef _EVENT_LOG_HPP_
+#define _EVENT_LOG_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <vector>
+
+// Asynchronous events in the order the guest saw them. Recording a run and replaying the
+// log delivers every interrupt and input byte at the same instruction count again.
+enum class LoggedEventType : uint8_t
+{
+  INTERRUPT = 1, // data is the cause
+  INPUT = 2      // data is the byte written to term_in
+};
+
+struct LoggedEvent
+{
+  uint64_t time; // in executed instructions
+  LoggedEventType type;
+  uint8_t data;
+};
+
+// On disk the log is a header followed by one entry per event, the type, the time since the
+// previous event as an LEB128 number and the data byte. Most events take three bytes.
+class EventLog
+{
+public:
+  static const uint32_t MAGIC = 0x474F4C45; // "ELOG"
+  static const uint32_t VERSION = 1;
+
+  EventLog();
+
+  void record(const LoggedEvent &event)
+  {
+    events.push_back(event);
+  }
+  // Drops every event and starts replaying from the beginning
+  void clear();
+
+  // Returns false if the file can't be written
+  bool save(const std::string &logFileName) const;
+  // Returns false if the file can't be read or isn't an event log
+  bool load(const std::string &logFileName);
+
+  // Replay position, UINT64_MAX once every event was replayed
+  uint64_t getNextTime() const
+  {
+    return next < events.size() ? events[next].time : UINT64_MAX;
+  }
+  const LoggedEvent &takeNext()
+  {
+    return events[next++];
+  }
+  void rewind();
+
+  const std::vector<LoggedEvent> &getEvents() const;
+
+private:
+  std::vector<LoggedEvent> events;
+  size_t next;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef _EVENT_QUEUE_HPP_
+#define _EVENT_QUEUE_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <vector>
+
+enum class EventType
+{
+  TIMER,
+  TERMINAL_POLL,
+  SAMPLE
+};
+
+struct Event
+{
+  uint64_t time; // in executed instructions
+  EventType type;
+  uint32_t data;
+};
+
+// Device events ordered by the time they are due. Nothing is ever removed early,
+// a device that reschedules marks its stale events through data and skips them.
+class EventQueue
+{
+public:
+  void schedule(const Event &event);
+  // Removes and returns the earliest event, the queue must not be empty
+  Event pop();
+  void clear();
+
+  // UINT64_MAX if nothing is scheduled
+  uint64_t getNextTime() const
+  {
+    return events.empty() ? UINT64_MAX : events.front().time;
+  }
+
+  // Every scheduled event, in no particular order
+  const std::vector<Event> &getEvents() const
+  {
+    return events;
+  }
+
+private:
+  // Binary heap with the earliest event at the front
+  std::vector<Event> events;
+};
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef _ISA_HPP_
+#define _ISA_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <array>
+
+// The instruction set, shared by the assembler, the emulator and its tools. FORMS is the only
+// place opcodes, modifiers and instruction names are written down, the encoder, decoder and
+// disassembler tables are computed from it at compile time. Everything past decoding works
+// on Operation.
+//
+// An instruction word is opcode, modifier, A, B and C, four bits each from the top, then a
+// 12 bit signed displacement.
+namespace isa
+{
+  enum class Operation : uint8_t
+  {
+    HALT,
+    INT,
+    CALL,
+    JMP,
+    BEQ,
+    BNE,
+    BGT,
+    XCHG,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    NOT,
+    AND,
+    OR,
+    XOR,
+    SHL,
+    SHR,
+    STORE,
+    PUSH,
+    STORE_INDIRECT,
+    CSR_READ,
+    ADD_DISP,
+    LOAD,
+    POP,
+    CSR_WRITE,
+    POP_CSR,
+    // Decoded words that are no instruction
+    INVALID_MODIFIER,
+    INVALID_OPCODE
+  };
+
+  const uint32_t FORM_COUNT = (uint32_t)Operation::INVALID_MODIFIER;
+  const uint32_t OPERATION_COUNT = (uint32_t)Operation::INVALID_OPCODE + 1;
+
+  struct Form
+  {
+    Operation operation;
+    uint8_t opCode;
+    uint8_t mod;
+    // Set if every modifier decodes to this form, mod is what the assembler emits
+    bool anyMod;
+    // What the disassembler prints, empty for forms without a mnemonic of their own
+    const char *mnemonic;
+    // Unique name of the form, used by the profiler and cycle reports and the cycle configuration
+    const char *name;
+  };
+
+  // In the order of Operation
+  inline constexpr Form FORMS[] = {
+      {Operation::HALT, 0b0000, 0b0000, true, "halt", "halt"},
+      {Operation::INT, 0b0001, 0b0000, true, "int", "int"},
+      {Operation::CALL, 0b0010, 0b0001, false, "call", "call"},
+      {Operation::JMP, 0b0011, 0b1000, false, "jmp", "jmp"},
+      {Operation::BEQ, 0b0011, 0b1001, false, "beq", "beq"},
+      {Operation::BNE, 0b0011, 0b1010, false, "bne", "bne"},
+      {Operation::BGT, 0b0011, 0b1011, false, "bgt", "bgt"},
+      {Operation::XCHG, 0b0100, 0b0000, true, "xchg", "xchg"},
+      {Operation::ADD, 0b0101, 0b0000, false, "add", "add"},
+      {Operation::SUB, 0b0101, 0b0001, false, "sub", "sub"},
+      {Operation::MUL, 0b0101, 0b0010, false, "mul", "mul"},
+      {Operation::DIV, 0b0101, 0b0011, false, "div", "div"},
+      {Operation::NOT, 0b0110, 0b0000, false, "not", "not"},
+      {Operation::AND, 0b0110, 0b0001, false, "and", "and"},
+      {Operation::OR, 0b0110, 0b0010, false, "or", "or"},
+      {Operation::XOR, 0b0110, 0b0011, false, "xor", "xor"},
+      {Operation::SHL, 0b0111, 0b0000, false, "shl", "shl"},
+      {Operation::SHR, 0b0111, 0b0001, false, "shr", "shr"},
+      {Operation::STORE, 0b1000, 0b0000, false, "st", "st"},                   // mem[A + B + D] = C
+      {Operation::PUSH, 0b1000, 0b0001, false, "push", "push"},                // A = A - D, mem[A] = C
+      {Operation::STORE_INDIRECT, 0b1000, 0b0010, false, "st", "st-indirect"}, // mem[mem[A + B + D]] = C
+      {Operation::CSR_READ, 0b1001, 0b0000, false, "csrrd", "csrrd"},          // A = csr[B]
+      {Operation::ADD_DISP, 0b1001, 0b0001, false, "", "ld-reg"},              // A = B + D
+      {Operation::LOAD, 0b1001, 0b0010, false, "ld", "ld"},                    // A = mem[B + C + D]
+      {Operation::POP, 0b1001, 0b0011, false, "pop", "pop"},                   // A = mem[B], B = B + D
+      {Operation::CSR_WRITE, 0b1001, 0b0100, false, "csrwr", "csrwr"},         // csr[A] = B
+      {Operation::POP_CSR, 0b1001, 0b0111, false, "pop", "pop-csr"},           // csr[A] = mem[B], B = B + D
+  };
+
+  constexpr bool formsInOrder()
+  {
+    if (sizeof(FORMS) / sizeof(FORMS[0]) != FORM_COUNT)
+    {
+      return false;
+    }
+    for (uint32_t i = 0; i < FORM_COUNT; ++i)
+    {
+      if ((uint32_t)FORMS[i].operation != i)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+  static_assert(formsInOrder(), "FORMS must list every operation in the order of Operation");
+
+  constexpr bool isSameName(const char *a, const char *b)
+  {
+    while (*a && *a == *b)
+    {
+      ++a;
+      ++b;
+    }
+    return *a == *b;
+  }
+
+  constexpr bool namesUnique()
+  {
+    for (uint32_t i = 0; i < FORM_COUNT; ++i)
+    {
+      for (uint32_t j = i + 1; j < FORM_COUNT; ++j)
+      {
+        if (isSameName(FORMS[i].name, FORMS[j].name))
+        {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+  static_assert(namesUnique(), "Every form needs a name of its own");
+
+  // Opcode and modifier of every form, indexed by operation
+  constexpr std::array<uint32_t, FORM_COUNT> buildEncoder()
+  {
+    std::array<uint32_t, FORM_COUNT> encoder{};
+    for (const Form &form : FORMS)
+    {
+      encoder[(uint32_t)form.operation] = (uint32_t)form.opCode << 28 | (uint32_t)form.mod << 24;
+    }
+    return encoder;
+  }
+
+  // Indexed by the top byte of a word, opcode and modifier
+  constexpr std::array<Operation, 256> buildDecoder()
+  {
+    std::array<Operation, 256> decoder{};
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+      decoder[i] = Operation::INVALID_OPCODE;
+    }
+    for (const Form &form : FORMS)
+    {
+      for (uint32_t mod = 0; mod < 16; ++mod)
+      {
+        Operation &entry = decoder[form.opCode << 4 | mod];
+        if (mod == form.mod || form.anyMod)
+        {
+          entry = form.operation;
+        }
+        else if (entry == Operation::INVALID_OPCODE)
+        {
+          entry = Operation::INVALID_MODIFIER;
+        }
+      }
+    }
+    return decoder;
+  }
+
+  inline constexpr std::array<uint32_t, FORM_COUNT> ENCODER = buildEncoder();
+  inline constexpr std::array<Operation, 256> DECODER = buildDecoder();
+
+  constexpr uint32_t encode(Operation operation, uint32_t regA, uint32_t regB, uint32_t regC, uint32_t disp)
+  {
+    return ENCODER[(uint32_t)operation] | (regA & 0xF) << 20 | (regB & 0xF) << 16 | (regC & 0xF) << 12 |
+           (disp & 0xFFF);
+  }
+
+  constexpr Operation decode(uint32_t word)
+  {
+    return DECODER[word >> 24];
+  }
+
+  constexpr const char *getMnemonic(Operation operation)
+  {
+    return (uint32_t)operation < FORM_COUNT ? FORMS[(uint32_t)operation].mnemonic : "";
+  }
+
+  // Never nullptr, the decoded words that are no instruction have names too
+  constexpr const char *getName(Operation operation)
+  {
+    if (operation == Operation::INVALID_MODIFIER)
+    {
+      return "invalid-modifier";
+    }
+    return (uint32_t)operation < FORM_COUNT ? FORMS[(uint32_t)operation].name : "invalid-opcode";
+  }
+
+  static_assert(decode(encode(Operation::POP_CSR, 0, 14, 0, 0xFFC)) == Operation::POP_CSR, "");
+  static_assert(decode(0x3C000000) == Operation::INVALID_MODIFIER, "");
+  static_assert(decode(0xA0000000) == Operation::INVALID_OPCODE, "");
+};
+
+#endif
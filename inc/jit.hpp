@@ -0,0 +1,113 @@
+#ifndef _JIT_HPP_
+#define _JIT_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include "memory.hpp"
+#include "decode_cache.hpp"
+
+// Translates guest basic blocks into x86-64 code. A block runs until the first call, jmp,
+// branch or write to pc, and every instruction the translator doesn't handle (halt, int)
+// is left to the interpreter. The guest register file stays in memory, the translated
+// code addresses it through a pinned host register.
+//
+// Branches through a literal pool word are chained directly to the block at the target,
+// the pool word is then treated as code so overwriting it drops the translation. Calls push
+// their return address onto a shadow return stack that lets ret continue without a lookup.
+class Jit
+{
+public:
+  typedef void (*WriteHandler)(void *context, uint32_t addr, uint32_t word);
+  // Takes the instruction budget and returns what is left of it
+  typedef int64_t (*BlockFunction)(int64_t budget);
+
+  static const uint32_t CODE_BUFFER_SIZE = 16 * 1024 * 1024;
+  static const uint32_t MAX_BLOCK_INSTRUCTIONS = 64;
+  static const uint32_t RETURN_STACK_SIZE = 64;
+  // Size of the block prologue, chained jumps enter a block past it
+  static const uint32_t BODY_OFFSET = 20;
+
+  // Every guest write that doesn't come from translated code must be reported with invalidate().
+  // Writes from translated code that can't take the fast path go through writeWord, which
+  // gets writeContext as its first argument.
+  Jit(Memory &mem, uint32_t *r, uint32_t *csr, WriteHandler writeWord, void *writeContext);
+  ~Jit();
+  Jit(const Jit &) = delete;
+  Jit &operator=(const Jit &) = delete;
+
+  // Runs translated blocks starting at r[15] until reaching an instruction that must be
+  // interpreted, or until at least maxInstructions were executed. Chained blocks only check
+  // the budget between blocks, so a run can overshoot it by up to one block.
+  // Returns the number of guest instructions executed.
+  uint64_t run(uint64_t maxInstructions);
+
+  // Translates and runs a single block at r[15] without following chained jumps, returns the
+  // number of guest instructions executed, 0 if the instruction at r[15] must be interpreted
+  uint32_t runBlock();
+
+  // Drops all translated code if the word at addr was translated, returns true if it was
+  bool invalidate(uint32_t addr)
+  {
+    const uint64_t *covered = coveredWords[addr >> Memory::PAGE_BITS];
+    if (!covered)
+    {
+      return false;
+    }
+    uint32_t word = (addr & Memory::PAGE_MASK) >> 2;
+    if (!(covered[word >> 6] & (1ull << (word & 0x3F))))
+    {
+      return false;
+    }
+    flush();
+    return true;
+  }
+
+  // Drops all translated code
+  void flush();
+
+  // Makes run() return once the current block exits. Writes that change what the caller has
+  // to do next, like programming a device, call it from writeWord.
+  void requestExit();
+
+private:
+  struct ReturnStackEntry
+  {
+    uint32_t pc;
+    BlockFunction *block;
+  };
+
+  BlockFunction getBlock(uint32_t pc);
+  BlockFunction compileBlock(uint32_t pc);
+  bool getConstantTarget(uint8_t regA, uint8_t regB, int32_t disp, uint32_t nextPc, uint32_t &target);
+  void patchLink(uint8_t *link, uint8_t *block);
+  bool isTranslatable(const DecodedInstruction &instruction);
+  void markCovered(uint32_t addr);
+  BlockFunction *getBlockEntry(uint32_t pc);
+
+  static uint32_t readWordHelper(Jit *jit, uint32_t addr);
+  static uint32_t writeWordHelper(Jit *jit, uint32_t addr, uint32_t word);
+
+  Memory &mem;
+  uint32_t *r;
+  uint32_t *csr;
+  WriteHandler writeWord;
+  void *writeContext;
+  uint8_t *codeBuffer;
+  uint32_t codeSize;
+  // Incremented by every flush, lets a write from translated code detect that it dropped the code
+  uint32_t flushCount;
+  bool exitRequested;
+  // Translated blocks, laid out like the pages of guest memory
+  BlockFunction **blockTable;
+  // One bit for every guest word that is part of a translated block
+  uint64_t **coveredWords;
+  std::vector<uint32_t> allocatedPages;
+  // Chained jumps waiting for the block at a pc to be translated
+  std::unordered_map<uint32_t, std::vector<uint8_t *>> pendingLinks;
+  ReturnStackEntry returnStack[RETURN_STACK_SIZE];
+  uint32_t returnStackTop;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef _LANE_GROUP_HPP_
+#define _LANE_GROUP_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <vector>
+#include "memory.hpp"
+#include "decode_cache.hpp"
+#include "emulator.hpp"
+
+// Runs up to LANES guests of the same image side by side, one guest per lane of the host's
+// vector registers. Registers are kept as one vector per guest register, so an instruction is
+// decoded once and its arithmetic runs for every lane at the same time. Each guest has its own
+// memory on top of the shared image, loads and stores go lane by lane.
+//
+// Every step executes the instruction at the lowest PC of all running lanes, for the lanes
+// that are there. When a branch splits the lanes the ones further ahead wait, and they join
+// in again once the others reach their PC.
+//
+// Only programs that need no devices but term_out run in lanes. A lane that configures the
+// timer, jumps to an unaligned address or changes code after it ran stops as unsupported,
+// its guest has to run again on an EmulatorCore.
+class LaneGroup
+{
+public:
+  static const uint32_t LANES = 16;
+
+  LaneGroup();
+  LaneGroup(const LaneGroup &) = delete;
+  LaneGroup &operator=(const LaneGroup &) = delete;
+
+  // Starts laneCount guests from image, every lane stops after maxInstructions until set otherwise
+  void reset(std::shared_ptr<const Memory> image, uint32_t laneCount);
+  void setMaxInstructions(uint32_t lane, uint64_t maxInstructions);
+  void setRegister(uint32_t lane, uint16_t index, uint32_t value);
+  Memory &getMemory(uint32_t lane);
+
+  // Runs until every lane stopped
+  void run();
+
+  StopReason getStopReason(uint32_t lane) const;
+  const std::string &getStopMessage(uint32_t lane) const;
+  // Set if the guest did something lanes don't model, its results are incomplete
+  bool isUnsupported(uint32_t lane) const;
+  uint64_t getInstructionCount(uint32_t lane) const;
+  // Everything the guest wrote to term_out
+  const std::string &getOutput(uint32_t lane) const;
+  void printState(uint32_t lane, std::ostream &out) const;
+
+private:
+  // GCC vector extensions, the compiler picks the widest vector instructions the host has
+  typedef uint32_t LaneWord __attribute__((vector_size(LANES * sizeof(uint32_t))));
+  // -1 in the lanes an instruction executes for, 0 in the others
+  typedef int32_t LaneMask __attribute__((vector_size(LANES * sizeof(int32_t))));
+  typedef int64_t LaneCount __attribute__((vector_size(LANES * sizeof(int64_t))));
+
+  const DecodedInstruction *fetchInstruction(uint32_t pc);
+  uint64_t stopAtLimits();
+  void stopLane(uint32_t lane, StopReason reason, const std::string &message);
+  void stopUnsupported(uint32_t lane);
+  bool readUniform(uint32_t addr, uint32_t &word) const;
+  uint32_t readWord(uint32_t lane, uint32_t addr);
+  void writeWord(uint32_t lane, uint32_t addr, uint32_t word);
+  void pushWord(uint32_t lane, uint32_t value);
+  void raiseInterrupt(uint32_t lane, uint32_t cause);
+  void executeMemory(const DecodedInstruction &instruction, uint32_t lanes);
+
+  LaneWord r[16];
+  LaneWord csr[3];
+  LaneCount instructionCount;
+  LaneCount limit;
+  // One bit for every lane that hasn't stopped, and the same as a mask
+  uint32_t running;
+  LaneMask runningMask;
+  uint32_t laneCount;
+  StopReason stopReasons[LANES];
+  std::string stopMessages[LANES];
+  bool unsupported[LANES];
+  std::string outputs[LANES];
+  std::shared_ptr<const Memory> image;
+  Memory memories[LANES];
+  // Pages any lane wrote, the others are still the image's in every lane
+  std::vector<uint8_t> writtenPages;
+  // Shared by all lanes, an instruction is only decoded if every lane has the same one there
+  DecodeCache decodeCache;
+};
+
+#endif
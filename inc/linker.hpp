@@ -8,8 +8,12 @@ namespace linker
 {
   extern bool isHex;
   extern bool isRelocatable;
+  extern bool isBinary;
   void setHex();
   void setRelocatable();
+  void setBinary();
+  // Also writes the address of every label to mapFileName, sorted by address
+  void setMapFile(std::string mapFileName);
   void setIOFiles(std::string outputFileName, std::vector<std::string> inputFileNames);
   void addPlaceSection(std::string sectionName, uint32_t sectionAddress);
   void link();
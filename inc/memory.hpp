@@ -0,0 +1,137 @@
+#ifndef _MEMORY_HPP_
+#define _MEMORY_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <vector>
+#include <memory>
+
+// Guest address space made of 4 KiB pages that are allocated on first write.
+// The top-level table maps every page number of the 32-bit space directly,
+// so an access is a single table lookup followed by an offset into the page.
+// Bytes that were never written read as zero.
+// Memory can sit on top of a shared read-only base. Base pages are read in place and
+// copied on the first write, so every instance only pays for the pages it writes.
+class Memory
+{
+public:
+  static const uint32_t PAGE_BITS = 12;
+  static const uint32_t PAGE_SIZE = 1 << PAGE_BITS;
+  static const uint32_t PAGE_MASK = PAGE_SIZE - 1;
+  static const uint32_t PAGE_COUNT = 1 << (32 - PAGE_BITS);
+
+  Memory();
+  ~Memory();
+  Memory(const Memory &) = delete;
+  Memory &operator=(const Memory &) = delete;
+
+  uint8_t readByte(uint32_t addr) const
+  {
+    const uint8_t *page = pageTable[addr >> PAGE_BITS];
+    return page ? page[addr & PAGE_MASK] : 0;
+  }
+
+  void writeByte(uint32_t addr, uint8_t byte)
+  {
+    uint8_t *page = writeTable[addr >> PAGE_BITS];
+    if (!page)
+    {
+      page = allocatePage(addr >> PAGE_BITS);
+    }
+    page[addr & PAGE_MASK] = byte;
+  }
+
+  // Returns a little-endian 4 byte word, the fast path is taken when the word doesn't cross a page boundary
+  uint32_t readWord(uint32_t addr) const
+  {
+    uint32_t offset = addr & PAGE_MASK;
+    const uint8_t *page = pageTable[addr >> PAGE_BITS];
+    if (offset <= PAGE_SIZE - 4)
+    {
+      if (!page)
+      {
+        return 0;
+      }
+      const uint8_t *p = page + offset;
+      return (p[3] << 24) | (p[2] << 16) | (p[1] << 8) | (p[0] << 0);
+    }
+    return (readByte(addr + 3) << 24) | (readByte(addr + 2) << 16) | (readByte(addr + 1) << 8) | (readByte(addr) << 0);
+  }
+
+  // Writes a little-endian 4 byte word, the fast path is taken when the word doesn't cross a page boundary
+  void writeWord(uint32_t addr, uint32_t word)
+  {
+    uint32_t offset = addr & PAGE_MASK;
+    if (offset <= PAGE_SIZE - 4)
+    {
+      uint8_t *page = writeTable[addr >> PAGE_BITS];
+      if (!page)
+      {
+        page = allocatePage(addr >> PAGE_BITS);
+      }
+      uint8_t *p = page + offset;
+      p[0] = (word >> 0) & 0xFF;
+      p[1] = (word >> 8) & 0xFF;
+      p[2] = (word >> 16) & 0xFF;
+      p[3] = (word >> 24) & 0xFF;
+      return;
+    }
+    writeByte(addr, (word >> 0) & 0xFF);
+    writeByte(addr + 1, (word >> 8) & 0xFF);
+    writeByte(addr + 2, (word >> 16) & 0xFF);
+    writeByte(addr + 3, (word >> 24) & 0xFF);
+  }
+
+  // Copies size bytes to guest memory starting at addr, a whole page at a time
+  void writeBlock(uint32_t addr, const uint8_t *data, uint32_t size);
+
+  // Returns the page with the given page number, or nullptr if it was never written
+  const uint8_t *getPage(uint32_t pageNumber) const
+  {
+    return pageTable[pageNumber];
+  }
+
+  // Base of the top-level table, for translated code that does its own page lookups
+  uint8_t *const *getPageTable() const
+  {
+    return pageTable;
+  }
+
+  // Like the page table, but without the pages that are still shared with the base
+  uint8_t *const *getWriteTable() const
+  {
+    return writeTable;
+  }
+
+  // Page numbers of the pages this memory allocated itself, in allocation order
+  const std::vector<uint32_t> &getAllocatedPages() const
+  {
+    return allocatedPages;
+  }
+
+  // Page numbers of every page that can be read, base pages included, sorted
+  std::vector<uint32_t> getPageNumbers() const;
+
+  // Releases every allocated page, afterwards memory reads as the base, or as zero without one
+  void clear();
+
+  // Clears memory and puts it on top of base, nullptr drops the current base.
+  // Costs one table entry per base page, nothing is copied.
+  void setBase(std::shared_ptr<const Memory> base);
+  // Hands the current content over to a new base that this memory then sits on, so any
+  // number of other memories can start from it. The pages are moved, not copied.
+  std::shared_ptr<const Memory> share();
+
+private:
+  uint8_t *allocatePage(uint32_t pageNumber);
+
+  // Pages to read from, allocated pages and base pages
+  uint8_t **pageTable;
+  // Allocated pages only, a write to a page missing here allocates or copies it first
+  uint8_t **writeTable;
+  std::vector<uint32_t> allocatedPages;
+  std::shared_ptr<const Memory> base;
+  std::vector<uint32_t> basePages;
+};
+
+#endif
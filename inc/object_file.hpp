@@ -0,0 +1,104 @@
+#ifndef _OBJECT_FILE_HPP_
+#define _OBJECT_FILE_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <string>
+
+// Binary relocatable object written by the assembler. All fields are little endian and every
+// table starts on a four byte boundary, so the records are read in place from the mapped file.
+// The header is followed by the section table, the symbol table, the relocation table, the
+// string table and the raw bytes of the sections. Names are offsets into the string table,
+// which holds them NUL terminated. The relocations of a section are a contiguous run of the
+// relocation table.
+const uint32_t OBJECT_FILE_MAGIC = 0x4A424F45; // "EOBJ"
+const uint32_t OBJECT_FILE_VERSION = 1;
+
+struct ObjectFileHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t sectionCount;
+  uint32_t sectionOffset;
+  uint32_t symbolCount;
+  uint32_t symbolOffset;
+  uint32_t relocationCount;
+  uint32_t relocationOffset;
+  uint32_t stringTableOffset;
+  uint32_t stringTableSize;
+};
+
+struct ObjectSection
+{
+  uint32_t name;
+  uint32_t offset; // from the start of the file
+  uint32_t size;
+  uint32_t relocationIndex;
+  uint32_t relocationCount;
+};
+
+struct ObjectSymbol
+{
+  uint32_t value;
+  uint32_t name;
+  uint32_t section; // name of the section, UND or ABS
+  uint16_t size;
+  uint8_t type;  // SymbolType
+  uint8_t scope; // ScopeType
+};
+
+struct ObjectRelocation
+{
+  uint32_t offset;
+  uint32_t symbol; // name of the symbol, the section for local symbols
+  uint32_t addend;
+};
+
+static_assert(sizeof(ObjectFileHeader) == 40, "");
+static_assert(sizeof(ObjectSection) == 20, "");
+static_assert(sizeof(ObjectSymbol) == 16, "");
+static_assert(sizeof(ObjectRelocation) == 12, "");
+
+// Read-only view of an object file. The binary format is mapped and checked once, after that
+// the records are used where they are. The text format is the debug dump of the same contents,
+// it is converted to the binary format when it is loaded.
+class ObjectFile
+{
+public:
+  ObjectFile();
+  ~ObjectFile();
+  ObjectFile(const ObjectFile &) = delete;
+  ObjectFile &operator=(const ObjectFile &) = delete;
+
+  // Returns false if the file can't be opened or isn't an object file in either format
+  bool load(const std::string &fileName);
+  // Copies the binary format or converts the text format
+  bool load(const char *image, size_t imageSize);
+
+  uint32_t getSectionCount() const;
+  const ObjectSection &getSection(uint32_t index) const;
+  const uint8_t *getSectionData(const ObjectSection &section) const;
+  uint32_t getSymbolCount() const;
+  const ObjectSymbol &getSymbol(uint32_t index) const;
+  // Index into the whole relocation table, see ObjectSection
+  const ObjectRelocation &getRelocation(uint32_t index) const;
+  const char *getString(uint32_t offset) const;
+
+  void writeBinary(std::ostream &out) const;
+  // The text dump, #.symtab followed by the bytes of every section in hex and its #.rela table
+  void writeText(std::ostream &out) const;
+
+private:
+  const ObjectFileHeader &getHeader() const;
+  bool isValid() const;
+  bool convertText(std::istream &input);
+  void unload();
+
+  const char *data;
+  size_t size;
+  bool mapped;
+  // Holds the file if it wasn't mapped
+  std::string buffer;
+};
+
+#endif
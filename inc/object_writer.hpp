@@ -0,0 +1,42 @@
+#ifndef _OBJECT_WRITER_HPP_
+#define _OBJECT_WRITER_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "symbol.hpp"
+#include "relocation.hpp"
+
+// Builds an object file in the binary format of object_file.hpp. The string table is made
+// when the file is built, in the order symbols, sections, relocations, so the same contents
+// always give the same bytes no matter which format they were read from.
+class ObjectWriter
+{
+public:
+  // Returns the index of the section. The data isn't copied, it has to stay valid until the
+  // file is built or written.
+  uint32_t addSection(const std::string &name, const uint8_t *data, uint32_t size);
+  void addRelocation(uint32_t section, const Relocation &relocation);
+  void addSymbol(const std::string &name, const Symbol &symbol);
+
+  std::string build() const;
+  // Writes the section data straight from where it was added
+  void write(std::ostream &out) const;
+
+private:
+  std::string buildTables() const;
+
+  struct SectionEntry
+  {
+    std::string name;
+    const uint8_t *data;
+    uint32_t size;
+    std::vector<Relocation> relocations;
+  };
+
+  std::vector<SectionEntry> sections;
+  std::vector<std::pair<std::string, Symbol>> symbols;
+};
+
+#endif
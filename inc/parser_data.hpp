@@ -2,38 +2,115 @@
 #define _PARSER_DATA_HPP_
 
 #include <iostream>
+#include <cstdint>
+#include <string>
 #include <vector>
+#include "string_pool.hpp"
+
+// Parsed lines, built once by the parser and read by both assembler passes.
+// Symbol names and .ascii strings are interned, numbers are already converted.
+
+enum class LineType : uint8_t
+{
+  DIRECTIVE,
+  INSTRUCTION
+};
+
+enum class DirectiveType : uint8_t
+{
+  GLOBAL,
+  EXTERN,
+  SECTION,
+  WORD,
+  SKIP,
+  END,
+  ASCII
+};
+
+enum class ArgumentType : uint8_t
+{
+  SYMBOL,
+  NUMBER,
+  STRING
+};
+
+enum class Mnemonic : uint8_t
+{
+  HALT,
+  INT,
+  IRET,
+  CALL,
+  RET,
+  JMP,
+  BEQ,
+  BNE,
+  BGT,
+  PUSH,
+  POP,
+  XCHG,
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  NOT,
+  AND,
+  OR,
+  XOR,
+  SHL,
+  SHR,
+  LD,
+  ST,
+  CSRRD,
+  CSRWR
+};
+
+enum class OperandKind : uint8_t
+{
+  NONE,
+  NUM,         // $number, or a branch target
+  SYM,         // $symbol, or a branch target
+  MEM_NUM,     // number
+  MEM_SYM,     // symbol
+  MEM_REG,     // [reg]
+  MEM_REG_NUM  // [reg + number]
+};
 
 struct Argument
 {
-  std::string type; //
-  std::string value;
+  ArgumentType type;
+  // The number, or the interned symbol name or string
+  uint32_t value;
 };
 
 struct Directive
 {
-  std::string mnemonic; //
+  DirectiveType mnemonic;
   std::vector<Argument> argList;
 };
 
 struct Instruction
 {
-  std::string mnemonic; //
-  std::string reg1; //
-  std::string reg2; //
-  std::string operand;
-  std::string operand_type; //
-  std::string offset;
+  Mnemonic mnemonic;
+  // Register indices in the order they are written, a CSR index for csrrd and csrwr
+  uint8_t reg1;
+  uint8_t reg2;
+  OperandKind operandKind;
+  // Base register of MEM_REG and MEM_REG_NUM
+  uint8_t operandReg;
+  // Offset of MEM_REG_NUM
+  int16_t offset;
+  // The number of NUM and MEM_NUM, the interned symbol name of SYM and MEM_SYM
+  uint32_t operand;
 };
 
 struct Line
 {
   unsigned number;
-  std::string type; //
-  std::string label;
+  LineType type;
+  // Interned label name, StringPool::NONE if the line has none
+  StringId label;
   Directive directive;
   Instruction instruction;
 };
 
-
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,89 @@
+#ifndef _PROFILER_HPP_
+#define _PROFILER_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <vector>
+#include "memory.hpp"
+#include "decode_cache.hpp"
+
+class SymbolMap;
+
+// Execution counts of a guest program. Counters for every instruction are kept in pages
+// that mirror the pages of guest memory, so counting is an array access and not a lookup.
+class Profiler
+{
+public:
+  static const uint32_t COUNTERS_PER_PAGE = Memory::PAGE_SIZE / 4;
+  // Number of entries in each ranking of the report
+  static const uint32_t REPORT_LENGTH = 20;
+
+  Profiler();
+  ~Profiler();
+  Profiler(const Profiler &) = delete;
+  Profiler &operator=(const Profiler &) = delete;
+
+  // Counts the instruction executed at pc, nextPc is PC after it executed
+  void record(const DecodedInstruction &instruction, uint32_t pc, uint32_t nextPc)
+  {
+    ++operationCounts[(uint32_t)instruction.operation];
+    Counters &counters = getCounters(pc);
+    ++counters.executed;
+    if (instruction.operation >= isa::Operation::JMP && instruction.operation <= isa::Operation::BGT)
+    {
+      counters.conditional = instruction.operation != isa::Operation::JMP;
+      if (nextPc != pc + 4)
+      {
+        ++counters.taken;
+        counters.target = nextPc;
+      }
+    }
+    else if (instruction.operation == isa::Operation::CALL)
+    {
+      ++getCounters(nextPc).calls;
+    }
+  }
+
+  void clear();
+
+  uint64_t getOperationCount(isa::Operation operation) const;
+  uint64_t getExecutedCount(uint32_t pc) const;
+  // Counted for jmp, beq, bne and bgt
+  uint64_t getTakenCount(uint32_t pc) const;
+
+  // Writes the operation counts and the hottest instructions, branches and loops.
+  // With a symbol map addresses are printed as labels and time is also ranked by function,
+  // a function being everything from its label up to the next one.
+  void writeReport(std::ostream &out, const SymbolMap *symbols) const;
+
+private:
+  struct Counters
+  {
+    uint64_t executed;
+    uint64_t taken;
+    // Number of calls to this address
+    uint32_t calls;
+    // Where the last taken branch went
+    uint32_t target;
+    // Set for beq, bne and bgt
+    bool conditional;
+  };
+
+  Counters &getCounters(uint32_t addr)
+  {
+    Counters *page = pageTable[addr >> Memory::PAGE_BITS];
+    if (!page)
+    {
+      page = allocatePage(addr >> Memory::PAGE_BITS);
+    }
+    return page[(addr & Memory::PAGE_MASK) >> 2];
+  }
+  const Counters *findCounters(uint32_t addr) const;
+  Counters *allocatePage(uint32_t pageNumber);
+
+  Counters **pageTable;
+  std::vector<uint32_t> allocatedPages;
+  uint64_t operationCounts[isa::OPERATION_COUNT];
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _PROGRAM_IMAGE_HPP_
+#define _PROGRAM_IMAGE_HPP_
+
+#include <cstdint>
+
+// Binary program image written by the linker with -binary. All fields are little endian.
+// The header is followed by rangeCount ranges, and every range points at its raw bytes
+// further down the file.
+const uint32_t PROGRAM_IMAGE_MAGIC = 0x474D4945; // "EIMG"
+const uint32_t PROGRAM_IMAGE_VERSION = 1;
+
+struct ProgramImageHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t rangeCount;
+  uint32_t reserved;
+};
+
+struct ProgramImageRange
+{
+  uint32_t address;
+  uint32_t size;
+  uint32_t offset; // from the start of the file
+  uint32_t reserved;
+};
+
+#endif
@@ -3,13 +3,33 @@
 
 #include <iostream>
 #include <cstdint>
+#include <vector>
+#include "string_pool.hpp"
 
-struct Section
+// An instruction that addresses the literal pool. The pool goes after the last instruction of
+// the section, so its displacement is patched in when the section closes.
+struct LiteralFixup
 {
-  uint32_t base;
-  uint32_t length;
+  uint32_t offset;
+  bool symbol;
+  // The number, or the symbol name
+  uint32_t literal;
 };
 
+// A word that holds the address of a symbol. Whether the symbol is local, and where, is only
+// known once the whole file is read, so the relocation is made at the end.
+struct SymbolReference
+{
+  uint32_t offset;
+  StringId symbol;
+};
 
+struct Section
+{
+  // Encoded contents, the literal pool is appended when the section closes
+  std::vector<uint8_t> data;
+  std::vector<LiteralFixup> literalFixups;
+  std::vector<SymbolReference> symbolReferences;
+};
 
-#endif
\ No newline at end of file
+#endif
@@ -5,11 +5,19 @@
 #include <cstdint>
 #include <vector>
 
+// The contents a section has in one input file, read in place from the mapped file
+struct SectionPiece
+{
+  const uint8_t *data;
+  uint32_t size;
+};
+
 struct SectionInfo
 {
   uint32_t address;
   uint32_t size;
-  std::vector<uint16_t> data;
+  // In the order of the input files
+  std::vector<SectionPiece> pieces;
 };
 
-#endif
\ No newline at end of file
+#endif
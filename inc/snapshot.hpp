@@ -0,0 +1,27 @@
+#ifndef _SNAPSHOT_HPP_
+#define _SNAPSHOT_HPP_
+
+#include <cstdint>
+
+// Guest snapshot written by the emulator with --snapshot-out. All fields are little endian.
+// The header is followed by pageCount page numbers, and the pages themselves start at
+// dataOffset, which is aligned to a page so they can be mapped straight from the file.
+const uint32_t SNAPSHOT_MAGIC = 0x504E5345; // "ESNP"
+const uint32_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t pageCount;
+  uint32_t dataOffset; // from the start of the file
+  uint64_t instructionCount;
+  uint64_t timerTime; // when the timer fires next, UINT64_MAX if it isn't running
+  uint32_t r[16];
+  uint32_t csr[3];
+  uint32_t pendingInterrupts;
+  uint32_t timerConfig;
+  uint32_t timerRestart;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef _SPSC_RING_HPP_
+#define _SPSC_RING_HPP_
+
+#include <cstdint>
+#include <atomic>
+
+// Fixed size queue between exactly one producer thread and one consumer thread, without locks.
+// The indices only ever grow, SIZE must be a power of two so they wrap cleanly.
+template <typename T, uint32_t SIZE>
+class SpscRing
+{
+  static_assert((SIZE & (SIZE - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+  SpscRing() : head(0), tail(0) {}
+
+  // Producer side, returns false if the ring is full
+  bool push(const T &value)
+  {
+    uint32_t currentTail = tail.load(std::memory_order_relaxed);
+    if (currentTail - head.load(std::memory_order_acquire) == SIZE)
+    {
+      return false;
+    }
+    items[currentTail & (SIZE - 1)] = value;
+    tail.store(currentTail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, returns false if the ring is empty
+  bool pop(T &value)
+  {
+    uint32_t currentHead = head.load(std::memory_order_relaxed);
+    if (currentHead == tail.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    value = items[currentHead & (SIZE - 1)];
+    head.store(currentHead + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  // Kept on separate cache lines so the two threads don't contend
+  alignas(64) std::atomic<uint32_t> head;
+  alignas(64) std::atomic<uint32_t> tail;
+  T items[SIZE];
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _STRING_POOL_HPP_
+#define _STRING_POOL_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+typedef uint32_t StringId;
+
+// Keeps one copy of every distinct string, which is then referred to by its index.
+// Indices are handed out in the order the strings are first seen.
+class StringPool
+{
+public:
+  static const StringId NONE = 0xFFFFFFFF;
+
+  StringId intern(const std::string &value);
+  const std::string &get(StringId id) const;
+  uint32_t size() const;
+
+private:
+  std::unordered_map<std::string, StringId> ids;
+  std::vector<std::string> values;
+};
+
+#endif
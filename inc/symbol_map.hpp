@@ -0,0 +1,37 @@
+#ifndef _SYMBOL_MAP_HPP_
+#define _SYMBOL_MAP_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Addresses of the labels of a linked program, read from the map the linker writes with -map.
+// Every line of the map is an address in hex followed by a symbol name.
+class SymbolMap
+{
+public:
+  struct Entry
+  {
+    uint32_t address;
+    std::string name;
+  };
+
+  // Returns false if the map can't be opened or a line isn't an address and a name, the map
+  // is left empty then
+  bool load(const std::string &mapFileName);
+  bool load(std::istream &input);
+  bool empty() const;
+
+  // Returns the index of the closest symbol at or below addr, or -1 if there isn't one
+  int find(uint32_t addr) const;
+  const Entry &getEntry(int index) const;
+  // Formats addr as symbol+offset, or as a plain hex address without a symbol
+  std::string symbolize(uint32_t addr) const;
+
+private:
+  // Sorted by address
+  std::vector<Entry> entries;
+};
+
+#endif
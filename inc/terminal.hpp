@@ -0,0 +1,61 @@
+#ifndef _TERMINAL_HPP_
+#define _TERMINAL_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <thread>
+#include <termios.h>
+#include "spsc_ring.hpp"
+
+// Host side of the guest terminal. Output is collected in a buffer and handed to the stream
+// in one write per flush. Input is read by a host thread and passed to the emulator through
+// a lock-free ring, so the emulator never blocks on the keyboard.
+class Terminal
+{
+public:
+  static const uint32_t OUTPUT_BUFFER_SIZE = 4096;
+  static const uint32_t INPUT_RING_SIZE = 1024;
+
+  Terminal(std::ostream &out);
+  ~Terminal();
+  Terminal(const Terminal &) = delete;
+  Terminal &operator=(const Terminal &) = delete;
+
+  // Starts the input thread on fd. A tty is switched to unbuffered input without echo
+  // until the terminal is destroyed.
+  void startInput(int fd);
+
+  void write(uint8_t character)
+  {
+    if (outputSize == OUTPUT_BUFFER_SIZE)
+    {
+      flush();
+    }
+    outputBuffer[outputSize++] = character;
+  }
+
+  void flush();
+
+  // Returns false if no input is waiting
+  bool readInput(uint8_t &character)
+  {
+    return input.pop(character);
+  }
+
+private:
+  void readInputLoop(int fd);
+
+  std::ostream &out;
+  char outputBuffer[OUTPUT_BUFFER_SIZE];
+  uint32_t outputSize;
+
+  SpscRing<uint8_t, INPUT_RING_SIZE> input;
+  std::thread inputThread;
+  // Written to stop the input thread
+  int wakePipe[2];
+  int inputFd;
+  bool restoreTty;
+  struct termios savedTty;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef _TRACE_WRITER_HPP_
+#define _TRACE_WRITER_HPP_
+
+#include <iostream>
+#include <cstdint>
+
+// Formats trace lines into a fixed buffer and hands it to the stream in large writes,
+// instead of formatting and flushing through the stream for every instruction
+class TraceWriter
+{
+public:
+  static const uint32_t BUFFER_SIZE = 64 * 1024;
+  // Longest piece a single call appends
+  static const uint32_t MAX_PIECE_SIZE = 64;
+
+  TraceWriter(std::ostream &out);
+  ~TraceWriter();
+  TraceWriter(const TraceWriter &) = delete;
+  TraceWriter &operator=(const TraceWriter &) = delete;
+
+  TraceWriter &text(const char *text);
+  // "%r<index>"
+  TraceWriter &reg(uint8_t index);
+  // "0x<value>" without padding
+  TraceWriter &hex(uint32_t value);
+  TraceWriter &dec(int32_t value);
+  TraceWriter &endLine();
+
+  void flush();
+
+private:
+  void reserve()
+  {
+    if (size > BUFFER_SIZE - MAX_PIECE_SIZE)
+    {
+      flush();
+    }
+  }
+
+  std::ostream &out;
+  char buffer[BUFFER_SIZE];
+  uint32_t size;
+};
+
+#endif
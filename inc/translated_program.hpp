@@ -0,0 +1,99 @@
+#ifndef _TRANSLATED_PROGRAM_HPP_
+#define _TRANSLATED_PROGRAM_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "memory.hpp"
+#include "emulator.hpp"
+
+// Base of a guest program that the translator turned into C++ ahead of time. The derived
+// class, written by the translator, runs the blocks it recovered from the image as native
+// code, everything else is left to the interpreter of the core it is attached to.
+//
+// Every guest word a block was translated from, its instructions and the literal pool words
+// it folded into constants, is covered by that block. A write to a covered word drops the
+// block, its address is interpreted from then on.
+class TranslatedProgram
+{
+public:
+  typedef void (*WriteHandler)(void *context, uint32_t addr, uint32_t word);
+
+  struct CoveredWord
+  {
+    uint32_t addr;
+    uint32_t block;
+  };
+
+  // image is the linked program in the format the translator read, coveredWords is sorted by address
+  TranslatedProgram(const std::string &image, const CoveredWord *coveredWords, size_t coveredWordCount,
+                    uint32_t blockCount);
+  virtual ~TranslatedProgram();
+  TranslatedProgram(const TranslatedProgram &) = delete;
+  TranslatedProgram &operator=(const TranslatedProgram &) = delete;
+
+  // Runs on the guest state of a core. Writes that can't take the fast path go through
+  // writeWord, which gets writeContext as its first argument.
+  void attach(Memory &mem, uint32_t *r, uint32_t *csr, WriteHandler writeWord, void *writeContext);
+
+  // Runs translated blocks starting at r[15] until reaching an address without a block or a
+  // block that doesn't fit in maxInstructions. Never overshoots the limit.
+  // Returns the number of guest instructions executed.
+  virtual uint64_t run(uint64_t maxInstructions) = 0;
+
+  // Drops every block that covers the word at addr. Every guest write that doesn't come
+  // from translated code must be reported here.
+  void invalidate(uint32_t addr);
+
+  // Makes run() return once the current instruction completes
+  void requestExit();
+
+  const std::string &getImage() const;
+
+protected:
+  uint32_t readWord(uint32_t addr) const
+  {
+    return mem->readWord(addr);
+  }
+
+  // Returns true if the running block must exit after the current instruction. Device
+  // registers, pages with translated code and pages still shared with the image take the slow path.
+  bool writeWord(uint32_t addr, uint32_t word)
+  {
+    uint32_t offset = addr & Memory::PAGE_MASK;
+    uint8_t *page = mem->getWriteTable()[addr >> Memory::PAGE_BITS];
+    if (page && addr < EmulatorCore::MMIO_START && offset <= Memory::PAGE_SIZE - 4 &&
+        !codePages[addr >> Memory::PAGE_BITS])
+    {
+      uint8_t *p = page + offset;
+      p[0] = (word >> 0) & 0xFF;
+      p[1] = (word >> 8) & 0xFF;
+      p[2] = (word >> 16) & 0xFF;
+      p[3] = (word >> 24) & 0xFF;
+      return false;
+    }
+    writeHandler(writeContext, addr, word);
+    return exitRequested;
+  }
+
+  Memory *mem;
+  uint32_t *r;
+  uint32_t *csr;
+  // Cleared for dropped blocks, the translated code checks it on entry
+  std::vector<uint8_t> blockValid;
+  bool exitRequested;
+
+private:
+  std::string image;
+  std::vector<CoveredWord> coveredWords;
+  // One entry for every guest page, set if any word on it is covered
+  std::vector<uint8_t> codePages;
+  WriteHandler writeHandler;
+  void *writeContext;
+};
+
+// Defined by the translated source
+TranslatedProgram *createTranslatedProgram();
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef _TRANSLATOR_HPP_
+#define _TRANSLATOR_HPP_
+
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include "emulator.hpp"
+
+// Translates a linked program image into C++ ahead of time. The blocks are recovered from
+// the entry point by following branch and call targets, which the assembler keeps in literal
+// pools, so they are known without running the program. Return addresses and the interrupt
+// handler installed with ld $handler and csrwr are followed as well.
+//
+// Every block becomes straight-line C++ with the guest registers in locals, and direct
+// branches between blocks become gotos. Computed targets go through a switch over the
+// block addresses, and any address without a block, like code that is only reached through
+// a computed target, is left to the interpreter of the core that runs the program.
+// Literal pool loads are folded into constants, the block is dropped if the guest writes them.
+class Translator
+{
+public:
+  static const uint32_t MAX_BLOCK_INSTRUCTIONS = 64;
+
+  Translator();
+
+  // Reads the linked program, either the text hex format or the binary format.
+  // Returns false if it can't be read.
+  bool load(const std::string &inputFileName);
+  // Recovers every block reachable from entry
+  void translate(uint32_t entry);
+  // Writes the C++ source of a TranslatedProgram, with the image embedded
+  void write(std::ostream &out) const;
+
+  uint32_t getBlockCount() const;
+  uint32_t getInstructionCount() const;
+
+private:
+  struct Block
+  {
+    uint32_t start;
+    uint32_t length;
+    // Words the block was translated from, its instructions and the literals it folded
+    std::vector<uint32_t> coveredWords;
+  };
+
+  static bool isTranslatable(const DecodedInstruction &instruction);
+  static uint16_t getWrittenRegisters(const DecodedInstruction &instruction);
+  static bool isBlockEnd(const DecodedInstruction &instruction);
+  bool isLoaded(uint32_t addr) const;
+  bool getLiteral(const DecodedInstruction &instruction, uint32_t pc, uint32_t &addr, uint32_t &value) const;
+  void addLeader(uint32_t addr);
+  void explore(uint32_t pc);
+  void writeBlock(std::ostream &out, const Block &block) const;
+  void writeInstruction(std::ostream &out, const Block &block, uint32_t pc, uint32_t index) const;
+  void writeJump(std::ostream &out, const std::string &indent, uint32_t target) const;
+
+  std::string image;
+  EmulatorCore core;
+  const Memory *mem;
+  // Addresses that start a block
+  std::set<uint32_t> leaders;
+  std::vector<uint32_t> pending;
+  std::set<uint32_t> explored;
+  std::vector<Block> blocks;
+  // Index into blocks by start address
+  std::map<uint32_t, uint32_t> blockIndex;
+};
+
+#endif
@@ -12,51 +12,70 @@
   int currentLineNumber = -1;
   Directive currentDirective;
   Instruction currentInstruction;
-  std::vector<Line> parsedLines;
-  Line currentLine;
+  // Symbol names and strings of every parsed line
+  StringPool parsedStrings;
+  Line currentLine = {0, LineType::DIRECTIVE, StringPool::NONE, {}, {}};
   bool stopParsing = false;
 
   void resetValues()
   {
-    currentDirective.mnemonic = "";
     currentDirective.argList.clear();
-    currentInstruction.mnemonic = "";
-    currentInstruction.reg1 = "";
-    currentInstruction.reg2 = "";
-    currentInstruction.operand = "";
-    currentInstruction.operand_type = "";
-    currentInstruction.offset = "";
-    currentLine.type = "";
-    currentLine.label = "";
+    currentInstruction.reg1 = 0;
+    currentInstruction.reg2 = 0;
+    currentInstruction.operandKind = OperandKind::NONE;
+    currentInstruction.operandReg = 0;
+    currentInstruction.offset = 0;
+    currentInstruction.operand = 0;
+    currentLine.label = StringPool::NONE;
   }
 
-  void addArgument(std::string argument, std::string type)
+  void addArgument(const char *argument, ArgumentType type)
   {
-    currentDirective.argList.push_back({type, argument});
+    uint32_t value;
+    if (type == ArgumentType::NUMBER)
+    {
+      value = assembler::stringToUnsignedInt(argument);
+    }
+    else
+    {
+      value = parsedStrings.intern(argument);
+    }
+    currentDirective.argList.push_back({type, value});
+  }
+
+  void setOperand(const char *operand, OperandKind kind)
+  {
+    if (kind == OperandKind::NUM || kind == OperandKind::MEM_NUM)
+    {
+      currentInstruction.operand = assembler::stringToUnsignedInt(operand);
+    }
+    else
+    {
+      currentInstruction.operand = parsedStrings.intern(operand);
+    }
+    currentInstruction.operandKind = kind;
   }
 
   void createDirective()
   {
-    currentLine.type = "directive";
+    currentLine.type = LineType::DIRECTIVE;
     currentLine.directive = currentDirective;
     currentLine.number = currentLineNumber;
     if (!stopParsing)
     {
-      parsedLines.push_back(currentLine);
-      assembler::handleLineFirstPass(currentLine);
+      assembler::handleLine(currentLine);
     }
     resetValues();
   }
 
   void createInstruction() 
   {
-    currentLine.type = "instruction"; 
+    currentLine.type = LineType::INSTRUCTION; 
     currentLine.instruction = currentInstruction; 
     currentLine.number = currentLineNumber;
     if (!stopParsing)
     {
-      parsedLines.push_back(currentLine);
-      assembler::handleLineFirstPass(currentLine);
+      assembler::handleLine(currentLine);
     }
     resetValues();
   }
@@ -95,7 +114,7 @@ line:
 ;
 
 label:
-  SYMBOL      { currentLine.label = $1; }
+  SYMBOL      { currentLine.label = parsedStrings.intern($1); }
 ;
 
 directive:
@@ -109,36 +128,36 @@ directive:
 ;
 
 global:
-  GLOBAL SYMBOL       { currentDirective.mnemonic = "global"; addArgument($2, "symbol"); currentLineNumber = yylineno; }
-| global ',' SYMBOL   { currentDirective.mnemonic = "global"; addArgument($3, "symbol"); }
+  GLOBAL SYMBOL       { currentDirective.mnemonic = DirectiveType::GLOBAL; addArgument($2, ArgumentType::SYMBOL); currentLineNumber = yylineno; }
+| global ',' SYMBOL   { currentDirective.mnemonic = DirectiveType::GLOBAL; addArgument($3, ArgumentType::SYMBOL); }
 ;
 
 extern:
-  EXTERN SYMBOL       { currentDirective.mnemonic = "extern"; addArgument($2, "symbol"); currentLineNumber = yylineno; }
-| extern ',' SYMBOL   { currentDirective.mnemonic = "extern"; addArgument($3, "symbol"); }
+  EXTERN SYMBOL       { currentDirective.mnemonic = DirectiveType::EXTERN; addArgument($2, ArgumentType::SYMBOL); currentLineNumber = yylineno; }
+| extern ',' SYMBOL   { currentDirective.mnemonic = DirectiveType::EXTERN; addArgument($3, ArgumentType::SYMBOL); }
 ;
 
 section:
-  SECTION SYMBOL       { currentDirective.mnemonic = "section"; addArgument($2, "symbol"); currentLineNumber = yylineno; }
+  SECTION SYMBOL       { currentDirective.mnemonic = DirectiveType::SECTION; addArgument($2, ArgumentType::SYMBOL); currentLineNumber = yylineno; }
 ;
 
 word:
-  WORD NUMBER       { currentDirective.mnemonic = "word"; addArgument($2, "number"); currentLineNumber = yylineno; }
-| WORD SYMBOL       { currentDirective.mnemonic = "word"; addArgument($2, "symbol"); currentLineNumber = yylineno; }
-| word ',' NUMBER   { currentDirective.mnemonic = "word"; addArgument($3, "number"); }
-| word ',' SYMBOL   { currentDirective.mnemonic = "word"; addArgument($3, "symbol"); }
+  WORD NUMBER       { currentDirective.mnemonic = DirectiveType::WORD; addArgument($2, ArgumentType::NUMBER); currentLineNumber = yylineno; }
+| WORD SYMBOL       { currentDirective.mnemonic = DirectiveType::WORD; addArgument($2, ArgumentType::SYMBOL); currentLineNumber = yylineno; }
+| word ',' NUMBER   { currentDirective.mnemonic = DirectiveType::WORD; addArgument($3, ArgumentType::NUMBER); }
+| word ',' SYMBOL   { currentDirective.mnemonic = DirectiveType::WORD; addArgument($3, ArgumentType::SYMBOL); }
 ;
 
 skip:
-  SKIP NUMBER       { currentDirective.mnemonic = "skip"; addArgument($2, "number"); currentLineNumber = yylineno; }
+  SKIP NUMBER       { currentDirective.mnemonic = DirectiveType::SKIP; addArgument($2, ArgumentType::NUMBER); currentLineNumber = yylineno; }
 ;
 
 end:
-  END       { currentDirective.mnemonic = "end"; currentLineNumber = yylineno; }
+  END       { currentDirective.mnemonic = DirectiveType::END; currentLineNumber = yylineno; }
 ;
 
 ascii:
-  ASCII STRING      { currentDirective.mnemonic = "ascii"; addArgument($2, "string"); currentLineNumber = yylineno; }
+  ASCII STRING      { currentDirective.mnemonic = DirectiveType::ASCII; addArgument($2, ArgumentType::STRING); currentLineNumber = yylineno; }
 ;
 
 instr:
@@ -171,150 +190,150 @@ instr:
 ;
 
 halt:
-  HALT  { currentInstruction.mnemonic = "halt"; currentLineNumber = yylineno; }
+  HALT  { currentInstruction.mnemonic = Mnemonic::HALT; currentLineNumber = yylineno; }
 ;
 
 int:
-  INT  { currentInstruction.mnemonic = "int"; currentLineNumber = yylineno; }
+  INT  { currentInstruction.mnemonic = Mnemonic::INT; currentLineNumber = yylineno; }
 ;
 
 iret:
-  IRET  { currentInstruction.mnemonic = "iret"; currentLineNumber = yylineno; }
+  IRET  { currentInstruction.mnemonic = Mnemonic::IRET; currentLineNumber = yylineno; }
 ;
 
 call:
-  CALL operand_branch  { currentInstruction.mnemonic = "call"; currentLineNumber = yylineno; }
+  CALL operand_branch  { currentInstruction.mnemonic = Mnemonic::CALL; currentLineNumber = yylineno; }
 
 ret:
-  RET  { currentInstruction.mnemonic = "ret"; currentLineNumber = yylineno; }
+  RET  { currentInstruction.mnemonic = Mnemonic::RET; currentLineNumber = yylineno; }
 ;
 
 jmp:
-  JMP operand_branch  { currentInstruction.mnemonic = "jmp"; currentLineNumber = yylineno; }
+  JMP operand_branch  { currentInstruction.mnemonic = Mnemonic::JMP; currentLineNumber = yylineno; }
 ;
 
 beq:
-  BEQ instr_gpr1 ',' instr_gpr2 ',' operand_branch { currentInstruction.mnemonic = "beq"; currentLineNumber = yylineno; }
+  BEQ instr_gpr1 ',' instr_gpr2 ',' operand_branch { currentInstruction.mnemonic = Mnemonic::BEQ; currentLineNumber = yylineno; }
 ;
 bne:
-  BNE instr_gpr1 ',' instr_gpr2 ',' operand_branch { currentInstruction.mnemonic = "bne"; currentLineNumber = yylineno; }
+  BNE instr_gpr1 ',' instr_gpr2 ',' operand_branch { currentInstruction.mnemonic = Mnemonic::BNE; currentLineNumber = yylineno; }
 ;
 bgt:
-  BGT instr_gpr1 ',' instr_gpr2 ',' operand_branch { currentInstruction.mnemonic = "bgt"; currentLineNumber = yylineno; }
+  BGT instr_gpr1 ',' instr_gpr2 ',' operand_branch { currentInstruction.mnemonic = Mnemonic::BGT; currentLineNumber = yylineno; }
 ;
 
 push:
-  PUSH instr_gpr1  { currentInstruction.mnemonic = "push"; currentLineNumber = yylineno; }
+  PUSH instr_gpr1  { currentInstruction.mnemonic = Mnemonic::PUSH; currentLineNumber = yylineno; }
 ;
 
 pop:
-  POP instr_gpr1  { currentInstruction.mnemonic = "pop"; currentLineNumber = yylineno; }
+  POP instr_gpr1  { currentInstruction.mnemonic = Mnemonic::POP; currentLineNumber = yylineno; }
 ;
 
 xchg:
-  XCHG instr_gpr1 ',' instr_gpr2  { currentInstruction.mnemonic = "xchg"; currentLineNumber = yylineno; }
+  XCHG instr_gpr1 ',' instr_gpr2  { currentInstruction.mnemonic = Mnemonic::XCHG; currentLineNumber = yylineno; }
 ;
 
 add:
-  ADD instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = "add"; currentLineNumber = yylineno; }
+  ADD instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = Mnemonic::ADD; currentLineNumber = yylineno; }
 ;
 
 sub:
-  SUB instr_gpr1 ',' instr_gpr2  { currentInstruction.mnemonic = "sub"; currentLineNumber = yylineno; }
+  SUB instr_gpr1 ',' instr_gpr2  { currentInstruction.mnemonic = Mnemonic::SUB; currentLineNumber = yylineno; }
 ;
 
 mul:
-  MUL instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = "mul"; currentLineNumber = yylineno; }
+  MUL instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = Mnemonic::MUL; currentLineNumber = yylineno; }
 ;
 
 div:
-  DIV instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = "div"; currentLineNumber = yylineno; }
+  DIV instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = Mnemonic::DIV; currentLineNumber = yylineno; }
 ;
 
 not:
-  NOT instr_gpr1  { currentInstruction.mnemonic = "not"; currentLineNumber = yylineno; }
+  NOT instr_gpr1  { currentInstruction.mnemonic = Mnemonic::NOT; currentLineNumber = yylineno; }
 ;
 
 and:
-  AND instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = "and"; currentLineNumber = yylineno; }
+  AND instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = Mnemonic::AND; currentLineNumber = yylineno; }
 ;
 
 or:
-  OR instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = "or"; currentLineNumber = yylineno; }
+  OR instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = Mnemonic::OR; currentLineNumber = yylineno; }
 ;
 
 xor:
-  XOR instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = "xor"; currentLineNumber = yylineno; }
+  XOR instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = Mnemonic::XOR; currentLineNumber = yylineno; }
 ;
 
 shl:
-  SHL instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = "shl"; currentLineNumber = yylineno; }
+  SHL instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = Mnemonic::SHL; currentLineNumber = yylineno; }
 ;
 
 shr:
-  SHR instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = "shr"; currentLineNumber = yylineno; }
+  SHR instr_gpr1 ',' instr_gpr2   { currentInstruction.mnemonic = Mnemonic::SHR; currentLineNumber = yylineno; }
 ;
 
 ld:
-  LD operand_ld ',' instr_gpr1  { currentInstruction.mnemonic = "ld"; currentLineNumber = yylineno; }
+  LD operand_ld ',' instr_gpr1  { currentInstruction.mnemonic = Mnemonic::LD; currentLineNumber = yylineno; }
 ;
 
 st:
-  ST instr_gpr1 ',' operand_st { currentInstruction.mnemonic = "st"; currentLineNumber = yylineno; }
+  ST instr_gpr1 ',' operand_st { currentInstruction.mnemonic = Mnemonic::ST; currentLineNumber = yylineno; }
 ;
 
 csrrd:
-  CSRRD instr_csr1 ',' instr_gpr2  { currentInstruction.mnemonic = "csrrd"; currentLineNumber = yylineno; }
+  CSRRD instr_csr1 ',' instr_gpr2  { currentInstruction.mnemonic = Mnemonic::CSRRD; currentLineNumber = yylineno; }
 ;
 
 csrwr:
-  CSRWR instr_gpr1 ',' instr_csr2 { currentInstruction.mnemonic = "csrwr"; currentLineNumber = yylineno; }
+  CSRWR instr_gpr1 ',' instr_csr2 { currentInstruction.mnemonic = Mnemonic::CSRWR; currentLineNumber = yylineno; }
 ;
 
 
 
 instr_gpr1:
-  GPR         { currentInstruction.reg1 = $1; }
+  GPR         { currentInstruction.reg1 = assembler::getGprIndex($1); }
 ;
 
 instr_gpr2:
-  GPR         { currentInstruction.reg2 = $1; }
+  GPR         { currentInstruction.reg2 = assembler::getGprIndex($1); }
 ;
 
 instr_csr1:
-  CSR         { currentInstruction.reg1 = $1; }
+  CSR         { currentInstruction.reg1 = assembler::getCsrIndex($1); }
 ;
 
 instr_csr2:
-  CSR         { currentInstruction.reg2 = $1; }
+  CSR         { currentInstruction.reg2 = assembler::getCsrIndex($1); }
 ;
 
 operand_reg:
-  GPR         { currentInstruction.operand = $1; }
+  GPR         { currentInstruction.operandReg = assembler::getGprIndex($1); }
 ;
 
 operand_ld:
-  '$' SYMBOL          { currentInstruction.operand = $2; currentInstruction.operand_type = "sym"; }
-| '$' NUMBER          { currentInstruction.operand = $2; currentInstruction.operand_type = "num"; }
-| SYMBOL              { currentInstruction.operand = $1; currentInstruction.operand_type = "mem[sym]"; }
-| NUMBER              { currentInstruction.operand = $1; currentInstruction.operand_type = "mem[num]"; }
-| '[' operand_reg ']' { currentInstruction.operand_type = "mem[reg]"; }
+  '$' SYMBOL          { setOperand($2, OperandKind::SYM); }
+| '$' NUMBER          { setOperand($2, OperandKind::NUM); }
+| SYMBOL              { setOperand($1, OperandKind::MEM_SYM); }
+| NUMBER              { setOperand($1, OperandKind::MEM_NUM); }
+| '[' operand_reg ']' { currentInstruction.operandKind = OperandKind::MEM_REG; }
 | '[' operand_reg '+' offset ']'
 ;
 
 operand_st:
- SYMBOL               { currentInstruction.operand = $1; currentInstruction.operand_type = "mem[sym]"; }
-| NUMBER              { currentInstruction.operand = $1; currentInstruction.operand_type = "mem[num]"; }
-| '[' operand_reg ']' { currentInstruction.operand_type = "mem[reg]"; }
+ SYMBOL               { setOperand($1, OperandKind::MEM_SYM); }
+| NUMBER              { setOperand($1, OperandKind::MEM_NUM); }
+| '[' operand_reg ']' { currentInstruction.operandKind = OperandKind::MEM_REG; }
 | '[' operand_reg '+' offset ']'
 ;
 
 operand_branch:
- SYMBOL               { currentInstruction.operand = $1; currentInstruction.operand_type = "sym"; }
-| NUMBER              { currentInstruction.operand = $1; currentInstruction.operand_type = "num"; }
+ SYMBOL               { setOperand($1, OperandKind::SYM); }
+| NUMBER              { setOperand($1, OperandKind::NUM); }
 
 offset:
-  NUMBER      { currentInstruction.offset = $1; currentInstruction.operand_type = "mem[reg+num]"; }
+  NUMBER      { currentInstruction.offset = assembler::stringToSignedInt($1); currentInstruction.operandKind = OperandKind::MEM_REG_NUM; }
 
 %%
 
@@ -340,36 +359,61 @@ void printParsingStatus(int parseStatus)
   }
 }
 
-// Print parsed instructions and directives, with all of their data
-void printParsingData()
+const char *mnemonicNames[] = {"halt", "int", "iret", "call", "ret", "jmp", "beq", "bne", "bgt",
+                               "push", "pop", "xchg", "add", "sub", "mul", "div", "not", "and",
+                               "or", "xor", "shl", "shr", "ld", "st", "csrrd", "csrwr"};
+const char *directiveNames[] = {"global", "extern", "section", "word", "skip", "end", "ascii"};
+const char *operandKindNames[] = {"", "num", "sym", "mem[num]", "mem[sym]", "mem[reg]", "mem[reg+num]"};
+const char *argumentTypeNames[] = {"symbol", "number", "string"};
+
+// Print a parsed instruction or directive, with all of its data
+void printParsedLine(const Line &line)
 {
-  for (const auto &line : parsedLines)
-  {
-    std::cout << "line number: " << line.number << std::endl
-              << "label: " << line.label << std::endl
-              << "type: " << line.type << std::endl;
+  std::cout << "line number: " << line.number << std::endl
+            << "label: " << (line.label != StringPool::NONE ? parsedStrings.get(line.label) : "") << std::endl
+            << "type: " << (line.type == LineType::INSTRUCTION ? "instruction" : "directive") << std::endl;
 
-    if (line.type == "instruction")
+  if (line.type == LineType::INSTRUCTION)
+  {
+    const Instruction &instruction = line.instruction;
+    std::cout << "mnemonic: " << mnemonicNames[(int)instruction.mnemonic] << std::endl
+              << "reg1: " << (int)instruction.reg1 << std::endl
+              << "reg2: " << (int)instruction.reg2 << std::endl;
+    if (instruction.operandKind == OperandKind::SYM || instruction.operandKind == OperandKind::MEM_SYM)
     {
-      std::cout << "mnemonic: " << line.instruction.mnemonic << std::endl
-                << "reg1: " << line.instruction.reg1 << std::endl
-                << "reg2: " << line.instruction.reg2 << std::endl
-                << "operand: " << line.instruction.operand << std::endl
-                << "offset: " << line.instruction.offset << std::endl
-                << "operand_type: " << line.instruction.operand_type << std::endl
-                << std::endl;
+      std::cout << "operand: " << parsedStrings.get(instruction.operand) << std::endl;
     }
-    else if (line.type == "directive")
+    else if (instruction.operandKind == OperandKind::MEM_REG || instruction.operandKind == OperandKind::MEM_REG_NUM)
     {
-      std::cout << "mnemonic: " << line.directive.mnemonic << std::endl;
-      int i = 0;
-      for (const auto& arg : line.directive.argList)
+      std::cout << "operand: " << (int)instruction.operandReg << std::endl;
+    }
+    else
+    {
+      std::cout << "operand: " << instruction.operand << std::endl;
+    }
+    std::cout << "offset: " << instruction.offset << std::endl
+              << "operand_type: " << operandKindNames[(int)instruction.operandKind] << std::endl
+              << std::endl;
+  }
+  else if (line.type == LineType::DIRECTIVE)
+  {
+    std::cout << "mnemonic: " << directiveNames[(int)line.directive.mnemonic] << std::endl;
+    int i = 0;
+    for (const auto& arg : line.directive.argList)
+    {
+      std::cout << "arg " << i << ": ";
+      if (arg.type == ArgumentType::NUMBER)
+      {
+        std::cout << arg.value;
+      }
+      else
       {
-        std::cout << "arg " << i << ": " << arg.value << " - " << arg.type << std::endl;
-        ++i;
+        std::cout << parsedStrings.get(arg.value);
       }
-      std::cout << std::endl;
+      std::cout << " - " << argumentTypeNames[(int)arg.type] << std::endl;
+      ++i;
     }
+    std::cout << std::endl;
   }
 }
 
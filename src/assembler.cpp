@@ -1,35 +1,44 @@
 #include <vector>
-#include <iomanip>
-#include <unordered_map>
-#include <unordered_set>
+#include <map>
 #include "../misc/parser.hpp"
 #include "../inc/assembler.hpp"
 #include "../inc/relocation.hpp"
 #include "../inc/symbol.hpp"
 #include "../inc/section.hpp"
+#include "../inc/isa.hpp"
+#include "../inc/object_writer.hpp"
+#include "../inc/object_file.hpp"
 
-extern std::vector<Line> parsedLines;
+extern StringPool parsedStrings;
 extern FILE *yyin;
 extern int yylineno;
 extern bool stopParsing;
 extern void printParsingStatus(int32_t parseStatus);
-extern void printParsingData();
+extern void printParsedLine(const Line &line);
 
+// Assembles in one pass, every line is encoded into its section as soon as it is parsed and
+// then dropped. References to the literal pool are patched when their section closes, the
+// relocations are made at the end of the file, once every symbol is known.
 namespace assembler
 {
   FILE *inputFile;
   std::ofstream outputFile;
-  std::unordered_set<std::string> globalSymbols;
-  std::unordered_map<std::string, Symbol> symbolTable;
-  // Used for calculating offsets within a section
-  std::unordered_map<std::string, Section> sectionTable;
-  std::map<std::pair<std::string, uint32_t>, uint32_t> literalNumTable;
-  std::map<std::pair<std::string, std::string>, uint32_t> literalSymTable;
-  std::unordered_map<std::string, std::vector<Relocation>> relocationTable;
-  std::string currentSection = "ABS";
-  uint32_t locationCounter = 0;
-
-  uint32_t stringToUnsignedInt(std::string value)
+  // Symbols and sections are identified by their interned names
+  const StringId ABS = StringPool::NONE;
+  // Indexed by symbol name, symbolDefined is set for every entry that is in the table
+  std::vector<Symbol> symbolTable;
+  std::vector<uint8_t> symbolDefined;
+  std::vector<uint8_t> globalSymbols;
+  std::map<StringId, Section> sectionTable;
+  // In the order they appear in the file
+  std::vector<StringId> sectionOrder;
+  // Literal pool of the current section, with the offset of every literal once it closes
+  std::map<uint32_t, uint32_t> literalNumTable;
+  std::map<StringId, uint32_t> literalSymTable;
+  StringId currentSection = ABS;
+  Section *current = nullptr;
+
+  uint32_t stringToUnsignedInt(const std::string &value)
   {
     if (value.length() > 2)
     {
@@ -41,7 +50,7 @@ namespace assembler
     return stoi(value);
   }
 
-  int16_t stringToSignedInt(std::string value)
+  int16_t stringToSignedInt(const std::string &value)
   {
     if (value.length() > 2)
     {
@@ -58,19 +67,20 @@ namespace assembler
     return stoi(value);
   }
 
-  bool isContentOutOfSection(Line line)
+  bool isContentOutOfSection(const Line &line)
   {
-    if (currentSection != "ABS")
+    if (currentSection != ABS)
     {
       return false;
     }
-    if (line.label != "")
+    if (line.label != StringPool::NONE)
     {
       return true;
     }
-    if (line.type == "directive")
+    if (line.type == LineType::DIRECTIVE)
     {
-      if (line.directive.mnemonic != "word" && line.directive.mnemonic != "skip" && line.directive.mnemonic != "ascii")
+      if (line.directive.mnemonic != DirectiveType::WORD && line.directive.mnemonic != DirectiveType::SKIP &&
+          line.directive.mnemonic != DirectiveType::ASCII)
       {
         return false;
       }
@@ -79,395 +89,212 @@ namespace assembler
     return true;
   }
 
-  void setIOFiles(std::string inputFileName, std::string outputFileName)
+  const std::string &getName(StringId name)
   {
-    inputFile = fopen(inputFileName.c_str(), "r");
-    outputFile.open(outputFileName);
-
-    if (!outputFile.is_open())
+    static const std::string absName = "ABS";
+    if (name == ABS)
     {
-      std::cout << "Error opening output file." << std::endl;
-      exit(1);
+      return absName;
     }
+    return parsedStrings.get(name);
   }
 
-  void addLabelSymbol(std::string symbolName)
+  bool hasSymbol(StringId name)
   {
-    if (symbolTable.count(symbolName) > 0 && symbolTable[symbolName].section != "UND")
-    {
-      std::cout << "Assembler error, symbol " << symbolName << " redefinition." << std::endl;
-      exit(1);
-    }
-    if (globalSymbols.count(symbolName) == 0)
-    {
-      symbolTable[symbolName].scope = ScopeType::LOCAL;
-    }
-    symbolTable[symbolName].value = locationCounter - sectionTable[currentSection].base;
-    symbolTable[symbolName].size = 0;
-    symbolTable[symbolName].type = SymbolType::NOTYPE;
-    symbolTable[symbolName].section = currentSection;
+    return name < symbolDefined.size() && symbolDefined[name];
   }
 
-  void addSectionSymbol(std::string symbolName)
+  // Adds the entry if it isn't in the table yet
+  Symbol &getSymbol(StringId name)
   {
-    if (symbolTable.count(symbolName) > 0)
+    if (name >= symbolTable.size())
     {
-      std::cout << "Assembler error, symbol " << symbolName << " redefinition." << std::endl;
-      exit(1);
+      symbolTable.resize(parsedStrings.size());
+      symbolDefined.resize(parsedStrings.size(), 0);
+      globalSymbols.resize(parsedStrings.size(), 0);
     }
-    symbolTable[symbolName] = {0, 0, SymbolType::SECTION, ScopeType::LOCAL, symbolName};
+    symbolDefined[name] = 1;
+    return symbolTable[name];
   }
 
-  // If an undefined symbol is used, it is treated as extern
-  void addInstructionSymbol(std::string symbolName)
+  bool isGlobalSymbol(StringId name)
   {
-    if (symbolTable.count(symbolName) > 0)
-    {
-      return;
-    }
-    symbolTable[symbolName] = {0, 0, SymbolType::NOTYPE, ScopeType::GLOBAL, "UND"};
+    return name < globalSymbols.size() && globalSymbols[name];
   }
 
-  void addRelocationInstruction(std::string symbolName)
+  void setText()
   {
-    uint32_t relOffset = literalSymTable[std::make_pair(currentSection, symbolName)];
-    uint32_t relAddend;
-    std::string relSymbolName;
-    if (symbolTable[symbolName].scope == ScopeType::LOCAL)
-    {
-      relAddend = symbolTable[symbolName].value;
-      relSymbolName = symbolTable[symbolName].section;
-    }
-    else if (symbolTable[symbolName].scope == ScopeType::GLOBAL)
+    isText = true;
+  }
+
+  void setIOFiles(std::string inputFileName, std::string outputFileName)
+  {
+    inputFile = fopen(inputFileName.c_str(), "r");
+    outputFile.open(outputFileName, isText ? std::ios::out : std::ios::out | std::ios::binary);
+
+    if (!outputFile.is_open())
     {
-      relAddend = 0;
-      relSymbolName = symbolName;
+      std::cout << "Error opening output file." << std::endl;
+      exit(1);
     }
-    relocationTable[currentSection].push_back({relOffset, relSymbolName, relAddend});
   }
 
-  void addRelocationWordDirective(std::string symbolName)
+  void addLabelSymbol(StringId symbolName)
   {
-    uint32_t relOffset = locationCounter - sectionTable[currentSection].base;
-    uint32_t relAddend = 0;
-    std::string relSymbolName;
-    if (symbolTable[symbolName].scope == ScopeType::LOCAL)
+    if (hasSymbol(symbolName) && symbolTable[symbolName].section != "UND")
     {
-      relAddend = symbolTable[symbolName].value;
-      relSymbolName = symbolTable[symbolName].section;
+      std::cout << "Assembler error, symbol " << getName(symbolName) << " redefinition." << std::endl;
+      exit(1);
     }
-    else if (symbolTable[symbolName].scope == ScopeType::GLOBAL)
+    Symbol &symbol = getSymbol(symbolName);
+    if (!isGlobalSymbol(symbolName))
     {
-      relAddend = 0;
-      relSymbolName = symbolName;
+      symbol.scope = ScopeType::LOCAL;
     }
-    relocationTable[currentSection].push_back({relOffset, relSymbolName, relAddend});
+    symbol.value = current->data.size();
+    symbol.size = 0;
+    symbol.type = SymbolType::NOTYPE;
+    symbol.section = getName(currentSection);
   }
 
-  void outputByte(uint16_t byteHigh, uint16_t byteLow)
+  void addSectionSymbol(StringId symbolName)
   {
-    // if (!(locationCounter % 8))
-    // {
-    //   outputFile << std::dec << std::setw(4) << std::right << std::setfill('0') << locationCounter << ": ";
-    // }
-    outputFile << std::setw(1) << std::left << std::setfill(' ') << std::hex << byteHigh;
-    outputFile << std::setw(2) << std::left << std::setfill(' ') << std::hex << byteLow;
-    locationCounter += 1;
-    if (!(locationCounter % 8))
+    if (hasSymbol(symbolName))
     {
-      outputFile << std::endl;
+      std::cout << "Assembler error, symbol " << getName(symbolName) << " redefinition." << std::endl;
+      exit(1);
     }
+    getSymbol(symbolName) = {0, 0, SymbolType::SECTION, ScopeType::LOCAL, getName(symbolName)};
   }
 
-  void outputWord(uint16_t byte4High, uint16_t byte4Low, uint16_t byte3High, uint16_t byte3Low, uint16_t byte2High, uint16_t byte2Low, uint16_t byte1High, uint16_t byte1Low)
+  // If an undefined symbol is used, it is treated as extern
+  void addInstructionSymbol(StringId symbolName)
   {
-    outputByte(byte1High, byte1Low);
-    outputByte(byte2High, byte2Low);
-    outputByte(byte3High, byte3Low);
-    outputByte(byte4High, byte4Low);
+    if (hasSymbol(symbolName))
+    {
+      return;
+    }
+    getSymbol(symbolName) = {0, 0, SymbolType::NOTYPE, ScopeType::GLOBAL, "UND"};
   }
 
-  void outputWordDisp(uint16_t byte4High, uint16_t byte4Low, uint16_t byte3High, uint16_t byte3Low, uint16_t byte2High, uint32_t disp)
+  void appendWord(Section &section, uint32_t word)
   {
-    uint16_t byte2Low = (disp & 0x00000F00) >> 8;
-    uint16_t byte1High = (disp & 0x000000F0) >> 4;
-    uint16_t byte1Low = (disp & 0x0000000F);
-    outputByte(byte1High, byte1Low);
-    outputByte(byte2High, byte2Low);
-    outputByte(byte3High, byte3Low);
-    outputByte(byte4High, byte4Low);
+    section.data.push_back(word & 0xFF);
+    section.data.push_back((word >> 8) & 0xFF);
+    section.data.push_back((word >> 16) & 0xFF);
+    section.data.push_back((word >> 24) & 0xFF);
   }
 
-  void outputInteger(uint32_t value)
+  void outputInstruction(isa::Operation operation, uint32_t regA, uint32_t regB, uint32_t regC, uint32_t disp)
   {
-    uint16_t byte4High = (value & 0xF0000000) >> 28;
-    uint16_t byte4Low = (value & 0x0F000000) >> 24;
-    uint16_t byte3High = (value & 0x00F00000) >> 20;
-    uint16_t byte3Low = (value & 0x000F0000) >> 16;
-    uint16_t byte2High = (value & 0x0000F000) >> 12;
-    uint16_t byte2Low = (value & 0x00000F00) >> 8;
-    uint16_t byte1High = (value & 0x000000F0) >> 4;
-    uint16_t byte1Low = (value & 0x0000000F);
-    outputWord(byte4High, byte4Low, byte3High, byte3Low,
-               byte2High, byte2Low, byte1High, byte1Low);
+    appendWord(*current, isa::encode(operation, regA, regB, regC, disp));
   }
 
-  void outputString(std::string value)
+  // Adds the literal of the instruction about to be encoded to the pool, its displacement is
+  // left 0 until the pool is placed
+  void addLiteral(const Instruction &instruction)
   {
-    std::vector<uint16_t> bytes;
-    for (const auto &c : value)
+    uint32_t offset = current->data.size();
+    if (instruction.operandKind == OperandKind::NUM || instruction.operandKind == OperandKind::MEM_NUM)
     {
-      bytes.push_back(c);
+      literalNumTable[instruction.operand];
+      current->literalFixups.push_back({offset, false, instruction.operand});
     }
-    for (const auto &byte : bytes)
+    if (instruction.operandKind == OperandKind::SYM || instruction.operandKind == OperandKind::MEM_SYM)
     {
-      uint16_t byteHigh = (byte & 0x000000F0) >> 4;
-      uint16_t byteLow = (byte & 0x0000000F);
-      outputByte(byteHigh, byteLow);
+      addInstructionSymbol(instruction.operand);
+      literalSymTable[instruction.operand];
+      current->literalFixups.push_back({offset, true, instruction.operand});
     }
   }
 
-  // After passing through the section, assign addresses to every literal in the literal pool
-  void literalPoolFirstPass()
+  // Places the literal pool after the last instruction and patches every reference to it
+  void closeSection()
   {
     for (auto &num : literalNumTable)
     {
-      if (num.first.first != currentSection)
-      {
-        continue;
-      }
-      num.second = locationCounter - sectionTable[currentSection].base;
-      locationCounter += 4;
+      num.second = current->data.size();
+      appendWord(*current, num.first);
     }
     for (auto &sym : literalSymTable)
     {
-      if (sym.first.first != currentSection)
-      {
-        continue;
-      }
-      sym.second = locationCounter - sectionTable[currentSection].base;
-      locationCounter += 4;
-    }
-  }
-
-  void literalPoolSecondPass()
-  {
-    for (const auto &num : literalNumTable)
-    {
-      if (num.first.first != currentSection)
-      {
-        continue;
-      }
-      outputInteger((num.first).second);
+      sym.second = current->data.size();
+      current->symbolReferences.push_back({sym.second, sym.first});
+      appendWord(*current, 0);
     }
-    for (const auto &sym : literalSymTable)
+    for (const auto &fixup : current->literalFixups)
     {
-      if (sym.first.first != currentSection)
-      {
-        continue;
-      }
-      outputInteger(0);
-      addRelocationInstruction(sym.first.second);
+      uint32_t literal = fixup.symbol ? literalSymTable[fixup.literal] : literalNumTable[fixup.literal];
+      uint32_t disp = literal - fixup.offset - 4;
+      current->data[fixup.offset] = disp & 0xFF;
+      current->data[fixup.offset + 1] |= (disp >> 8) & 0xF;
     }
+    current->literalFixups.clear();
+    literalNumTable.clear();
+    literalSymTable.clear();
   }
 
-  void handleDirectiveFirstPass(Directive directive)
+  void handleDirective(const Directive &directive)
   {
-    if (directive.mnemonic == "extern")
-    {
-      for (const auto &arg : directive.argList)
-      {
-        if (arg.type == "symbol")
-        {
-          if (symbolTable.count(arg.value) > 0)
-          {
-            std::cout << "Assembler error, symbol " << arg.value << " redefinition." << std::endl;
-            exit(1);
-          }
-          symbolTable[arg.value] = {0, 0, SymbolType::NOTYPE, ScopeType::GLOBAL, "UND"};
-          globalSymbols.insert(arg.value);
-        }
-      }
-    }
-    if (directive.mnemonic == "global")
+    switch (directive.mnemonic)
     {
+    case DirectiveType::EXTERN:
+    case DirectiveType::GLOBAL:
       for (const auto &arg : directive.argList)
       {
-        if (arg.type == "symbol")
+        if (hasSymbol(arg.value))
         {
-          if (symbolTable.count(arg.value) > 0)
-          {
-            std::cout << "Assembler error, symbol " << arg.value << " redefinition." << std::endl;
-            exit(1);
-          }
-          symbolTable[arg.value] = {0, 0, SymbolType::NOTYPE, ScopeType::GLOBAL, "UND"};
-          globalSymbols.insert(arg.value);
+          std::cout << "Assembler error, symbol " << getName(arg.value) << " redefinition." << std::endl;
+          exit(1);
         }
+        getSymbol(arg.value) = {0, 0, SymbolType::NOTYPE, ScopeType::GLOBAL, "UND"};
+        globalSymbols[arg.value] = 1;
       }
-    }
-    if (directive.mnemonic == "section")
-    {
-      if (currentSection != "ABS")
+      break;
+    case DirectiveType::SECTION:
+      if (current)
       {
-        literalPoolFirstPass();
-      }
-      while (locationCounter % 8)
-      {
-        ++locationCounter;
+        closeSection();
       }
       addSectionSymbol(directive.argList[0].value);
-      sectionTable[currentSection].length = locationCounter - sectionTable[currentSection].base;
       currentSection = directive.argList[0].value;
-      sectionTable[currentSection].base = locationCounter;
-    }
-    if (directive.mnemonic == "word")
-    {
+      current = &sectionTable[currentSection];
+      sectionOrder.push_back(currentSection);
+      break;
+    case DirectiveType::WORD:
       for (const auto &arg : directive.argList)
       {
-        if (arg.type == "symbol")
+        if (arg.type == ArgumentType::SYMBOL)
         {
-          if (symbolTable.count(arg.value) > 0)
+          if (!hasSymbol(arg.value))
           {
-            continue;
+            getSymbol(arg.value) = {0, 0, SymbolType::NOTYPE, ScopeType::GLOBAL, "UND"};
           }
-          symbolTable[arg.value] = {0, 0, SymbolType::NOTYPE, ScopeType::GLOBAL, "UND"};
-        }
-      }
-      locationCounter += directive.argList.size() * 4;
-    }
-    if (directive.mnemonic == "skip")
-    {
-      locationCounter += stoi(directive.argList[0].value);
-    }
-    if (directive.mnemonic == "ascii")
-    {
-      locationCounter += directive.argList[0].value.length();
-    }
-    if (directive.mnemonic == "end")
-    {
-      stopParsing = true;
-    }
-  }
-
-  void handleInstructionFirstPass(Instruction instruction)
-  {
-    if (instruction.mnemonic == "iret")
-    {
-      locationCounter += 8;
-    }
-    if (instruction.mnemonic == "ld" && (instruction.operand_type == "mem[num]" || instruction.operand_type == "mem[sym]"))
-    {
-      locationCounter += 4;
-    }
-    locationCounter += 4;
-
-    if (instruction.mnemonic == "call" || instruction.mnemonic == "jmp" || instruction.mnemonic == "beq" ||
-        instruction.mnemonic == "bne" || instruction.mnemonic == "bgt")
-    {
-      if (instruction.operand_type == "num")
-      {
-        literalNumTable[std::make_pair(currentSection, stringToUnsignedInt(instruction.operand))];
-      }
-      if (instruction.operand_type == "sym")
-      {
-        addInstructionSymbol(instruction.operand);
-        literalSymTable[std::make_pair(currentSection, instruction.operand)];
-      }
-    }
-
-    if (instruction.mnemonic == "st")
-    {
-      if (instruction.operand_type == "mem[num]")
-      {
-        literalNumTable[std::make_pair(currentSection, stringToUnsignedInt(instruction.operand))];
-      }
-      if (instruction.operand_type == "mem[sym]")
-      {
-        addInstructionSymbol(instruction.operand);
-        literalSymTable[std::make_pair(currentSection, instruction.operand)];
-      }
-    }
-
-    if (instruction.mnemonic == "ld")
-    {
-      if (instruction.operand_type == "num" || instruction.operand_type == "mem[num]")
-      {
-        literalNumTable[std::make_pair(currentSection, stringToUnsignedInt(instruction.operand))];
-      }
-      if (instruction.operand_type == "sym" || instruction.operand_type == "mem[sym]")
-      {
-        addInstructionSymbol(instruction.operand);
-        literalSymTable[std::make_pair(currentSection, instruction.operand)];
-      }
-    }
-  }
-
-  void handleLineFirstPass(Line line)
-  {
-    if (line.label != "")
-    {
-      addLabelSymbol(line.label);
-    }
-    if (line.type == "directive")
-    {
-      handleDirectiveFirstPass(line.directive);
-    }
-    if (line.type == "instruction")
-    {
-      handleInstructionFirstPass(line.instruction);
-    }
-  }
-
-  void handleDirectiveSecondPass(Directive directive)
-  {
-    if (directive.mnemonic == "section")
-    {
-      if (currentSection != "ABS")
-      {
-        literalPoolSecondPass();
-      }
-      if (locationCounter % 8)
-      {
-        outputFile << std::endl;
-      }
-      while (locationCounter % 8)
-      {
-        ++locationCounter;
-      }
-      currentSection = directive.argList[0].value;
-      outputFile << "#." << currentSection << std::endl;
-    }
-    if (directive.mnemonic == "word")
-    {
-      for (const auto &arg : directive.argList)
-      {
-        if (arg.type == "symbol")
-        {
-          addRelocationWordDirective(arg.value);
-          outputInteger(0);
+          current->symbolReferences.push_back({(uint32_t)current->data.size(), arg.value});
+          appendWord(*current, 0);
         }
-        if (arg.type == "number")
+        else
         {
-          uint32_t value = stringToUnsignedInt(arg.value);
-          outputInteger(value);
+          appendWord(*current, arg.value);
         }
       }
-    }
-    if (directive.mnemonic == "skip")
+      break;
+    case DirectiveType::SKIP:
+      current->data.resize(current->data.size() + directive.argList[0].value, 0);
+      break;
+    case DirectiveType::ASCII:
     {
-      uint32_t size = stoi(directive.argList[0].value);
-      for (uint32_t i = 0; i < size; ++i)
-      {
-        outputByte(0, 0);
-      }
+      const std::string &value = parsedStrings.get(directive.argList[0].value);
+      current->data.insert(current->data.end(), value.begin(), value.end());
+      break;
     }
-    if (directive.mnemonic == "ascii")
-    {
-      outputString(directive.argList[0].value);
+    case DirectiveType::END:
+      stopParsing = true;
+      break;
     }
   }
 
-  uint16_t getGprIndex(std::string regCode)
+  uint8_t getGprIndex(const std::string &regCode)
   {
     if (regCode == "%sp")
     {
@@ -480,7 +307,7 @@ namespace assembler
     return stoi(regCode.substr(2, std::string::npos));
   }
 
-  uint16_t getCsrIndex(std::string regCode)
+  uint8_t getCsrIndex(const std::string &regCode)
   {
     if (regCode == "%status")
     {
@@ -498,324 +325,216 @@ namespace assembler
     exit(1);
   }
 
-  uint32_t getDisplacement(std::string operand, std::string type)
+  void checkOffset(const Instruction &instruction)
   {
-    if (type == "num" || type == "mem[num]")
+    if (instruction.offset > 2047 || instruction.offset < -2048)
     {
-      return literalNumTable[std::make_pair(currentSection, stringToUnsignedInt(operand))] - locationCounter - 4;
+      std::cout << "Error. Signed offset out of range" << std::endl;
+      exit(1);
     }
-    return literalSymTable[std::make_pair(currentSection, operand)] - locationCounter - 4;
   }
 
-  void handleInstructionSecondPass(Instruction instruction)
+  void handleInstruction(const Instruction &instruction)
   {
-    if (instruction.mnemonic == "halt")
-    {
-      outputWord(0, 0, 0, 0, 0, 0, 0, 0);
-    }
-    if (instruction.mnemonic == "int")
-    {
-      outputWord(1, 0, 0, 0, 0, 0, 0, 0);
-    }
-    if (instruction.mnemonic == "iret")
-    {
-      outputWord(9, 1, 14, 14, 0, 0, 0, 4);      // sp = sp + 4
-      outputWord(9, 7, 0, 14, 0, 0xF, 0xF, 0xC); // pop status, sp = sp - 4
-      outputWord(9, 3, 15, 14, 0, 0, 0, 8);      // pop pc, sp = sp + 8
-    }
-    if (instruction.mnemonic == "call")
-    {
-      uint32_t disp = getDisplacement(instruction.operand, instruction.operand_type);
-      outputWordDisp(2, 1, 15, 0, 0, disp);
-    }
-    if (instruction.mnemonic == "ret")
-    {
-      outputWord(9, 3, 15, 14, 0, 0, 0, 4);
-    }
-    if (instruction.mnemonic == "jmp")
-    {
-      uint32_t disp = getDisplacement(instruction.operand, instruction.operand_type);
-      outputWordDisp(3, 8, 15, 0, 0, disp);
-    }
-    if (instruction.mnemonic == "beq")
-    {
-      uint32_t disp = getDisplacement(instruction.operand, instruction.operand_type);
-      uint16_t regB = getGprIndex(instruction.reg1);
-      uint16_t regC = getGprIndex(instruction.reg2);
-      outputWordDisp(3, 9, 15, regB, regC, disp);
-    }
-    if (instruction.mnemonic == "bne")
-    {
-      uint32_t disp = getDisplacement(instruction.operand, instruction.operand_type);
-      uint16_t regB = getGprIndex(instruction.reg1);
-      uint16_t regC = getGprIndex(instruction.reg2);
-      outputWordDisp(3, 10, 15, regB, regC, disp);
-    }
-    if (instruction.mnemonic == "bgt")
-    {
-      uint32_t disp = getDisplacement(instruction.operand, instruction.operand_type);
-      uint16_t regB = getGprIndex(instruction.reg1);
-      uint16_t regC = getGprIndex(instruction.reg2);
-      outputWordDisp(3, 11, 15, regB, regC, disp);
-    }
-    if (instruction.mnemonic == "push")
-    {
-      uint16_t regC = getGprIndex(instruction.reg1);
-      outputWord(8, 1, 14, 0, regC, 0, 0, 4);
-    }
-    if (instruction.mnemonic == "pop")
-    {
-      uint16_t regA = getGprIndex(instruction.reg1);
-      outputWord(9, 3, regA, 14, 0, 0, 0, 4);
-    }
-    if (instruction.mnemonic == "xchg")
-    {
-      uint16_t regB = getGprIndex(instruction.reg1);
-      uint16_t regC = getGprIndex(instruction.reg2);
-      outputWord(4, 0, 0, regB, regC, 0, 0, 0);
-    }
-    if (instruction.mnemonic == "add")
-    {
-      uint16_t regA = getGprIndex(instruction.reg2);
-      uint16_t regB = getGprIndex(instruction.reg2);
-      uint16_t regC = getGprIndex(instruction.reg1);
-      outputWord(5, 0, regA, regB, regC, 0, 0, 0);
-    }
-    if (instruction.mnemonic == "sub")
-    {
-      uint16_t regA = getGprIndex(instruction.reg2);
-      uint16_t regB = getGprIndex(instruction.reg2);
-      uint16_t regC = getGprIndex(instruction.reg1);
-      outputWord(5, 1, regA, regB, regC, 0, 0, 0);
-    }
-    if (instruction.mnemonic == "mul")
-    {
-      uint16_t regA = getGprIndex(instruction.reg2);
-      uint16_t regB = getGprIndex(instruction.reg2);
-      uint16_t regC = getGprIndex(instruction.reg1);
-      outputWord(5, 2, regA, regB, regC, 0, 0, 0);
-    }
-    if (instruction.mnemonic == "div")
-    {
-      uint16_t regA = getGprIndex(instruction.reg2);
-      uint16_t regB = getGprIndex(instruction.reg2);
-      uint16_t regC = getGprIndex(instruction.reg1);
-      outputWord(5, 3, regA, regB, regC, 0, 0, 0);
-    }
-    if (instruction.mnemonic == "not")
-    {
-      uint16_t regA = getGprIndex(instruction.reg1);
-      uint16_t regB = getGprIndex(instruction.reg1);
-      uint16_t regC = 0;
-      outputWord(6, 0, regA, regB, regC, 0, 0, 0);
-    }
-    if (instruction.mnemonic == "and")
-    {
-      uint16_t regA = getGprIndex(instruction.reg2);
-      uint16_t regB = getGprIndex(instruction.reg2);
-      uint16_t regC = getGprIndex(instruction.reg1);
-      outputWord(6, 1, regA, regB, regC, 0, 0, 0);
+    switch (instruction.mnemonic)
+    {
+    case Mnemonic::HALT:
+      outputInstruction(isa::Operation::HALT, 0, 0, 0, 0);
+      break;
+    case Mnemonic::INT:
+      outputInstruction(isa::Operation::INT, 0, 0, 0, 0);
+      break;
+    case Mnemonic::IRET:
+      outputInstruction(isa::Operation::ADD_DISP, 14, 14, 0, 4); // sp = sp + 4
+      outputInstruction(isa::Operation::POP_CSR, 0, 14, 0, -4);  // pop status, sp = sp - 4
+      outputInstruction(isa::Operation::POP, 15, 14, 0, 8);      // pop pc, sp = sp + 8
+      break;
+    case Mnemonic::CALL:
+      addLiteral(instruction);
+      outputInstruction(isa::Operation::CALL, 15, 0, 0, 0);
+      break;
+    case Mnemonic::RET:
+      outputInstruction(isa::Operation::POP, 15, 14, 0, 4);
+      break;
+    case Mnemonic::JMP:
+      addLiteral(instruction);
+      outputInstruction(isa::Operation::JMP, 15, 0, 0, 0);
+      break;
+    case Mnemonic::BEQ:
+      addLiteral(instruction);
+      outputInstruction(isa::Operation::BEQ, 15, instruction.reg1, instruction.reg2, 0);
+      break;
+    case Mnemonic::BNE:
+      addLiteral(instruction);
+      outputInstruction(isa::Operation::BNE, 15, instruction.reg1, instruction.reg2, 0);
+      break;
+    case Mnemonic::BGT:
+      addLiteral(instruction);
+      outputInstruction(isa::Operation::BGT, 15, instruction.reg1, instruction.reg2, 0);
+      break;
+    case Mnemonic::PUSH:
+      outputInstruction(isa::Operation::PUSH, 14, 0, instruction.reg1, 4);
+      break;
+    case Mnemonic::POP:
+      outputInstruction(isa::Operation::POP, instruction.reg1, 14, 0, 4);
+      break;
+    case Mnemonic::XCHG:
+      outputInstruction(isa::Operation::XCHG, 0, instruction.reg1, instruction.reg2, 0);
+      break;
+    case Mnemonic::ADD:
+      outputInstruction(isa::Operation::ADD, instruction.reg2, instruction.reg2, instruction.reg1, 0);
+      break;
+    case Mnemonic::SUB:
+      outputInstruction(isa::Operation::SUB, instruction.reg2, instruction.reg2, instruction.reg1, 0);
+      break;
+    case Mnemonic::MUL:
+      outputInstruction(isa::Operation::MUL, instruction.reg2, instruction.reg2, instruction.reg1, 0);
+      break;
+    case Mnemonic::DIV:
+      outputInstruction(isa::Operation::DIV, instruction.reg2, instruction.reg2, instruction.reg1, 0);
+      break;
+    case Mnemonic::NOT:
+      outputInstruction(isa::Operation::NOT, instruction.reg1, instruction.reg1, 0, 0);
+      break;
+    case Mnemonic::AND:
+      outputInstruction(isa::Operation::AND, instruction.reg2, instruction.reg2, instruction.reg1, 0);
+      break;
+    case Mnemonic::OR:
+      outputInstruction(isa::Operation::OR, instruction.reg2, instruction.reg2, instruction.reg1, 0);
+      break;
+    case Mnemonic::XOR:
+      outputInstruction(isa::Operation::XOR, instruction.reg2, instruction.reg2, instruction.reg1, 0);
+      break;
+    case Mnemonic::SHL:
+      outputInstruction(isa::Operation::SHL, instruction.reg2, instruction.reg2, instruction.reg1, 0);
+      break;
+    case Mnemonic::SHR:
+      outputInstruction(isa::Operation::SHR, instruction.reg2, instruction.reg2, instruction.reg1, 0);
+      break;
+    case Mnemonic::LD:
+      switch (instruction.operandKind)
+      {
+      case OperandKind::NUM:
+      case OperandKind::SYM:
+        addLiteral(instruction);
+        outputInstruction(isa::Operation::LOAD, instruction.reg1, 15, 0, 0);
+        break;
+      case OperandKind::MEM_NUM:
+      case OperandKind::MEM_SYM:
+        addLiteral(instruction);
+        outputInstruction(isa::Operation::LOAD, instruction.reg1, 15, 0, 0);
+        outputInstruction(isa::Operation::LOAD, instruction.reg1, instruction.reg1, 0, 0);
+        break;
+      case OperandKind::MEM_REG:
+        outputInstruction(isa::Operation::LOAD, instruction.reg1, instruction.operandReg, 0, 0);
+        break;
+      case OperandKind::MEM_REG_NUM:
+        checkOffset(instruction);
+        outputInstruction(isa::Operation::LOAD, instruction.reg1, instruction.operandReg, 0, instruction.offset);
+        break;
+      default:
+        break;
+      }
+      break;
+    case Mnemonic::ST:
+      switch (instruction.operandKind)
+      {
+      case OperandKind::MEM_NUM:
+      case OperandKind::MEM_SYM:
+        addLiteral(instruction);
+        outputInstruction(isa::Operation::STORE_INDIRECT, 15, 0, instruction.reg1, 0);
+        break;
+      case OperandKind::MEM_REG:
+        outputInstruction(isa::Operation::STORE, instruction.operandReg, 0, instruction.reg1, 0);
+        break;
+      case OperandKind::MEM_REG_NUM:
+        checkOffset(instruction);
+        outputInstruction(isa::Operation::STORE, instruction.operandReg, 0, instruction.reg1, instruction.offset);
+        break;
+      default:
+        break;
+      }
+      break;
+    case Mnemonic::CSRRD:
+      outputInstruction(isa::Operation::CSR_READ, instruction.reg2, instruction.reg1, 0, 0);
+      break;
+    case Mnemonic::CSRWR:
+      outputInstruction(isa::Operation::CSR_WRITE, instruction.reg2, instruction.reg1, 0, 0);
+      break;
     }
-    if (instruction.mnemonic == "or")
-    {
-      uint16_t regA = getGprIndex(instruction.reg2);
-      uint16_t regB = getGprIndex(instruction.reg2);
-      uint16_t regC = getGprIndex(instruction.reg1);
-      outputWord(6, 2, regA, regB, regC, 0, 0, 0);
-    }
-    if (instruction.mnemonic == "xor")
-    {
-      uint16_t regA = getGprIndex(instruction.reg2);
-      uint16_t regB = getGprIndex(instruction.reg2);
-      uint16_t regC = getGprIndex(instruction.reg1);
-      outputWord(6, 3, regA, regB, regC, 0, 0, 0);
-    }
-    if (instruction.mnemonic == "shl")
-    {
-      uint16_t regA = getGprIndex(instruction.reg2);
-      uint16_t regB = getGprIndex(instruction.reg2);
-      uint16_t regC = getGprIndex(instruction.reg1);
-      outputWord(7, 0, regA, regB, regC, 0, 0, 0);
-    }
-    if (instruction.mnemonic == "shr")
-    {
-      uint16_t regA = getGprIndex(instruction.reg2);
-      uint16_t regB = getGprIndex(instruction.reg2);
-      uint16_t regC = getGprIndex(instruction.reg1);
-      outputWord(7, 1, regA, regB, regC, 0, 0, 0);
-    }
-    if (instruction.mnemonic == "ld")
+  }
+
+  void handleLine(const Line &line)
+  {
+    if (isContentOutOfSection(line))
     {
-      if (instruction.operand_type == "num" || instruction.operand_type == "sym" ||
-          instruction.operand_type == "mem[num]" || instruction.operand_type == "mem[sym]")
-      {
-        uint32_t disp = getDisplacement(instruction.operand, instruction.operand_type);
-        uint16_t regA = getGprIndex(instruction.reg1);
-        outputWordDisp(9, 2, regA, 15, 0, disp);
-      }
-      if (instruction.operand_type == "mem[num]" || instruction.operand_type == "mem[sym]")
-      {
-        uint16_t regA = getGprIndex(instruction.reg1);
-        outputWord(9, 2, regA, regA, 0, 0, 0, 0);
-      }
-      if (instruction.operand_type == "mem[reg]")
-      {
-        uint16_t regA = getGprIndex(instruction.reg1);
-        uint16_t regB = getGprIndex(instruction.operand);
-        outputWord(9, 2, regA, regB, 0, 0, 0, 0);
-      }
-      if (instruction.operand_type == "mem[reg+num]")
-      {
-        if (stringToSignedInt(instruction.offset) > 2047 || stringToSignedInt(instruction.offset) < -2048)
-        {
-          std::cout << "Error. Signed offset out of range" << std::endl;
-          exit(1);
-        }
-        uint16_t regA = getGprIndex(instruction.reg1);
-        uint16_t regB = getGprIndex(instruction.operand);
-        int16_t disp = stringToSignedInt(instruction.offset);
-        outputWordDisp(9, 2, regA, regB, 0, disp);
-      }
+      std::cout << "Line " << line.number << ": Error. Content defined outside of section." << std::endl;
+      exit(1);
     }
-    if (instruction.mnemonic == "st")
+    if (line.label != StringPool::NONE)
     {
-      if (instruction.operand_type == "mem[num]" || instruction.operand_type == "mem[sym]")
-      {
-        uint32_t disp = getDisplacement(instruction.operand, instruction.operand_type);
-        uint16_t regC = getGprIndex(instruction.reg1);
-        outputWordDisp(8, 2, 15, 0, regC, disp);
-      }
-      if (instruction.operand_type == "mem[reg]")
-      {
-        uint16_t regC = getGprIndex(instruction.reg1);
-        uint16_t regA = getGprIndex(instruction.operand);
-        outputWord(8, 0, regA, 0, regC, 0, 0, 0);
-      }
-      if (instruction.operand_type == "mem[reg+num]")
-      {
-        if (stringToSignedInt(instruction.offset) > 2047 || stringToSignedInt(instruction.offset) < -2048)
-        {
-          std::cout << "Error. Signed offset out of range" << std::endl;
-          exit(1);
-        }
-        uint16_t regC = getGprIndex(instruction.reg1);
-        uint16_t regA = getGprIndex(instruction.operand);
-        int16_t disp = stringToSignedInt(instruction.offset);
-        outputWordDisp(8, 0, regA, 0, regC, disp);
-      }
+      addLabelSymbol(line.label);
     }
-    if (instruction.mnemonic == "csrrd")
+    if (line.type == LineType::DIRECTIVE)
     {
-      uint16_t regA = getGprIndex(instruction.reg2);
-      uint16_t regB = getCsrIndex(instruction.reg1);
-      outputWord(9, 0, regA, regB, 0, 0, 0, 0);
+      handleDirective(line.directive);
     }
-    if (instruction.mnemonic == "csrwr")
+    else
     {
-      uint16_t regA = getCsrIndex(instruction.reg2);
-      uint16_t regB = getGprIndex(instruction.reg1);
-      outputWord(9, 4, regA, regB, 0, 0, 0, 0);
+      handleInstruction(line.instruction);
     }
   }
 
-  void outputSymbolTable()
+  Relocation getRelocation(const SymbolReference &reference)
   {
-    outputFile << "#.symtab" << std::endl;
-    outputFile << std::setw(10) << std::left << std::setfill(' ') << "Value";
-    outputFile << std::setw(10) << std::left << std::setfill(' ') << "Size";
-    outputFile << std::setw(10) << std::left << std::setfill(' ') << "Type";
-    outputFile << std::setw(10) << std::left << std::setfill(' ') << "Scope";
-    outputFile << std::setw(20) << std::left << std::setfill(' ') << "Section";
-    outputFile << std::setw(20) << std::left << std::setfill(' ') << "Name";
-    outputFile << std::endl;
-    for (const auto &symbol : symbolTable)
-    {
-      outputFile << std::setw(8) << std::right << std::setfill('0') << std::hex << symbol.second.value << "  ";
-      outputFile << std::setw(10) << std::left << std::setfill(' ') << symbol.second.size;
-      outputFile << std::setw(10) << std::left << std::setfill(' ') << SymbolTypeToString(symbol.second.type);
-      outputFile << std::setw(10) << std::left << std::setfill(' ') << ScopeTypeToString(symbol.second.scope);
-      outputFile << std::setw(20) << std::left << std::setfill(' ') << symbol.second.section;
-      outputFile << std::setw(20) << std::left << std::setfill(' ') << symbol.first;
-      outputFile << std::endl;
+    const Symbol &symbol = symbolTable[reference.symbol];
+    if (symbol.scope == ScopeType::LOCAL)
+    {
+      return {reference.offset, symbol.section, symbol.value};
     }
+    return {reference.offset, getName(reference.symbol), 0};
   }
 
-  void outputRelocationTables()
+  // Symbols in the order their names were interned, sections in the order they appear
+  void outputObjectFile()
   {
-    for (const auto &section : sectionTable)
+    ObjectWriter writer;
+    for (StringId name = 0; name < symbolTable.size(); ++name)
     {
-      if (section.first == "ABS")
-      {
-        continue;
-      }
-      outputFile << std::endl;
-      outputFile << "#.rela." << section.first << std::endl;
-      outputFile << std::setw(10) << std::left << std::setfill(' ') << "Offset";
-      outputFile << std::setw(20) << std::left << std::setfill(' ') << "Symbol";
-      outputFile << std::setw(10) << std::left << std::setfill(' ') << "Addend";
-      for (const auto &rel : relocationTable[section.first])
+      if (symbolDefined[name])
       {
-        outputFile << std::endl;
-        outputFile << std::setw(8) << std::right << std::setfill('0') << std::hex << rel.offset << "  ";
-        outputFile << std::setw(20) << std::left << std::setfill(' ') << rel.symbolName;
-        outputFile << std::setw(10) << std::left << std::setfill(' ') << std::dec << rel.addend;
+        writer.addSymbol(getName(name), symbolTable[name]);
       }
     }
-  }
-
-  void outputLiteralPool()
-  {
-    for (const auto &num : literalNumTable)
+    for (StringId sectionName : sectionOrder)
     {
-      std::cout << "Section(" << num.first.first << ") ";
-      std::cout << "Literal(" << num.first.second << ") ";
-      std::cout << "Address(" << num.second << ") " << std::endl;
+      const Section &section = sectionTable[sectionName];
+      uint32_t index = writer.addSection(getName(sectionName), section.data.data(), section.data.size());
+      for (const auto &reference : section.symbolReferences)
+      {
+        writer.addRelocation(index, getRelocation(reference));
+      }
     }
-    for (const auto &sym : literalSymTable)
+    if (!isText)
     {
-      std::cout << "Section(" << sym.first.first << ") ";
-      std::cout << "Literal(" << sym.first.second << ") ";
-      std::cout << "Address(" << sym.second << ") " << std::endl;
+      writer.write(outputFile);
+      return;
     }
+    std::string object = writer.build();
+    ObjectFile dump;
+    dump.load(object.data(), object.size());
+    dump.writeText(outputFile);
   }
 
-  void firstPass()
+  void assemble()
   {
     yyin = inputFile;
     int32_t parseStatus = yyparse();
-    literalPoolFirstPass();
-    locationCounter = 0;
-    currentSection = "ABS";
-  }
-
-  void secondPass()
-  {
-    outputSymbolTable();
-    for (const auto &line : parsedLines)
+    if (current)
     {
-      if (isContentOutOfSection(line))
-      {
-        std::cout << "Line " << line.number << ": Error. Content defined outside of section." << std::endl;
-        exit(1);
-      }
-      if (line.type == "directive")
-      {
-        handleDirectiveSecondPass(line.directive);
-      }
-      else if (line.type == "instruction")
-      {
-        handleInstructionSecondPass(line.instruction);
-      }
+      closeSection();
     }
-    literalPoolSecondPass();
-    outputRelocationTables();
-    locationCounter = 0;
-  }
-
-  void assemble()
-  {
-    firstPass();
-    secondPass();
+    outputObjectFile();
   }
 
-}
\ No newline at end of file
+}
@@ -5,8 +5,16 @@
 #include "../inc/assembler.hpp"
 
 
+bool assembler::isText = false;
+
 int main(int argc, char **argv)
 {
+  if ((argc == 5) && (std::string(argv[1]) == "-text"))
+  {
+    assembler::setText();
+    --argc;
+    ++argv;
+  }
   if ((argc != 4) || (std::string(argv[1]) != "-o"))
   {
     std::cout << "Invalid command." << std::endl;
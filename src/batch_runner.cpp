@@ -0,0 +1,275 @@
+#include "../inc/batch_runner.hpp"
+#include "../inc/terminal.hpp"
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+BatchRunner::BatchRunner(uint32_t threadCount, bool useJit, bool useLanes)
+    : threadCount(threadCount ? threadCount : 1), useJit(useJit), useLanes(useLanes), queues(this->threadCount)
+{
+}
+
+bool BatchRunner::loadManifest(const std::string &manifestFileName)
+{
+  std::ifstream manifest(manifestFileName);
+  if (!manifest.is_open())
+  {
+    return false;
+  }
+  std::string line;
+  while (std::getline(manifest, line))
+  {
+    std::istringstream fields(line);
+    BatchJob job;
+    if (!(fields >> job.imageFileName) || job.imageFileName[0] == '#')
+    {
+      continue;
+    }
+    job.maxInstructions = DEFAULT_MAX_INSTRUCTIONS;
+    std::string field;
+    for (bool first = true; fields >> field; first = false)
+    {
+      size_t equals = field.find('=');
+      try
+      {
+        if (equals == std::string::npos && first)
+        {
+          job.maxInstructions = std::stoull(field);
+        }
+        else if (field[0] == 'r' && equals != std::string::npos && std::stoul(field.substr(1, equals - 1)) < 16)
+        {
+          job.registers.push_back({std::stoul(field.substr(1, equals - 1)), std::stoul(field.substr(equals + 1), nullptr, 0)});
+        }
+        else if (field.substr(0, 2) == "0x" && equals != std::string::npos)
+        {
+          job.words.push_back({std::stoul(field.substr(0, equals), nullptr, 16), std::stoul(field.substr(equals + 1), nullptr, 0)});
+        }
+        else
+        {
+          return false;
+        }
+      }
+      catch (const std::logic_error &)
+      {
+        return false;
+      }
+    }
+    addJob(job);
+  }
+  return true;
+}
+
+void BatchRunner::addJob(const BatchJob &job)
+{
+  jobs.push_back(job);
+}
+
+const std::vector<BatchJob> &BatchRunner::getJobs() const
+{
+  return jobs;
+}
+
+const std::vector<BatchResult> &BatchRunner::getResults() const
+{
+  return results;
+}
+
+void BatchRunner::run()
+{
+  results.assign(jobs.size(), {StopReason::NONE, "", 0, "", ""});
+  images.clear();
+  EmulatorCore loader;
+  for (const auto &job : jobs)
+  {
+    if (!images.count(job.imageFileName) && loader.load(job.imageFileName))
+    {
+      images[job.imageFileName] = loader.shareImage();
+    }
+  }
+  // Lanes take jobs of the same image in manifest order
+  groups.clear();
+  std::unordered_map<std::string, uint32_t> openGroups;
+  for (uint32_t job = 0; job < jobs.size(); ++job)
+  {
+    auto open = openGroups.find(jobs[job].imageFileName);
+    if (!useLanes || !images.count(jobs[job].imageFileName) || open == openGroups.end() ||
+        groups[open->second].size() == LaneGroup::LANES)
+    {
+      openGroups[jobs[job].imageFileName] = groups.size();
+      groups.push_back({job});
+    }
+    else
+    {
+      groups[open->second].push_back(job);
+    }
+  }
+  for (uint32_t group = 0; group < groups.size(); ++group)
+  {
+    queues[group % threadCount].groups.push_back(group);
+  }
+
+  std::vector<std::thread> workers;
+  for (uint32_t worker = 1; worker < threadCount; ++worker)
+  {
+    workers.emplace_back(&BatchRunner::runWorker, this, worker);
+  }
+  runWorker(0);
+  for (auto &worker : workers)
+  {
+    worker.join();
+  }
+}
+
+void BatchRunner::runWorker(uint32_t worker)
+{
+  EmulatorCore core;
+  if (useJit)
+  {
+    core.setJit();
+  }
+  std::unique_ptr<LaneGroup> lanes;
+  if (useLanes)
+  {
+    lanes.reset(new LaneGroup());
+  }
+  uint32_t group;
+  while (takeGroup(worker, group))
+  {
+    if (groups[group].size() == 1)
+    {
+      runJob(core, groups[group][0]);
+    }
+    else
+    {
+      runLanes(*lanes, core, groups[group]);
+    }
+  }
+}
+
+// Takes the next group from the front of the worker's own queue, or steals one from the back of another queue
+bool BatchRunner::takeGroup(uint32_t worker, uint32_t &group)
+{
+  for (uint32_t i = 0; i < threadCount; ++i)
+  {
+    WorkQueue &queue = queues[(worker + i) % threadCount];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.groups.empty())
+    {
+      continue;
+    }
+    if (i == 0)
+    {
+      group = queue.groups.front();
+      queue.groups.pop_front();
+    }
+    else
+    {
+      group = queue.groups.back();
+      queue.groups.pop_back();
+    }
+    return true;
+  }
+  return false;
+}
+
+void BatchRunner::runJob(EmulatorCore &core, uint32_t job)
+{
+  BatchResult &result = results[job];
+  std::ostringstream output;
+  Terminal terminal(output);
+  core.setTerminal(&terminal);
+  auto image = images.find(jobs[job].imageFileName);
+  bool loaded = true;
+  if (image != images.end())
+  {
+    core.loadShared(image->second);
+  }
+  else
+  {
+    // Reports the load error
+    loaded = core.load(jobs[job].imageFileName);
+  }
+  if (loaded)
+  {
+    for (const auto &reg : jobs[job].registers)
+    {
+      core.setRegister(reg.first, reg.second);
+    }
+    for (const auto &word : jobs[job].words)
+    {
+      core.getMemory().writeWord(word.first, word.second);
+    }
+    core.run(jobs[job].maxInstructions);
+    std::ostringstream state;
+    core.printState(state);
+    result.state = state.str();
+  }
+  core.setTerminal(nullptr);
+  terminal.flush();
+  result.output = output.str();
+  result.stopReason = core.getStopReason();
+  result.message = core.getStopMessage();
+  result.instructionCount = core.getInstructionCount();
+}
+
+// Every job of the group has the same image, which is loaded
+void BatchRunner::runLanes(LaneGroup &lanes, EmulatorCore &core, const std::vector<uint32_t> &group)
+{
+  lanes.reset(images.at(jobs[group[0]].imageFileName), group.size());
+  for (uint32_t lane = 0; lane < group.size(); ++lane)
+  {
+    const BatchJob &job = jobs[group[lane]];
+    lanes.setMaxInstructions(lane, job.maxInstructions);
+    for (const auto &reg : job.registers)
+    {
+      lanes.setRegister(lane, reg.first, reg.second);
+    }
+    for (const auto &word : job.words)
+    {
+      lanes.getMemory(lane).writeWord(word.first, word.second);
+    }
+  }
+  lanes.run();
+  for (uint32_t lane = 0; lane < group.size(); ++lane)
+  {
+    if (lanes.isUnsupported(lane))
+    {
+      runJob(core, group[lane]);
+      continue;
+    }
+    BatchResult &result = results[group[lane]];
+    std::ostringstream state;
+    lanes.printState(lane, state);
+    result.state = state.str();
+    result.output = lanes.getOutput(lane);
+    result.stopReason = lanes.getStopReason(lane);
+    result.message = lanes.getStopMessage(lane);
+    result.instructionCount = lanes.getInstructionCount(lane);
+  }
+}
+
+uint32_t BatchRunner::printResults(std::ostream &out) const
+{
+  uint32_t failed = 0;
+  for (uint32_t job = 0; job < jobs.size(); ++job)
+  {
+    const BatchResult &result = results[job];
+    out << jobs[job].imageFileName << ": " << StopReasonToString(result.stopReason);
+    out << " after " << std::dec << result.instructionCount << " instructions" << std::endl;
+    if (!result.message.empty())
+    {
+      out << result.message << std::endl;
+    }
+    out << result.state;
+    if (!result.output.empty())
+    {
+      out << "Terminal output:" << std::endl;
+      out << result.output << std::endl;
+    }
+    if (result.stopReason != StopReason::HALT)
+    {
+      ++failed;
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,83 @@
+#include "../inc/cache_model.hpp"
+
+static bool isPowerOfTwo(uint32_t value)
+{
+  return value && !(value & (value - 1));
+}
+
+bool CacheModel::isValid(uint32_t size, uint32_t lineSize, uint32_t ways)
+{
+  return isPowerOfTwo(lineSize) && ways && size % ((uint64_t)lineSize * ways) == 0 &&
+         isPowerOfTwo(size / lineSize / ways);
+}
+
+CacheModel::CacheModel(uint32_t size, uint32_t lineSize, uint32_t ways)
+    : lineBits(0), setMask(size / lineSize / ways - 1), ways(ways), lines(size / lineSize)
+{
+  while ((1u << lineBits) < lineSize)
+  {
+    ++lineBits;
+  }
+  clear();
+}
+
+bool CacheModel::access(uint32_t addr)
+{
+  uint32_t tag = addr >> lineBits;
+  Line *set = &lines[(tag & setMask) * ways];
+  Line *victim = set;
+  ++time;
+  for (uint32_t way = 0; way < ways; ++way)
+  {
+    if (set[way].valid && set[way].tag == tag)
+    {
+      set[way].lastUse = time;
+      ++hits;
+      return true;
+    }
+    // Invalid lines have lastUse 0 and are taken first
+    if (set[way].lastUse < victim->lastUse)
+    {
+      victim = &set[way];
+    }
+  }
+  *victim = {tag, true, time};
+  ++misses;
+  return false;
+}
+
+void CacheModel::clear()
+{
+  for (auto &line : lines)
+  {
+    line = {0, false, 0};
+  }
+  time = 0;
+  hits = 0;
+  misses = 0;
+}
+
+uint32_t CacheModel::getSize() const
+{
+  return lines.size() << lineBits;
+}
+
+uint32_t CacheModel::getLineSize() const
+{
+  return 1u << lineBits;
+}
+
+uint32_t CacheModel::getWays() const
+{
+  return ways;
+}
+
+uint64_t CacheModel::getHits() const
+{
+  return hits;
+}
+
+uint64_t CacheModel::getMisses() const
+{
+  return misses;
+}
@@ -0,0 +1,74 @@
+#include "../inc/call_stack_sampler.hpp"
+#include "../inc/symbol_map.hpp"
+
+CallStackSampler::CallStackSampler(uint64_t interval) : interval(interval)
+{
+  reset(0);
+}
+
+uint64_t CallStackSampler::getInterval() const
+{
+  return interval;
+}
+
+void CallStackSampler::reset(uint32_t entry)
+{
+  stack.clear();
+  stack.push_back({entry, 0});
+  overflowDepth = 0;
+  samples.clear();
+  sampleCount = 0;
+}
+
+// Returns past frames that were left without a return, like a handler that never irets
+void CallStackSampler::unwind(uint32_t returnAddress)
+{
+  for (size_t i = stack.size() - 1; i > 0; --i)
+  {
+    if (stack[i].returnAddress == returnAddress)
+    {
+      stack.resize(i);
+      return;
+    }
+  }
+}
+
+void CallStackSampler::sample()
+{
+  std::vector<uint32_t> entries;
+  entries.reserve(stack.size());
+  for (const auto &frame : stack)
+  {
+    entries.push_back(frame.entry);
+  }
+  ++samples[entries];
+  ++sampleCount;
+}
+
+uint64_t CallStackSampler::getSampleCount() const
+{
+  return sampleCount;
+}
+
+void CallStackSampler::writeFoldedStacks(std::ostream &out, const SymbolMap *symbols) const
+{
+  for (const auto &stackSamples : samples)
+  {
+    for (size_t i = 0; i < stackSamples.first.size(); ++i)
+    {
+      if (i)
+      {
+        out << ';';
+      }
+      if (symbols && !symbols->empty())
+      {
+        out << symbols->symbolize(stackSamples.first[i]);
+      }
+      else
+      {
+        out << "0x" << std::hex << stackSamples.first[i];
+      }
+    }
+    out << ' ' << std::dec << stackSamples.second << std::endl;
+  }
+}
@@ -0,0 +1,280 @@
+#include "../inc/cycle_model.hpp"
+#include "../inc/symbol_map.hpp"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <cstring>
+
+CycleModel::Config::Config()
+    : instructionCacheSize(4096), instructionCacheLineSize(16), instructionCacheWays(1),
+      dataCacheSize(4096), dataCacheLineSize(16), dataCacheWays(2),
+      missPenalty(10), takenBranchPenalty(2), literalStall(1)
+{
+  for (uint32_t operation = 0; operation < isa::OPERATION_COUNT; ++operation)
+  {
+    cycles[operation] = 1;
+  }
+  cycles[(uint32_t)isa::Operation::MUL] = 3;
+  cycles[(uint32_t)isa::Operation::DIV] = 20;
+}
+
+bool CycleModel::Config::load(const std::string &configFileName)
+{
+  std::ifstream input(configFileName);
+  return input.is_open() && load(input);
+}
+
+bool CycleModel::Config::load(std::istream &input)
+{
+  std::string line;
+  while (std::getline(input, line))
+  {
+    std::istringstream fields(line.substr(0, line.find('#')));
+    std::string key;
+    if (!(fields >> key))
+    {
+      continue;
+    }
+    std::string name;
+    uint32_t value = 0;
+    uint32_t size = 0;
+    uint32_t lineSize = 0;
+    uint32_t ways = 0;
+    bool valid = false;
+    if (key == "cycles" && fields >> name >> value)
+    {
+      for (uint32_t operation = 0; operation < isa::FORM_COUNT; ++operation)
+      {
+        if (name == isa::getName((isa::Operation)operation))
+        {
+          cycles[operation] = value;
+          valid = true;
+        }
+      }
+    }
+    else if ((key == "icache" || key == "dcache") && fields >> size >> lineSize >> ways)
+    {
+      valid = CacheModel::isValid(size, lineSize, ways);
+      if (key == "icache")
+      {
+        instructionCacheSize = size;
+        instructionCacheLineSize = lineSize;
+        instructionCacheWays = ways;
+      }
+      else
+      {
+        dataCacheSize = size;
+        dataCacheLineSize = lineSize;
+        dataCacheWays = ways;
+      }
+    }
+    else if (key == "miss-penalty" && fields >> value)
+    {
+      missPenalty = value;
+      valid = true;
+    }
+    else if (key == "taken-branch" && fields >> value)
+    {
+      takenBranchPenalty = value;
+      valid = true;
+    }
+    else if (key == "literal-stall" && fields >> value)
+    {
+      literalStall = value;
+      valid = true;
+    }
+    if (!valid || fields >> name)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+CycleModel::CycleModel(const Config &config)
+    : config(config),
+      instructionCache(config.instructionCacheSize, config.instructionCacheLineSize, config.instructionCacheWays),
+      dataCache(config.dataCacheSize, config.dataCacheLineSize, config.dataCacheWays)
+{
+  clear();
+}
+
+void CycleModel::clear()
+{
+  instructionCache.clear();
+  dataCache.clear();
+  dataAccesses = 0;
+  pendingMisses = 0;
+  firstAccessMissed = false;
+  instructionCount = 0;
+  cycleCount = 0;
+  missCycles = 0;
+  branchCycles = 0;
+  literalLoads = 0;
+  literalMisses = 0;
+  literalCycles = 0;
+  memset(operationCounts, 0, sizeof(operationCounts));
+  memset(operationCycles, 0, sizeof(operationCycles));
+  misses.clear();
+}
+
+// PC relative loads of a branch or call target, of the address for st mem[x], and ld $imm
+bool CycleModel::isLiteralLoad(const DecodedInstruction &instruction)
+{
+  switch (instruction.operation)
+  {
+  case isa::Operation::CALL:
+  case isa::Operation::JMP:
+  case isa::Operation::BEQ:
+  case isa::Operation::BNE:
+  case isa::Operation::BGT:
+  case isa::Operation::STORE_INDIRECT:
+    return instruction.regA == 15;
+  case isa::Operation::LOAD:
+    return instruction.regB == 15;
+  default:
+    return false;
+  }
+}
+
+void CycleModel::record(const DecodedInstruction &instruction, uint32_t pc, uint32_t nextPc)
+{
+  uint64_t cycles = config.cycles[(uint32_t)instruction.operation];
+  uint64_t fetchMisses = instructionCache.access(pc) ? 0 : 1;
+  if (fetchMisses || pendingMisses)
+  {
+    Misses &instructionMisses = misses[pc];
+    instructionMisses.fetch += fetchMisses;
+    instructionMisses.data += pendingMisses;
+    missCycles += (fetchMisses + pendingMisses) * config.missPenalty;
+    cycles += (fetchMisses + pendingMisses) * config.missPenalty;
+  }
+  // The literal is the first value the instruction reads, its miss is counted both ways
+  if (isLiteralLoad(instruction) && dataAccesses)
+  {
+    ++literalLoads;
+    literalMisses += firstAccessMissed;
+    literalCycles += config.literalStall + (firstAccessMissed ? config.missPenalty : 0);
+    cycles += config.literalStall;
+  }
+  if (nextPc != pc + 4)
+  {
+    branchCycles += config.takenBranchPenalty;
+    cycles += config.takenBranchPenalty;
+  }
+  ++operationCounts[(uint32_t)instruction.operation];
+  operationCycles[(uint32_t)instruction.operation] += cycles;
+  ++instructionCount;
+  cycleCount += cycles;
+  dataAccesses = 0;
+  pendingMisses = 0;
+  firstAccessMissed = false;
+}
+
+uint64_t CycleModel::getInstructionCount() const
+{
+  return instructionCount;
+}
+
+uint64_t CycleModel::getCycleCount() const
+{
+  return cycleCount;
+}
+
+static void writeRatio(std::ostream &out, uint64_t count, uint64_t total)
+{
+  out << std::fixed << std::setprecision(2) << std::setw(8) << std::right << (total ? (double)count / total : 0.0);
+}
+
+static void writePercent(std::ostream &out, uint64_t count, uint64_t total)
+{
+  out << std::fixed << std::setprecision(2) << std::setw(8) << std::right << (total ? 100.0 * count / total : 0.0) << "%";
+}
+
+static void writeCache(std::ostream &out, const char *name, const CacheModel &cache)
+{
+  std::ostringstream geometry;
+  geometry << cache.getSize() << " B, " << cache.getLineSize() << " B lines, " << cache.getWays()
+           << (cache.getWays() == 1 ? " way" : " ways");
+  out << "  " << std::setw(14) << std::left << name << std::setw(28) << geometry.str() << std::right;
+  out << std::setw(14) << cache.getHits() << " hits";
+  out << std::setw(14) << cache.getMisses() << " misses";
+  writePercent(out, cache.getHits(), cache.getHits() + cache.getMisses());
+  out << " hit rate" << std::endl;
+}
+
+void CycleModel::writeReport(std::ostream &out, const SymbolMap *symbols) const
+{
+  if (symbols && symbols->empty())
+  {
+    symbols = nullptr;
+  }
+
+  out << std::setfill(' ') << "Cycle model: " << std::dec << instructionCount << " instructions, ";
+  out << cycleCount << " cycles, CPI";
+  writeRatio(out, cycleCount, instructionCount);
+  out << std::endl;
+
+  out << std::endl
+      << "Cycles by instruction:" << std::endl;
+  for (uint32_t operation = 0; operation < isa::OPERATION_COUNT; ++operation)
+  {
+    if (operationCounts[operation])
+    {
+      out << "  " << std::setw(16) << std::left << isa::getName((isa::Operation)operation) << std::right;
+      out << std::setw(14) << operationCounts[operation];
+      out << std::setw(14) << operationCycles[operation];
+      writePercent(out, operationCycles[operation], cycleCount);
+      out << "  CPI";
+      writeRatio(out, operationCycles[operation], operationCounts[operation]);
+      out << std::endl;
+    }
+  }
+
+  out << std::endl
+      << "Caches:" << std::endl;
+  writeCache(out, "instruction", instructionCache);
+  writeCache(out, "data", dataCache);
+
+  out << std::endl
+      << "Stalls:" << std::endl;
+  out << "  " << std::setw(16) << std::left << "cache misses" << std::right << std::setw(14) << missCycles << " cycles";
+  writePercent(out, missCycles, cycleCount);
+  out << std::endl;
+  out << "  " << std::setw(16) << std::left << "taken branches" << std::right << std::setw(14) << branchCycles << " cycles";
+  writePercent(out, branchCycles, cycleCount);
+  out << std::endl;
+  out << "  " << std::setw(16) << std::left << "literal pool" << std::right << std::setw(14) << literalCycles << " cycles";
+  writePercent(out, literalCycles, cycleCount);
+  out << std::setw(14) << literalLoads << " loads" << std::setw(14) << literalMisses << " misses" << std::endl;
+
+  struct Instruction
+  {
+    uint32_t pc;
+    Misses misses;
+  };
+  std::vector<Instruction> worst;
+  for (const auto &entry : misses)
+  {
+    worst.push_back({entry.first, entry.second});
+  }
+  std::sort(worst.begin(), worst.end(), [](const Instruction &a, const Instruction &b)
+            { return a.misses.fetch + a.misses.data != b.misses.fetch + b.misses.data
+                         ? a.misses.fetch + a.misses.data > b.misses.fetch + b.misses.data
+                         : a.pc < b.pc; });
+  out << std::endl
+      << "Most misses:" << std::endl;
+  for (uint32_t i = 0; i < worst.size() && i < REPORT_LENGTH; ++i)
+  {
+    out << "  " << std::setw(8) << std::setfill('0') << std::hex << worst[i].pc << std::setfill(' ') << std::dec;
+    out << std::setw(14) << worst[i].misses.fetch << " fetch";
+    out << std::setw(14) << worst[i].misses.data << " data";
+    if (symbols)
+    {
+      out << "  " << symbols->symbolize(worst[i].pc);
+    }
+    out << std::endl;
+  }
+}
@@ -0,0 +1,40 @@
+#include "../inc/decode_cache.hpp"
+#include <cstdlib>
+#include <new>
+
+DecodeCache::DecodeCache()
+{
+  pageTable = static_cast<DecodedInstruction **>(calloc(Memory::PAGE_COUNT, sizeof(DecodedInstruction *)));
+  if (!pageTable)
+  {
+    throw std::bad_alloc();
+  }
+}
+
+DecodeCache::~DecodeCache()
+{
+  clear();
+  free(pageTable);
+}
+
+void DecodeCache::clear()
+{
+  for (const auto &pageNumber : allocatedPages)
+  {
+    free(pageTable[pageNumber]);
+    pageTable[pageNumber] = nullptr;
+  }
+  allocatedPages.clear();
+}
+
+DecodedInstruction *DecodeCache::allocatePage(uint32_t pageNumber)
+{
+  DecodedInstruction *page = static_cast<DecodedInstruction *>(calloc(ENTRIES_PER_PAGE, sizeof(DecodedInstruction)));
+  if (!page)
+  {
+    throw std::bad_alloc();
+  }
+  pageTable[pageNumber] = page;
+  allocatedPages.push_back(pageNumber);
+  return page;
+}
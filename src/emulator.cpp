@@ -1,7 +1,25 @@
-#include "../inc/assembler.hpp"
-#include <map>
+#include "../inc/emulator.hpp"
+#include "../inc/jit.hpp"
+#include "../inc/translated_program.hpp"
+#include "../inc/trace_writer.hpp"
+#include "../inc/terminal.hpp"
+#include "../inc/program_image.hpp"
+#include "../inc/snapshot.hpp"
+#include "../inc/profiler.hpp"
+#include "../inc/call_stack_sampler.hpp"
+#include "../inc/event_log.hpp"
+#include <sstream>
 #include <iomanip>
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define SP r[14]
 #define PC r[15]
@@ -10,767 +28,1801 @@
 #define HANDLER csr[1]
 #define CAUSE csr[2]
 
-namespace emulator
+std::string StopReasonToString(StopReason reason)
 {
-  std::ifstream inputFile;
-  std::map<uint32_t, uint16_t> mem;
-  std::vector<uint32_t> r(15);
-  std::vector<uint32_t> csr(3);
-  bool stopEmulation = false;
-  bool printInstructions = false;
+  switch (reason)
+  {
+  case StopReason::NONE:
+    return "NONE";
+  case StopReason::HALT:
+    return "HALT";
+  case StopReason::INSTRUCTION_LIMIT:
+    return "INSTRUCTION_LIMIT";
+  case StopReason::INVALID_OPCODE:
+    return "INVALID_OPCODE";
+  case StopReason::INVALID_MODIFIER:
+    return "INVALID_MODIFIER";
+  case StopReason::LOCKSTEP_MISMATCH:
+    return "LOCKSTEP_MISMATCH";
+  case StopReason::LOAD_ERROR:
+    return "LOAD_ERROR";
+  case StopReason::BREAKPOINT:
+    return "BREAKPOINT";
+  default:
+    return "ERROR";
+  }
+}
+
+EmulatorCore::EmulatorCore()
+    : idleLoopSkipping(true), terminal(nullptr), recording(nullptr), replay(nullptr), translated(nullptr)
+{
+  reset();
+}
+
+EmulatorCore::~EmulatorCore()
+{
+}
+
+void EmulatorCore::reset()
+{
+  mem.clear();
+  decodeCache.clear();
+  if (jit)
+  {
+    jit->flush();
+  }
+  memset(r, 0, sizeof(r));
+  memset(csr, 0, sizeof(csr));
+  PC = START_ADDRESS;
+  stopReason = StopReason::NONE;
+  stopMessage.clear();
+  instructionCount = 0;
+  sliceEnd = 0;
+  skipIdleLoops = false;
+  idleBranch = 0;
+  idleIterations = 0;
+  if (profiler)
+  {
+    profiler->clear();
+  }
+  if (cycleModel)
+  {
+    cycleModel->clear();
+  }
+  pendingInterrupts = 0;
+  timerConfig = 0;
+  timerGeneration = 0;
+  timerRestart = false;
+  if (sampler)
+  {
+    sampler->reset(START_ADDRESS);
+  }
+  if (recording)
+  {
+    recording->clear();
+  }
+  if (replay)
+  {
+    replay->rewind();
+  }
+  scheduleEvents();
+  if (shadow)
+  {
+    shadow->reset();
+  }
+}
+
+// Drops every pending event and schedules the periodic ones again from the current count
+void EmulatorCore::scheduleEvents()
+{
+  events.clear();
+  if (terminal)
+  {
+    events.schedule({instructionCount + TERMINAL_POLL_INTERVAL, EventType::TERMINAL_POLL, 0});
+  }
+  if (sampler)
+  {
+    events.schedule({instructionCount + sampler->getInterval(), EventType::SAMPLE, 0});
+  }
+}
+
+// Maps a whole file for reading, an empty file maps to nullptr
+static bool mapFile(const std::string &fileName, const char *&data, size_t &size)
+{
+  int fd = open(fileName.c_str(), O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) < 0)
+  {
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return false;
+  }
+  data = nullptr;
+  size = info.st_size;
+  if (size == 0)
+  {
+    close(fd);
+    return true;
+  }
+  void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)
+  {
+    return false;
+  }
+  data = static_cast<const char *>(mapped);
+  return true;
+}
+
+static void unmapFile(const char *data, size_t size)
+{
+  if (data)
+  {
+    munmap(const_cast<char *>(data), size);
+  }
+}
+
+bool EmulatorCore::load(const std::string &inputFileName)
+{
+  const char *image;
+  size_t size;
+  if (!mapFile(inputFileName, image, size))
+  {
+    reset();
+    stop(StopReason::LOAD_ERROR, "Error opening input file.");
+    return false;
+  }
+  bool loaded = loadImage(image, size);
+  unmapFile(image, size);
+  return loaded;
+}
+
+bool EmulatorCore::load(std::istream &input)
+{
+  std::string image((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+  return loadImage(image.data(), image.size());
+}
+
+static uint32_t readLittleEndian(const char *data)
+{
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+  return (bytes[3] << 24) | (bytes[2] << 16) | (bytes[1] << 8) | (bytes[0] << 0);
+}
+
+// Binary images or the text hex format, told apart by the magic number
+bool EmulatorCore::loadImage(const char *image, size_t size)
+{
+  mem.setBase(nullptr);
+  reset();
+  bool isBinary = size >= sizeof(ProgramImageHeader) && readLittleEndian(image) == PROGRAM_IMAGE_MAGIC;
+  if (!(isBinary ? loadBinaryImage(image, size) : loadHexImage(image, size)))
+  {
+    reset();
+    stop(StopReason::LOAD_ERROR, "Invalid program image.");
+    return false;
+  }
+  syncShadow();
+  return true;
+}
+
+// Copies every range straight into guest memory
+bool EmulatorCore::loadBinaryImage(const char *image, size_t size)
+{
+  uint32_t version = readLittleEndian(image + 4);
+  uint32_t rangeCount = readLittleEndian(image + 8);
+  if (version != PROGRAM_IMAGE_VERSION || (size - sizeof(ProgramImageHeader)) / sizeof(ProgramImageRange) < rangeCount)
+  {
+    return false;
+  }
+  for (uint32_t i = 0; i < rangeCount; ++i)
+  {
+    const char *range = image + sizeof(ProgramImageHeader) + i * sizeof(ProgramImageRange);
+    uint32_t address = readLittleEndian(range);
+    uint32_t rangeSize = readLittleEndian(range + 4);
+    uint32_t offset = readLittleEndian(range + 8);
+    if (offset > size || rangeSize > size - offset)
+    {
+      return false;
+    }
+    mem.writeBlock(address, reinterpret_cast<const uint8_t *>(image) + offset, rangeSize);
+  }
+  return true;
+}
+
+static int hexDigit(char character)
+{
+  if (character >= '0' && character <= '9')
+  {
+    return character - '0';
+  }
+  if (character >= 'a' && character <= 'f')
+  {
+    return character - 'a' + 10;
+  }
+  if (character >= 'A' && character <= 'F')
+  {
+    return character - 'A' + 10;
+  }
+  return -1;
+}
+
+static bool isSpace(char character)
+{
+  return character == ' ' || character == '\n' || character == '\r' || character == '\t';
+}
+
+// Parses "address: byte byte ..." lines in place, everything from the first # on is ignored
+bool EmulatorCore::loadHexImage(const char *image, size_t size)
+{
+  const char *current = image;
+  const char *end = image + size;
+  uint32_t addr = 0;
+  while (current != end)
+  {
+    if (isSpace(*current))
+    {
+      ++current;
+      continue;
+    }
+    if (*current == '#')
+    {
+      break;
+    }
+    uint32_t value = 0;
+    uint32_t digits = 0;
+    int digit;
+    while (current != end && (digit = hexDigit(*current)) >= 0)
+    {
+      value = (value << 4) | digit;
+      ++current;
+      if (++digits > 8)
+      {
+        return false;
+      }
+    }
+    if (current != end && *current == ':' && digits)
+    {
+      addr = value;
+      ++current;
+      continue;
+    }
+    if (!digits || value > 0xFF || (current != end && !isSpace(*current)))
+    {
+      return false;
+    }
+    mem.writeByte(addr++, value);
+  }
+  return true;
+}
+
+std::shared_ptr<const Memory> EmulatorCore::shareImage()
+{
+  return mem.share();
+}
+
+void EmulatorCore::loadShared(std::shared_ptr<const Memory> image)
+{
+  mem.setBase(image);
+  reset();
+  syncShadow();
+}
+
+static void appendLittleEndian(std::vector<char> &data, uint32_t word)
+{
+  data.push_back((word >> 0) & 0xFF);
+  data.push_back((word >> 8) & 0xFF);
+  data.push_back((word >> 16) & 0xFF);
+  data.push_back((word >> 24) & 0xFF);
+}
+
+static void appendLittleEndian64(std::vector<char> &data, uint64_t word)
+{
+  appendLittleEndian(data, word & 0xFFFFFFFF);
+  appendLittleEndian(data, word >> 32);
+}
+
+static uint64_t readLittleEndian64(const char *data)
+{
+  return readLittleEndian(data) | (uint64_t)readLittleEndian(data + 4) << 32;
+}
+
+bool EmulatorCore::saveSnapshot(const std::string &snapshotFileName) const
+{
+  std::vector<uint32_t> pages = mem.getPageNumbers();
+  uint64_t timerTime = UINT64_MAX;
+  for (const auto &event : events.getEvents())
+  {
+    if (event.type == EventType::TIMER && event.data == timerGeneration)
+    {
+      timerTime = std::min(timerTime, event.time);
+    }
+  }
+
+  std::vector<char> header;
+  uint32_t dataOffset = sizeof(SnapshotHeader) + pages.size() * sizeof(uint32_t);
+  dataOffset = (dataOffset + Memory::PAGE_MASK) & ~Memory::PAGE_MASK;
+  appendLittleEndian(header, SNAPSHOT_MAGIC);
+  appendLittleEndian(header, SNAPSHOT_VERSION);
+  appendLittleEndian(header, pages.size());
+  appendLittleEndian(header, dataOffset);
+  appendLittleEndian64(header, instructionCount);
+  appendLittleEndian64(header, timerTime);
+  for (uint32_t i = 0; i < 16; ++i)
+  {
+    appendLittleEndian(header, r[i]);
+  }
+  for (uint32_t i = 0; i < 3; ++i)
+  {
+    appendLittleEndian(header, csr[i]);
+  }
+  appendLittleEndian(header, pendingInterrupts);
+  appendLittleEndian(header, timerConfig);
+  appendLittleEndian(header, timerRestart);
+  for (const auto &pageNumber : pages)
+  {
+    appendLittleEndian(header, pageNumber);
+  }
+  header.resize(dataOffset, 0);
+
+  std::ofstream snapshot(snapshotFileName, std::ios::out | std::ios::binary);
+  if (!snapshot.is_open())
+  {
+    return false;
+  }
+  snapshot.write(header.data(), header.size());
+  for (const auto &pageNumber : pages)
+  {
+    snapshot.write(reinterpret_cast<const char *>(mem.getPage(pageNumber)), Memory::PAGE_SIZE);
+  }
+  return snapshot.good();
+}
+
+bool EmulatorCore::restoreSnapshot(const std::string &snapshotFileName)
+{
+  const char *image;
+  size_t size;
+  if (!mapFile(snapshotFileName, image, size))
+  {
+    reset();
+    stop(StopReason::LOAD_ERROR, "Error opening snapshot file.");
+    return false;
+  }
+  bool restored = restoreImage(image, size);
+  unmapFile(image, size);
+  if (!restored)
+  {
+    reset();
+    stop(StopReason::LOAD_ERROR, "Invalid snapshot.");
+    return false;
+  }
+  syncShadow();
+  return true;
+}
+
+bool EmulatorCore::restoreImage(const char *image, size_t size)
+{
+  mem.setBase(nullptr);
+  reset();
+  if (size < sizeof(SnapshotHeader) || readLittleEndian(image) != SNAPSHOT_MAGIC ||
+      readLittleEndian(image + 4) != SNAPSHOT_VERSION)
+  {
+    return false;
+  }
+  uint32_t pageCount = readLittleEndian(image + 8);
+  uint32_t dataOffset = readLittleEndian(image + 12);
+  if ((size - sizeof(SnapshotHeader)) / sizeof(uint32_t) < pageCount || dataOffset > size ||
+      (size - dataOffset) / Memory::PAGE_SIZE < pageCount)
+  {
+    return false;
+  }
+
+  const char *pageNumbers = image + sizeof(SnapshotHeader);
+  for (uint32_t i = 0; i < pageCount; ++i)
+  {
+    uint32_t pageNumber = readLittleEndian(pageNumbers + i * sizeof(uint32_t));
+    if (pageNumber >= Memory::PAGE_COUNT)
+    {
+      return false;
+    }
+    mem.writeBlock(pageNumber << Memory::PAGE_BITS, reinterpret_cast<const uint8_t *>(image) + dataOffset + (size_t)i * Memory::PAGE_SIZE, Memory::PAGE_SIZE);
+  }
+
+  const char *field = image + 16;
+  instructionCount = readLittleEndian64(field);
+  uint64_t timerTime = readLittleEndian64(field + 8);
+  field += 16;
+  for (uint32_t i = 0; i < 16; ++i, field += 4)
+  {
+    r[i] = readLittleEndian(field);
+  }
+  for (uint32_t i = 0; i < 3; ++i, field += 4)
+  {
+    csr[i] = readLittleEndian(field);
+  }
+  pendingInterrupts = readLittleEndian(field);
+  timerConfig = readLittleEndian(field + 4);
+  timerRestart = readLittleEndian(field + 8);
+
+  // Guest time goes on from the snapshot, so every event is scheduled again from there
+  if (sampler)
+  {
+    sampler->reset(PC);
+  }
+  scheduleEvents();
+  if (timerTime != UINT64_MAX)
+  {
+    events.schedule({timerTime, EventType::TIMER, timerGeneration});
+  }
+  return true;
+}
+
+void EmulatorCore::setJit()
+{
+  if (!jit)
+  {
+    jit.reset(new Jit(mem, r, csr, writeWordFromTranslatedCode, this));
+  }
+}
+
+void EmulatorCore::setLockstep()
+{
+  if (!shadow)
+  {
+    shadow.reset(new EmulatorCore());
+    shadow->setJit();
+    syncShadow();
+  }
+}
+
+void EmulatorCore::setTranslatedProgram(TranslatedProgram *program)
+{
+  translated = program;
+  if (translated)
+  {
+    translated->attach(mem, r, csr, writeWordFromTranslatedCode, this);
+  }
+}
+
+void EmulatorCore::setTrace(std::ostream &out)
+{
+  trace.reset(new TraceWriter(out));
+}
+
+void EmulatorCore::setTerminal(Terminal *terminal)
+{
+  if (terminal && !this->terminal)
+  {
+    events.schedule({instructionCount + TERMINAL_POLL_INTERVAL, EventType::TERMINAL_POLL, 0});
+  }
+  this->terminal = terminal;
+}
+
+void EmulatorCore::setRecording(EventLog *log)
+{
+  recording = log;
+}
+
+void EmulatorCore::setReplay(EventLog *log)
+{
+  replay = log;
+}
+
+void EmulatorCore::setIdleLoopSkipping(bool enabled)
+{
+  idleLoopSkipping = enabled;
+}
+
+void EmulatorCore::setProfile()
+{
+  if (!profiler)
+  {
+    profiler.reset(new Profiler());
+  }
+}
+
+void EmulatorCore::setCycleModel(const CycleModel::Config &config)
+{
+  cycleModel.reset(new CycleModel(config));
+}
+
+void EmulatorCore::setSampling(uint64_t interval)
+{
+  if (!sampler)
+  {
+    events.schedule({instructionCount + interval, EventType::SAMPLE, 0});
+  }
+  sampler.reset(new CallStackSampler(interval));
+  sampler->reset(PC);
+}
+
+void EmulatorCore::addBreakpoint(uint32_t addr)
+{
+  breakpoints.insert(addr);
+}
+
+void EmulatorCore::removeBreakpoint(uint32_t addr)
+{
+  breakpoints.erase(addr);
+}
+
+StopReason EmulatorCore::getStopReason() const
+{
+  return stopReason;
+}
+
+const std::string &EmulatorCore::getStopMessage() const
+{
+  return stopMessage;
+}
+
+uint64_t EmulatorCore::getInstructionCount() const
+{
+  return instructionCount;
+}
+
+const Profiler *EmulatorCore::getProfiler() const
+{
+  return profiler.get();
+}
+
+const CycleModel *EmulatorCore::getCycleModel() const
+{
+  return cycleModel.get();
+}
+
+const CallStackSampler *EmulatorCore::getSampler() const
+{
+  return sampler.get();
+}
+
+uint32_t EmulatorCore::getRegister(uint16_t index) const
+{
+  return r[index];
+}
+
+void EmulatorCore::setRegister(uint16_t index, uint32_t value)
+{
+  r[index] = value;
+}
+
+uint32_t EmulatorCore::getCsr(uint16_t index) const
+{
+  return csr[index];
+}
+
+Memory &EmulatorCore::getMemory()
+{
+  return mem;
+}
+
+void EmulatorCore::stop(StopReason reason, const std::string &message)
+{
+  stopReason = reason;
+  stopMessage = message;
+  endSlice();
+}
+
+// Makes the running slice return after the current instruction or translated block
+void EmulatorCore::endSlice()
+{
+  sliceEnd = 0;
+  if (jit)
+  {
+    jit->requestExit();
+  }
+  if (translated)
+  {
+    translated->requestExit();
+  }
+}
+
+// Returns a 4 byte word from memory for the specified address
+uint32_t EmulatorCore::readWord(uint32_t addr)
+{
+  if (cycleModel && addr < MMIO_START)
+  {
+    cycleModel->accessData(addr);
+  }
+  return mem.readWord(addr);
+}
+
+// Writes a 4 byte word to memory at the specified address
+void EmulatorCore::writeWord(uint32_t addr, uint32_t word)
+{
+  if (cycleModel && addr < MMIO_START)
+  {
+    cycleModel->accessData(addr);
+  }
+  mem.writeWord(addr, word);
+  decodeCache.invalidate(addr);
+  decodeCache.invalidate(addr + 3);
+  if (jit)
+  {
+    jit->invalidate(addr);
+    jit->invalidate(addr + 3);
+  }
+  if (translated)
+  {
+    translated->invalidate(addr);
+    translated->invalidate(addr + 3);
+  }
+  if (addr >= MMIO_START)
+  {
+    writeDevice(addr, word);
+  }
+}
+
+// Device registers keep their last written value in memory, reads don't need to reach the device
+void EmulatorCore::writeDevice(uint32_t addr, uint32_t word)
+{
+  switch (addr)
+  {
+  case TERM_OUT:
+    if (terminal)
+    {
+      terminal->write(word);
+    }
+    break;
+  case TIM_CFG:
+    // The timer restarts once the slice ends, when the instruction count is exact
+    timerConfig = word;
+    timerRestart = true;
+    endSlice();
+    break;
+  }
+}
+
+void EmulatorCore::writeWordFromTranslatedCode(void *core, uint32_t addr, uint32_t word)
+{
+  static_cast<EmulatorCore *>(core)->writeWord(addr, word);
+}
+
+static const char *csrName(uint16_t index)
+{
+  switch (index)
+  {
+  case 0:
+    return "status";
+  case 1:
+    return "handler";
+  case 2:
+    return "cause";
+  default:
+    return "ERROR_REG";
+  }
+}
+
+void EmulatorCore::printInt()
+{
+  trace->text("int").endLine();
+}
+
+void EmulatorCore::printCall(const DecodedInstruction &instruction)
+{
+  trace->text("call ").hex(mem.readWord(r[instruction.regA] + instruction.disp)).endLine();
+}
+
+void EmulatorCore::printBranch(const DecodedInstruction &instruction)
+{
+  trace->text(isa::getMnemonic(instruction.operation)).text(" ");
+  if (instruction.operation != isa::Operation::JMP)
+  {
+    trace->reg(instruction.regB).text(", ").reg(instruction.regC).text(", ");
+  }
+  trace->hex(mem.readWord(r[instruction.regA] + instruction.disp)).endLine();
+}
+
+void EmulatorCore::printXchg(const DecodedInstruction &instruction)
+{
+  trace->text("xchg ").reg(instruction.regB).text(", ").reg(instruction.regC).endLine();
+}
+
+// Arithmetic, logic and shift instructions
+void EmulatorCore::printRegisterOp(const DecodedInstruction &instruction)
+{
+  trace->text(isa::getMnemonic(instruction.operation)).text(" ").reg(instruction.regB);
+  if (instruction.operation != isa::Operation::NOT)
+  {
+    trace->text(", ").reg(instruction.regC);
+  }
+  trace->endLine();
+}
+
+void EmulatorCore::printStore(const DecodedInstruction &instruction)
+{
+  switch (instruction.operation)
+  {
+  case isa::Operation::STORE:
+    trace->text("st ").reg(instruction.regC).text(", [").reg(instruction.regA);
+    trace->text(" + ").hex(instruction.disp).text("]").endLine();
+    break;
+  case isa::Operation::STORE_INDIRECT:
+    trace->text("st ").reg(instruction.regC).text(", ");
+    trace->hex(mem.readWord(r[instruction.regA] + instruction.disp)).endLine();
+    break;
+  case isa::Operation::PUSH:
+    trace->text("push ").reg(instruction.regC).endLine();
+    break;
+  default:
+    break;
+  }
+}
+
+void EmulatorCore::printLoad(const DecodedInstruction &instruction)
+{
+  switch (instruction.operation)
+  {
+  case isa::Operation::LOAD:
+    trace->text("ld ");
+    if (instruction.regB == 15)
+    {
+      trace->text("$").hex(mem.readWord(r[instruction.regB] + instruction.disp));
+    }
+    else
+    {
+      trace->text("[").reg(instruction.regB).text(" + ").hex(instruction.disp).text("]");
+    }
+    trace->text(", ").reg(instruction.regA).endLine();
+    break;
+  case isa::Operation::POP:
+    trace->text("pop ").reg(instruction.regA).text("(").dec(instruction.disp).text(")").endLine();
+    break;
+  case isa::Operation::POP_CSR:
+    trace->text("pop ").text(csrName(instruction.regA)).text("(").dec(instruction.disp).text(")").endLine();
+    break;
+  case isa::Operation::CSR_WRITE:
+    trace->text("csrwr ").reg(instruction.regB).text(", %").text(csrName(instruction.regA)).endLine();
+    break;
+  case isa::Operation::CSR_READ:
+    trace->text("csrrd %").text(csrName(instruction.regB)).text(", ").reg(instruction.regA).endLine();
+    break;
+  case isa::Operation::ADD_DISP:
+    trace->reg(instruction.regA).text(" = ").reg(instruction.regB);
+    if (instruction.disp >= 0)
+    {
+      trace->text(" + ");
+    }
+    trace->dec(instruction.disp).endLine();
+    break;
+  default:
+    break;
+  }
+}
+
+void EmulatorCore::printInstruction(const DecodedInstruction &instruction)
+{
+  switch (instruction.operation)
+  {
+  case isa::Operation::INT:
+    printInt();
+    break;
+  case isa::Operation::CALL:
+    printCall(instruction);
+    break;
+  case isa::Operation::JMP:
+  case isa::Operation::BEQ:
+  case isa::Operation::BNE:
+  case isa::Operation::BGT:
+    printBranch(instruction);
+    break;
+  case isa::Operation::XCHG:
+    printXchg(instruction);
+    break;
+  case isa::Operation::ADD:
+  case isa::Operation::SUB:
+  case isa::Operation::MUL:
+  case isa::Operation::DIV:
+  case isa::Operation::NOT:
+  case isa::Operation::AND:
+  case isa::Operation::OR:
+  case isa::Operation::XOR:
+  case isa::Operation::SHL:
+  case isa::Operation::SHR:
+    printRegisterOp(instruction);
+    break;
+  case isa::Operation::STORE:
+  case isa::Operation::PUSH:
+  case isa::Operation::STORE_INDIRECT:
+    printStore(instruction);
+    break;
+  case isa::Operation::CSR_READ:
+  case isa::Operation::ADD_DISP:
+  case isa::Operation::LOAD:
+  case isa::Operation::POP:
+  case isa::Operation::CSR_WRITE:
+  case isa::Operation::POP_CSR:
+    printLoad(instruction);
+    break;
+  default:
+    break;
+  }
+}
+
+void EmulatorCore::pushReg(uint32_t value)
+{
+  SP -= 4;
+  writeWord(SP, value);
+}
+
+void EmulatorCore::popReg(uint32_t &reg)
+{
+  reg = readWord(SP);
+  SP += 4;
+}
+
+void EmulatorCore::executeInvalidOpCode(const DecodedInstruction &instruction)
+{
+  stop(StopReason::INVALID_OPCODE, "Invalid opcode.");
+}
+
+void EmulatorCore::executeInvalidModifier(const DecodedInstruction &instruction)
+{
+  stop(StopReason::INVALID_MODIFIER, "Invalid instruction modifier.");
+}
+
+void EmulatorCore::executeHalt(const DecodedInstruction &instruction)
+{
+  stop(StopReason::HALT, "");
+}
+
+void EmulatorCore::raiseInterrupt(uint32_t cause)
+{
+  pushReg(STATUS);
+  pushReg(PC);
+  CAUSE = cause;
+  STATUS &= ~(0x1);
+  if (sampler)
+  {
+    sampler->enter(HANDLER, PC);
+  }
+  PC = HANDLER;
+}
+
+void EmulatorCore::executeInt(const DecodedInstruction &instruction)
+{
+  raiseInterrupt(CAUSE_SOFTWARE);
+}
+
+void EmulatorCore::executeCall(const DecodedInstruction &instruction)
+{
+  pushReg(PC);
+  uint32_t returnAddress = PC;
+  PC = readWord(r[instruction.regA] + r[instruction.regB] + instruction.disp);
+  if (sampler)
+  {
+    sampler->enter(PC, returnAddress);
+  }
+}
+
+void EmulatorCore::executeJmp(const DecodedInstruction &instruction)
+{
+  branchTo(readWord(r[instruction.regA] + instruction.disp));
+}
+
+void EmulatorCore::executeBeq(const DecodedInstruction &instruction)
+{
+  if (r[instruction.regB] == r[instruction.regC])
+  {
+    branchTo(readWord(r[instruction.regA] + instruction.disp));
+  }
+}
+
+void EmulatorCore::executeBne(const DecodedInstruction &instruction)
+{
+  if (r[instruction.regB] != r[instruction.regC])
+  {
+    branchTo(readWord(r[instruction.regA] + instruction.disp));
+  }
+}
+
+void EmulatorCore::executeBgt(const DecodedInstruction &instruction)
+{
+  if (r[instruction.regB] > r[instruction.regC])
+  {
+    branchTo(readWord(r[instruction.regA] + instruction.disp));
+  }
+}
+
+// PC already points past the branch
+void EmulatorCore::branchTo(uint32_t target)
+{
+  if (target < PC && skipIdleLoops)
+  {
+    noteBackwardBranch(PC - 4, target);
+  }
+  PC = target;
+}
+
+// Counts how often the same backward branch is taken in a row. After IDLE_LOOP_ITERATIONS
+// the state is saved, and if the next iteration ends in the same state without having
+// stored anything, every later iteration does too, so they are skipped up to the slice end.
+// The loop stays known as idle until its state changes, so later slices skip right away.
+void EmulatorCore::noteBackwardBranch(uint32_t branchPc, uint32_t target)
+{
+  if (branchPc != idleBranch)
+  {
+    idleBranch = branchPc;
+    idleIterations = 0;
+    return;
+  }
+  if (++idleIterations < IDLE_LOOP_ITERATIONS)
+  {
+    return;
+  }
+  if (idleIterations == IDLE_LOOP_ITERATIONS)
+  {
+    idleStart = instructionCount;
+    memcpy(idleRegisters, r, sizeof(r));
+    memcpy(idleCsr, csr, sizeof(csr));
+    return;
+  }
+  uint64_t length = instructionCount - idleStart;
+  if (memcmp(idleRegisters, r, sizeof(r)) || memcmp(idleCsr, csr, sizeof(csr)) ||
+      length != (branchPc - target) / 4 + 1 || !isIdleLoopBody(target, branchPc))
+  {
+    idleIterations = 0;
+    return;
+  }
+  // The branch itself is counted once it returns
+  instructionCount += (sliceEnd - instructionCount - 1) / length * length;
+  idleStart = instructionCount;
+  idleIterations = IDLE_LOOP_ITERATIONS;
+}
+
+// Every instruction from start to the branch at end runs once per iteration, none of them
+// stores, calls or raises an interrupt, and branches inside stay inside
+bool EmulatorCore::isIdleLoopBody(uint32_t start, uint32_t end)
+{
+  if (start & 0x3 || end - start >= IDLE_LOOP_MAX_LENGTH * 4)
+  {
+    return false;
+  }
+  for (uint32_t pc = start; pc < end; pc += 4)
+  {
+    DecodedInstruction instruction = decodeInstruction(mem.readWord(pc));
+    switch (instruction.operation)
+    {
+    case isa::Operation::HALT:
+    case isa::Operation::INT:
+    case isa::Operation::CALL:
+    case isa::Operation::STORE:
+    case isa::Operation::PUSH:
+    case isa::Operation::STORE_INDIRECT:
+    case isa::Operation::INVALID_MODIFIER:
+    case isa::Operation::INVALID_OPCODE:
+      return false;
+    case isa::Operation::JMP:
+    case isa::Operation::BEQ:
+    case isa::Operation::BNE:
+    case isa::Operation::BGT:
+    {
+      if (instruction.regA != 0 && instruction.regA != 15)
+      {
+        return false;
+      }
+      uint32_t base = instruction.regA == 15 ? pc + 4 : 0;
+      uint32_t target = mem.readWord(base + instruction.disp);
+      if (target < start || target > end)
+      {
+        return false;
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+  return true;
+}
+
+void EmulatorCore::executeXchg(const DecodedInstruction &instruction)
+{
+  uint32_t temp = r[instruction.regB];
+  r[instruction.regB] = r[instruction.regC];
+  r[instruction.regC] = temp;
+}
+
+void EmulatorCore::executeAdd(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = r[instruction.regB] + r[instruction.regC];
+}
+
+void EmulatorCore::executeSub(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = r[instruction.regB] - r[instruction.regC];
+}
+
+void EmulatorCore::executeMul(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = r[instruction.regB] * r[instruction.regC];
+}
+
+void EmulatorCore::executeDiv(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = r[instruction.regB] / r[instruction.regC];
+}
+
+void EmulatorCore::executeNot(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = ~r[instruction.regB];
+}
+
+void EmulatorCore::executeAnd(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = r[instruction.regB] & r[instruction.regC];
+}
+
+void EmulatorCore::executeOr(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = r[instruction.regB] | r[instruction.regC];
+}
+
+void EmulatorCore::executeXor(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = r[instruction.regB] ^ r[instruction.regC];
+}
+
+void EmulatorCore::executeShl(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = r[instruction.regB] << r[instruction.regC];
+}
+
+void EmulatorCore::executeShr(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = r[instruction.regB] >> r[instruction.regC];
+}
+
+// st mem[reg], mem[reg + literal]
+void EmulatorCore::executeStore(const DecodedInstruction &instruction)
+{
+  writeWord(r[instruction.regA] + r[instruction.regB] + instruction.disp, r[instruction.regC]);
+}
+
+// st mem[literal], mem[symbol]
+void EmulatorCore::executeStoreIndirect(const DecodedInstruction &instruction)
+{
+  writeWord(readWord(r[instruction.regA] + r[instruction.regB] + instruction.disp), r[instruction.regC]);
+}
+
+// push
+void EmulatorCore::executePush(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = r[instruction.regA] - instruction.disp;
+  writeWord(r[instruction.regA], r[instruction.regC]);
+}
+
+// ld literal, symbol, mem[literal], mem[symbol], mem[reg], mem[reg + literal]
+void EmulatorCore::executeLoad(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = readWord(r[instruction.regB] + r[instruction.regC] + instruction.disp);
+}
+
+// pop
+void EmulatorCore::executePop(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = readWord(r[instruction.regB]);
+  r[instruction.regB] = r[instruction.regB] + instruction.disp;
+  // ret and iret
+  if (instruction.regA == 15 && sampler)
+  {
+    sampler->leave(PC);
+  }
+}
+
+// pop csr
+void EmulatorCore::executePopCsr(const DecodedInstruction &instruction)
+{
+  csr[instruction.regA] = readWord(r[instruction.regB]);
+  r[instruction.regB] = r[instruction.regB] + instruction.disp;
+}
+
+// csrrd
+void EmulatorCore::executeCsrRead(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = csr[instruction.regB];
+}
+
+// csrwr
+void EmulatorCore::executeCsrWrite(const DecodedInstruction &instruction)
+{
+  csr[instruction.regA] = r[instruction.regB];
+}
+
+// for iret, sp = sp + 4
+void EmulatorCore::executeAddDisp(const DecodedInstruction &instruction)
+{
+  r[instruction.regA] = r[instruction.regB] + instruction.disp;
+}
 
-  void setInputFile(std::string inputFileName)
+InstructionHandler EmulatorCore::selectHandler(isa::Operation operation)
+{
+  struct Entry
   {
-    inputFile.open(inputFileName);
+    isa::Operation operation;
+    InstructionHandler handler;
+  };
+  static constexpr Entry handlers[] = {
+      {isa::Operation::HALT, &dispatch<&EmulatorCore::executeHalt>},
+      {isa::Operation::INT, &dispatch<&EmulatorCore::executeInt>},
+      {isa::Operation::CALL, &dispatch<&EmulatorCore::executeCall>},
+      {isa::Operation::JMP, &dispatch<&EmulatorCore::executeJmp>},
+      {isa::Operation::BEQ, &dispatch<&EmulatorCore::executeBeq>},
+      {isa::Operation::BNE, &dispatch<&EmulatorCore::executeBne>},
+      {isa::Operation::BGT, &dispatch<&EmulatorCore::executeBgt>},
+      {isa::Operation::XCHG, &dispatch<&EmulatorCore::executeXchg>},
+      {isa::Operation::ADD, &dispatch<&EmulatorCore::executeAdd>},
+      {isa::Operation::SUB, &dispatch<&EmulatorCore::executeSub>},
+      {isa::Operation::MUL, &dispatch<&EmulatorCore::executeMul>},
+      {isa::Operation::DIV, &dispatch<&EmulatorCore::executeDiv>},
+      {isa::Operation::NOT, &dispatch<&EmulatorCore::executeNot>},
+      {isa::Operation::AND, &dispatch<&EmulatorCore::executeAnd>},
+      {isa::Operation::OR, &dispatch<&EmulatorCore::executeOr>},
+      {isa::Operation::XOR, &dispatch<&EmulatorCore::executeXor>},
+      {isa::Operation::SHL, &dispatch<&EmulatorCore::executeShl>},
+      {isa::Operation::SHR, &dispatch<&EmulatorCore::executeShr>},
+      {isa::Operation::STORE, &dispatch<&EmulatorCore::executeStore>},
+      {isa::Operation::PUSH, &dispatch<&EmulatorCore::executePush>},
+      {isa::Operation::STORE_INDIRECT, &dispatch<&EmulatorCore::executeStoreIndirect>},
+      {isa::Operation::CSR_READ, &dispatch<&EmulatorCore::executeCsrRead>},
+      {isa::Operation::ADD_DISP, &dispatch<&EmulatorCore::executeAddDisp>},
+      {isa::Operation::LOAD, &dispatch<&EmulatorCore::executeLoad>},
+      {isa::Operation::POP, &dispatch<&EmulatorCore::executePop>},
+      {isa::Operation::CSR_WRITE, &dispatch<&EmulatorCore::executeCsrWrite>},
+      {isa::Operation::POP_CSR, &dispatch<&EmulatorCore::executePopCsr>},
+      {isa::Operation::INVALID_MODIFIER, &dispatch<&EmulatorCore::executeInvalidModifier>},
+      {isa::Operation::INVALID_OPCODE, &dispatch<&EmulatorCore::executeInvalidOpCode>},
+  };
+  static_assert(sizeof(handlers) / sizeof(handlers[0]) == isa::OPERATION_COUNT, "every operation needs a handler");
+  static_assert([]
+                {
+                  for (uint32_t i = 0; i < isa::OPERATION_COUNT; ++i)
+                  {
+                    if ((uint32_t)handlers[i].operation != i)
+                    {
+                      return false;
+                    }
+                  }
+                  return true; }(),
+                "handlers must be in the order of isa::Operation");
+  return handlers[(uint32_t)operation].handler;
+}
 
-    if (!inputFile.is_open())
-    {
-      std::cout << "Error opening input file." << std::endl;
-      exit(1);
-    }
+DecodedInstruction EmulatorCore::decodeInstruction(uint32_t instruction)
+{
+  DecodedInstruction decoded;
+  decoded.opCode = (instruction & 0xF0000000) >> 28;
+  decoded.mod = (instruction & 0x0F000000) >> 24;
+  decoded.regA = (instruction & 0x00F00000) >> 20;
+  decoded.regB = (instruction & 0x000F0000) >> 16;
+  decoded.regC = (instruction & 0x0000F000) >> 12;
+  decoded.disp = (instruction & 0x00000FFF);
+  if (decoded.disp & 0x0800)
+  {
+    decoded.disp |= 0xFFFFF000; // Set sign bits for negative numbers
   }
+  decoded.operation = isa::decode(instruction);
+  decoded.execute = selectHandler(decoded.operation);
+  decoded.fused = nullptr;
+  decoded.fusedLength = 1;
+  return decoded;
+}
+
+// iret, the three words the assembler emits for it
+uint32_t EmulatorCore::executeFusedIret(const DecodedInstruction &instruction)
+{
+  const DecodedInstruction *parts = &instruction;
+  executeAddDisp(parts[0]);
+  PC += 4;
+  executePopCsr(parts[1]);
+  PC += 4;
+  executePop(parts[2]);
+  return 3;
+}
 
-  void parseInput()
+// ld mem[sym], the literal load of the address and the load through it
+uint32_t EmulatorCore::executeFusedLoadMemory(const DecodedInstruction &instruction)
+{
+  const DecodedInstruction *parts = &instruction;
+  executeLoad(parts[0]);
+  PC += 4;
+  executeLoad(parts[1]);
+  return 2;
+}
+
+// Two pushes in a row
+uint32_t EmulatorCore::executeFusedPushes(const DecodedInstruction &instruction)
+{
+  const DecodedInstruction *parts = &instruction;
+  executePush(parts[0]);
+  // A device write ends the slice right after the first push, and a push onto the
+  // second one changes it, either way the second push runs on its own
+  if (sliceEnd == 0 || !parts[1].execute)
   {
-    std::string currentWord;
-    uint32_t addr;
-    while (inputFile >> currentWord)
-    {
-      if (currentWord[0] == '#')
-      {
-        return;
-      }
-      if (currentWord.back() == ':')
-      {
-        currentWord.pop_back();
-        addr = std::stoul(currentWord, nullptr, 16);
-        continue;
-      }
-      uint16_t data = std::stoul(currentWord, nullptr, 16);
-      mem[addr++] = data;
-    }
+    return 1;
   }
+  PC += 4;
+  executePush(parts[1]);
+  return 2;
+}
+
+// Two pops in a row, the second one can be ret
+uint32_t EmulatorCore::executeFusedPops(const DecodedInstruction &instruction)
+{
+  const DecodedInstruction *parts = &instruction;
+  executePop(parts[0]);
+  PC += 4;
+  executePop(parts[1]);
+  return 2;
+}
 
-  uint32_t fetchInstruction()
+// Recognizes the sequences the assembler emits for iret and ld mem[sym], and pushes and
+// pops in pairs, starting at the cache entry for pc. A sequence never crosses a page, so
+// its instructions are the entries right after the first one. Those are only filled in
+// when a sequence is found, an entry decoded on its own can start a sequence itself.
+void EmulatorCore::fuseInstructions(DecodedInstruction *first, uint32_t pc)
+{
+  uint32_t available = (Memory::PAGE_SIZE - (pc & Memory::PAGE_MASK)) / 4;
+  uint32_t length = std::min(available, DecodeCache::MAX_FUSED_LENGTH);
+  DecodedInstruction parts[DecodeCache::MAX_FUSED_LENGTH];
+  parts[0] = *first;
+  for (uint32_t i = 1; i < length; ++i)
   {
-    uint16_t byte1 = mem[PC];
-    uint16_t byte2 = mem[PC + 1];
-    uint16_t byte3 = mem[PC + 2];
-    uint16_t byte4 = mem[PC + 3];
-    uint32_t instruction = (byte4 << 24) | (byte3 << 16) | (byte2 << 8) | (byte1 << 0);
-    PC += 4;
-    return instruction;
+    parts[i] = first[i].execute ? first[i] : decodeInstruction(mem.readWord(pc + i * 4));
   }
+  auto is = [&](uint32_t i, isa::Operation operation)
+  {
+    return i < length && parts[i].operation == operation;
+  };
 
-  // Returns a 4 byte word from memory for the specified address
-  uint32_t readWord(uint32_t addr)
+  if (is(0, isa::Operation::ADD_DISP) && is(1, isa::Operation::POP_CSR) && is(2, isa::Operation::POP) && parts[0].regA == 14 &&
+      parts[0].regB == 14 && parts[1].regB == 14 && parts[2].regA == 15 && parts[2].regB == 14)
   {
-    uint16_t byte1 = mem[addr];
-    uint16_t byte2 = mem[addr + 1];
-    uint16_t byte3 = mem[addr + 2];
-    uint16_t byte4 = mem[addr + 3];
-    uint32_t word = (byte4 << 24) | (byte3 << 16) | (byte2 << 8) | (byte1 << 0);
-    return word;
+    first->fused = &dispatchFused<&EmulatorCore::executeFusedIret>;
+    first->fusedLength = 3;
   }
-
-  // Writes a 4 byte word to memory at the specified address
-  void writeWord(uint32_t addr, uint32_t word)
+  else if (is(0, isa::Operation::LOAD) && is(1, isa::Operation::LOAD) && parts[0].regA != 0 && parts[0].regA != 15 &&
+           parts[0].regB == 15 && parts[0].regC == 0 && parts[1].regA == parts[0].regA &&
+           parts[1].regB == parts[0].regA && parts[1].regC == 0)
   {
-    uint16_t byte4 = (word & 0xFF000000) >> 24;
-    uint16_t byte3 = (word & 0x00FF00FF) >> 16;
-    uint16_t byte2 = (word & 0x0000FF00) >> 8;
-    uint16_t byte1 = (word & 0x000000FF) >> 0;
-    mem[addr] = byte1;
-    mem[addr + 1] = byte2;
-    mem[addr + 2] = byte3;
-    mem[addr + 3] = byte4;
+    first->fused = &dispatchFused<&EmulatorCore::executeFusedLoadMemory>;
+    first->fusedLength = 2;
   }
-
-  void printInt()
+  else if (is(0, isa::Operation::PUSH) && is(1, isa::Operation::PUSH) && parts[0].regA == 14 && parts[1].regA == 14)
   {
-    std::cout << "int" << std::endl;
+    first->fused = &dispatchFused<&EmulatorCore::executeFusedPushes>;
+    first->fusedLength = 2;
   }
-
-  void printCall(uint32_t instruction)
+  else if (is(0, isa::Operation::POP) && is(1, isa::Operation::POP) && parts[0].regB == 14 && parts[1].regB == 14 &&
+           parts[0].regA != 0 && parts[0].regA != 14 && parts[0].regA != 15)
   {
-    uint16_t mod = ((instruction & 0x0F000000) >> 24);
-    uint16_t regA = ((instruction & 0x00F00000) >> 20);
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t disp = (instruction & 0x00000FFF);
-
-    switch (mod)
-    {
-    case 0b0001:
-      std::cout << "call ";
-      std::cout << "0x" << std::hex << readWord(r[regA] + disp);
-      std::cout << std::endl;
-      break;
-    default:
-      std::cout << "Emulator error. Invalid instruction modifier." << std::endl;
-      exit(1);
-    }
+    first->fused = &dispatchFused<&EmulatorCore::executeFusedPops>;
+    first->fusedLength = 2;
   }
-
-  void printBranch(uint32_t instruction)
+  for (uint32_t i = 1; i < first->fusedLength; ++i)
   {
-    uint16_t mod = ((instruction & 0x0F000000) >> 24);
-    uint16_t regA = ((instruction & 0x00F00000) >> 20);
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t regC = ((instruction & 0x0000F000) >> 12);
-    uint16_t disp = (instruction & 0x00000FFF);
-
-    switch (mod)
+    if (!first[i].execute)
     {
-    case 0b1000:
-      std::cout << "jmp ";
-      std::cout << "0x" << std::hex << readWord(r[regA] + disp);
-      std::cout << std::endl;
-      break;
-    case 0b1001:
-      std::cout << "beq ";
-      std::cout << "%r" << std::dec << regB << ", "
-                << "%r" << std::dec << regC << ", ";
-      std::cout << "0x" << std::hex << readWord(r[regA] + disp);
-      std::cout << std::endl;
-      break;
-    case 0b1010:
-      std::cout << "bne ";
-      std::cout << "%r" << std::dec << regB << ", "
-                << "%r" << std::dec << regC << ", ";
-      std::cout << "0x" << std::hex << readWord(r[regA] + disp);
-      std::cout << std::endl;
-      break;
-    case 0b1011:
-      std::cout << "bgt ";
-      std::cout << "%r" << std::dec << regB << ", "
-                << "%r" << std::dec << regC << ", ";
-      std::cout << "0x" << std::hex << readWord(r[regA] + disp);
-      std::cout << std::endl;
-      break;
-    default:
-      std::cout << "Emulator error. Invalid instruction modifier." << std::endl;
-      exit(1);
+      first[i] = parts[i];
     }
   }
+}
 
-  void printXchg(uint32_t instruction)
+// Policies for the interpreter loop. Every combination gets its own instantiation of the
+// loop, so the one without tracing, profiling and breakpoints doesn't check for them at all.
+struct EmulatorCore::NoTrace
+{
+  static void onInstruction(EmulatorCore &core, const DecodedInstruction &instruction) {}
+};
+
+struct EmulatorCore::TraceInstructions
+{
+  static void onInstruction(EmulatorCore &core, const DecodedInstruction &instruction)
   {
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t regC = ((instruction & 0x0000F000) >> 12);
-    std::cout << "xchg %r" << std::dec << regB << ", %r" << std::dec << regC << std::endl;
+    core.printInstruction(instruction);
   }
+};
 
-  void printArithmOp(uint32_t instruction)
-  {
-    uint16_t mod = ((instruction & 0x0F000000) >> 24);
-    uint16_t regA = ((instruction & 0x00F00000) >> 20);
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t regC = ((instruction & 0x0000F000) >> 12);
+struct EmulatorCore::NoProfile
+{
+  static void onInstruction(EmulatorCore &core, const DecodedInstruction &instruction, uint32_t pc) {}
+};
 
-    switch (mod)
+struct EmulatorCore::ProfileInstructions
+{
+  static void onInstruction(EmulatorCore &core, const DecodedInstruction &instruction, uint32_t pc)
+  {
+    if (core.profiler)
     {
-    case 0b0000:
-      std::cout << "add ";
-      break;
-    case 0b0001:
-      std::cout << "sub ";
-      break;
-    case 0b0010:
-      std::cout << "mul ";
-      break;
-    case 0b0011:
-      std::cout << "div ";
-      break;
-    default:
-      std::cout << "Invalid instruction modifier." << std::endl;
-      exit(1);
-      break;
+      core.profiler->record(instruction, pc, core.PC);
     }
-    std::cout << "%r" << std::dec << regB << ", %r" << std::dec << regC << std::endl;
-  }
-
-  void printLogOp(uint32_t instruction)
-  {
-    uint16_t mod = ((instruction & 0x0F000000) >> 24);
-    uint16_t regA = ((instruction & 0x00F00000) >> 20);
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t regC = ((instruction & 0x0000F000) >> 12);
-
-    switch (mod)
+    if (core.cycleModel)
     {
-    case 0b0000:
-      std::cout << "not %r" << std::dec << regB << std::endl;
-      break;
-    case 0b0001:
-      std::cout << "and %r" << std::dec << regB << ", %r" << std::dec << regC << std::endl;
-      break;
-    case 0b0010:
-      std::cout << "or %r" << std::dec << regB << ", %r" << std::dec << regC << std::endl;
-      break;
-    case 0b0011:
-      std::cout << "xor %r" << std::dec << regB << ", %r" << std::dec << regC << std::endl;
-      break;
-    default:
-      std::cout << "Invalid instruction modifier." << std::endl;
-      exit(1);
-      break;
+      core.cycleModel->record(instruction, pc, core.PC);
     }
   }
+};
 
-  void printShift(uint32_t instruction)
+struct EmulatorCore::NoBreakpoints
+{
+  static bool isBreakpoint(EmulatorCore &core, uint32_t pc)
   {
-    uint16_t mod = ((instruction & 0x0F000000) >> 24);
-    uint16_t regA = ((instruction & 0x00F00000) >> 20);
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t regC = ((instruction & 0x0000F000) >> 12);
-
-    switch (mod)
-    {
-    case 0b0000:
-      std::cout << "shl ";
-      break;
-    case 0b0001:
-      std::cout << "shr ";
-      break;
-    default:
-      std::cout << "Invalid instruction modifier." << std::endl;
-      exit(1);
-      break;
-    }
-    std::cout << "%r" << std::dec << regB << ", %r" << std::dec << regC << std::endl;
+    return false;
   }
+};
 
-  void printStore(uint32_t instruction)
+struct EmulatorCore::CheckBreakpoints
+{
+  static bool isBreakpoint(EmulatorCore &core, uint32_t pc)
   {
-    uint16_t mod = ((instruction & 0x0F000000) >> 24);
-    uint16_t regA = ((instruction & 0x00F00000) >> 20);
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t regC = ((instruction & 0x0000F000) >> 12);
-    uint16_t disp = (instruction & 0x00000FFF);
+    return core.breakpoints.count(pc);
+  }
+};
 
-    switch (mod)
-    {
-    case 0b0000:
-      std::cout << "st ";
-      std::cout << "%r" << std::dec << regC << ", ";
-      std::cout << "[%r" << std::dec << regA;
-      std::cout << " + 0x" << std::hex << disp << "]";
-      std::cout << std::endl;
-      break;
-    case 0b0010:
-      std::cout << "st ";
-      std::cout << "%r" << std::dec << regC << ", ";
-      std::cout << "0x" << std::hex << readWord(r[regA] + disp);
-      std::cout << std::endl;
-      break;
-    case 0b0001:
-      std::cout << "push ";
-      std::cout << "%r" << std::dec << regC << std::endl;
-      break;
-    default:
-      std::cout << "Emulator error. Invalid instruction modifier." << std::endl;
-      exit(1);
-    }
+// PC is advanced before the trace, so PC relative operands print the same as they execute.
+// The profile sees PC after execution to tell taken branches apart.
+template <class Trace, class Profile>
+void EmulatorCore::interpretInstruction(const DecodedInstruction &instruction)
+{
+  uint32_t pc = PC;
+  PC += 4;
+  Trace::onInstruction(*this, instruction);
+  instruction.execute(*this, instruction);
+  r[0] = 0x00000000;
+  Profile::onInstruction(*this, instruction, pc);
+}
+
+// Returns the instruction at PC, decoded only on the first visit. Unaligned instructions
+// aren't cached and are decoded into uncached.
+const DecodedInstruction &EmulatorCore::fetchInstruction(DecodedInstruction &uncached)
+{
+  DecodedInstruction *currentInstruction = decodeCache.getEntry(PC);
+  if (!currentInstruction)
+  {
+    uncached = decodeInstruction(mem.readWord(PC));
+    return uncached;
+  }
+  if (!currentInstruction->execute)
+  {
+    *currentInstruction = decodeInstruction(mem.readWord(PC));
+    fuseInstructions(currentInstruction, PC);
   }
+  return *currentInstruction;
+}
 
-  void printLoad(uint32_t instruction)
+template <class Trace, class Profile, class Breakpoints>
+void EmulatorCore::interpretLoop(bool resumeAtBreakpoint)
+{
+  // Fused sequences would hide their later instructions from the trace, the profile and breakpoints
+  const bool fuse = std::is_same<Trace, NoTrace>::value && std::is_same<Profile, NoProfile>::value &&
+                    std::is_same<Breakpoints, NoBreakpoints>::value;
+  DecodedInstruction uncached;
+  // Stopping and device writes pull sliceEnd in, so it's the only check the loop needs
+  while (instructionCount < sliceEnd)
   {
-    uint16_t mod = ((instruction & 0x0F000000) >> 24);
-    uint16_t regA = ((instruction & 0x00F00000) >> 20);
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t regC = ((instruction & 0x0000F000) >> 12);
-    int16_t disp = (instruction & 0x00000FFF);
-    if (disp & 0x0800)
+    if (Breakpoints::isBreakpoint(*this, PC) && !resumeAtBreakpoint)
     {
-      disp |= 0xF000; // Set sign bits for negative numbers
+      std::ostringstream message;
+      message << "Breakpoint at 0x" << std::hex << PC << ".";
+      stop(StopReason::BREAKPOINT, message.str());
+      return;
     }
-    std::string csr;
-
-    switch (mod)
+    resumeAtBreakpoint = false;
+    const DecodedInstruction &instruction = fetchInstruction(uncached);
+    // A sequence only runs fused if it ends within the slice, so events still arrive between its instructions
+    if (fuse && instruction.fused && sliceEnd - instructionCount >= instruction.fusedLength)
     {
-    case 0b0010:
-      std::cout << "ld ";
-      if (regB == 15)
-      {
-        std::cout << "$0x" << std::hex << readWord(r[regB] + disp);
-      }
-      else
-      {
-        std::cout << "[%r" << std::dec << regB << " + 0x" << std::hex << disp << "]";
-      }
-      std::cout << ", %r" << std::dec << regA << std::endl;
-      break;
-    case 0b0011:
-      std::cout << "pop ";
-      std::cout << "%r" << std::dec << regA << "(" << std::dec << disp << ")" << std::endl;
-      break;
-    case 0b0111:
-      std::cout << "pop ";
-      switch (regA)
-      {
-      case 0:
-        csr = "status";
-        break;
-      case 1:
-        csr = "handler";
-        break;
-      case 2:
-        csr = "cause";
-        break;
-      default:
-        csr = "ERROR_REG";
-        break;
-      }
-      std::cout << csr << "(" << std::dec << disp << ")" << std::endl;
-      break;
-    case 0b0100:
-      std::cout << "csrwr ";
-      std::cout << "%r" << std::dec << regB << ", ";
-      switch (regA)
-      {
-      case 0:
-        csr = "status";
-        break;
-      case 1:
-        csr = "handler";
-        break;
-      case 2:
-        csr = "cause";
-        break;
-      default:
-        csr = "ERROR_REG";
-        break;
-      }
-      std::cout << "%" << csr << std::endl;
-      break;
-    case 0b0000:
-      std::cout << "csrrd ";
-      switch (regB)
-      {
-      case 0:
-        csr = "status";
-        break;
-      case 1:
-        csr = "handler";
-        break;
-      case 2:
-        csr = "cause";
-        break;
-      default:
-        csr = "ERROR_REG";
-        break;
-      }
-      std::cout << "%" << csr << ", ";
-      std::cout << "%r" << std::dec << regA << std::endl;
-      break;
-    case 0b0001:
-      std::cout << "%r" << regA << " = %r" << regB;
-      if (disp >= 0)
-      {
-        std::cout << " + ";
-      }
-      std::cout << disp << std::endl;
-      break;
-    default:
-      std::cout << "Emulator error. Invalid instruction modifier." << std::endl;
-      exit(1);
+      PC += 4;
+      instructionCount += instruction.fused(*this, instruction);
+      r[0] = 0x00000000;
+      continue;
     }
+    interpretInstruction<Trace, Profile>(instruction);
+    ++instructionCount;
   }
+}
 
-  void pushReg(uint32_t value)
+template <class Trace, class Profile>
+void EmulatorCore::interpretWithProfile(bool resumeAtBreakpoint)
+{
+  if (breakpoints.empty())
   {
-    SP -= 4;
-    writeWord(SP, value);
+    interpretLoop<Trace, Profile, NoBreakpoints>(resumeAtBreakpoint);
   }
-
-  void popReg(uint32_t &reg)
+  else
   {
-    reg = readWord(SP);
-    SP += 4;
+    interpretLoop<Trace, Profile, CheckBreakpoints>(resumeAtBreakpoint);
   }
+}
 
-  void executeHalt()
+template <class Trace>
+void EmulatorCore::interpretWithTrace(bool resumeAtBreakpoint)
+{
+  if (profiler || cycleModel)
+  {
+    interpretWithProfile<Trace, ProfileInstructions>(resumeAtBreakpoint);
+  }
+  else
   {
-    stopEmulation = true;
-    std::cout << "Emulated processor executed halt instruction" << std::endl;
-    std::cout << "Emulated processor state:" << std::endl;
-    std::cout << std::setw(6) << std::setfill(' ') << "r0=0x" << std::hex << std::setw(8) << std::setfill('0') << r[0] << " ";
-    std::cout << std::setw(6) << std::setfill(' ') << "r1=0x" << std::hex << std::setw(8) << std::setfill('0') << r[1] << " ";
-    std::cout << std::setw(6) << std::setfill(' ') << "r2=0x" << std::hex << std::setw(8) << std::setfill('0') << r[2] << " ";
-    std::cout << std::setw(6) << std::setfill(' ') << "r3=0x" << std::hex << std::setw(8) << std::setfill('0') << r[3] << std::endl;
-    std::cout << std::setw(6) << std::setfill(' ') << "r4=0x" << std::hex << std::setw(8) << std::setfill('0') << r[4] << " ";
-    std::cout << std::setw(6) << std::setfill(' ') << "r5=0x" << std::hex << std::setw(8) << std::setfill('0') << r[5] << " ";
-    std::cout << std::setw(6) << std::setfill(' ') << "r6=0x" << std::hex << std::setw(8) << std::setfill('0') << r[6] << " ";
-    std::cout << std::setw(6) << std::setfill(' ') << "r7=0x" << std::hex << std::setw(8) << std::setfill('0') << r[7] << std::endl;
-    std::cout << std::setw(6) << std::setfill(' ') << "r8=0x" << std::hex << std::setw(8) << std::setfill('0') << r[8] << " ";
-    std::cout << std::setw(6) << std::setfill(' ') << "r9=0x" << std::hex << std::setw(8) << std::setfill('0') << r[9] << " ";
-    std::cout << std::setw(6) << std::setfill(' ') << "r10=0x" << std::hex << std::setw(8) << std::setfill('0') << r[10] << " ";
-    std::cout << std::setw(6) << std::setfill(' ') << "r11=0x" << std::hex << std::setw(8) << std::setfill('0') << r[11] << std::endl;
-    std::cout << std::setw(6) << std::setfill(' ') << "r12=0x" << std::hex << std::setw(8) << std::setfill('0') << r[12] << " ";
-    std::cout << std::setw(6) << std::setfill(' ') << "r13=0x" << std::hex << std::setw(8) << std::setfill('0') << r[13] << " ";
-    std::cout << std::setw(6) << std::setfill(' ') << "r14=0x" << std::hex << std::setw(8) << std::setfill('0') << r[14] << " ";
-    std::cout << std::setw(6) << std::setfill(' ') << "r15=0x" << std::hex << std::setw(8) << std::setfill('0') << r[15] << std::endl;
+    interpretWithProfile<Trace, NoProfile>(resumeAtBreakpoint);
   }
+}
 
-  void executeInt()
+void EmulatorCore::interpret(bool resumeAtBreakpoint)
+{
+  if (trace)
   {
-    if (printInstructions)
-    {
-      printInt();
-    }
-    pushReg(STATUS);
-    pushReg(PC);
-    CAUSE = 4;
-    STATUS &= ~(0x1);
-    PC = HANDLER;
+    interpretWithTrace<TraceInstructions>(resumeAtBreakpoint);
+    trace->flush();
+  }
+  else
+  {
+    interpretWithTrace<NoTrace>(resumeAtBreakpoint);
   }
+}
 
-  void executeCall(uint32_t instruction)
+void EmulatorCore::runJit()
+{
+  while (instructionCount < sliceEnd)
   {
-    if (printInstructions)
+    instructionCount += jit->run(sliceEnd - instructionCount);
+    if (instructionCount >= sliceEnd)
     {
-      printCall(instruction);
+      break;
     }
-    uint16_t mod = ((instruction & 0x0F000000) >> 24);
-    uint16_t regA = ((instruction & 0x00F00000) >> 20);
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t disp = (instruction & 0x00000FFF);
+    // Instructions the translator leaves behind are rare, so they aren't cached
+    interpretInstruction<NoTrace, NoProfile>(decodeInstruction(readWord(PC)));
+    ++instructionCount;
+  }
+}
 
-    switch (mod)
+// Like runJit, but translated programs never overshoot the slice
+void EmulatorCore::runTranslated()
+{
+  while (instructionCount < sliceEnd)
+  {
+    instructionCount += translated->run(sliceEnd - instructionCount);
+    if (instructionCount >= sliceEnd)
     {
-    case 0b0001:
-      pushReg(PC);
-      PC = readWord(r[regA] + r[regB] + disp);
       break;
-    default:
-      std::cout << "Emulator error. Invalid instruction modifier." << std::endl;
-      exit(1);
     }
+    interpretInstruction<NoTrace, NoProfile>(decodeInstruction(readWord(PC)));
+    ++instructionCount;
   }
+}
+
+static uint64_t getTimerPeriod(uint32_t config)
+{
+  static const uint64_t periods[] = {500, 1000, 1500, 2000, 5000, 10000, 30000, 60000};
+  return (config < 8 ? periods[config] : periods[0]) * EmulatorCore::INSTRUCTIONS_PER_MILLISECOND;
+}
 
-  void executeBranch(uint32_t instruction)
+// Handles device writes and every event that is due, then enters the interrupt handler
+// if an interrupt is pending and not masked
+void EmulatorCore::processEvents()
+{
+  if (timerRestart)
   {
-    if (printInstructions)
-    {
-      printBranch(instruction);
-    }
-    uint16_t mod = ((instruction & 0x0F000000) >> 24);
-    uint16_t regA = ((instruction & 0x00F00000) >> 20);
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t regC = ((instruction & 0x0000F000) >> 12);
-    uint16_t disp = (instruction & 0x00000FFF);
+    timerRestart = false;
+    ++timerGeneration;
+    events.schedule({instructionCount + getTimerPeriod(timerConfig), EventType::TIMER, timerGeneration});
+  }
 
-    switch (mod)
+  while (events.getNextTime() <= instructionCount)
+  {
+    Event event = events.pop();
+    switch (event.type)
     {
-    case 0b1000:
-      PC = readWord(r[regA] + disp);
-      break;
-    case 0b1001:
-      if (r[regB] == r[regC])
+    case EventType::TIMER:
+      // Events from before the last configuration are stale
+      if (event.data == timerGeneration)
       {
-        PC = readWord(r[regA] + disp);
+        pendingInterrupts |= 1 << CAUSE_TIMER;
+        events.schedule({event.time + getTimerPeriod(timerConfig), EventType::TIMER, timerGeneration});
       }
       break;
-    case 0b1010:
-      if (r[regB] != r[regC])
+    case EventType::TERMINAL_POLL:
+      if (terminal)
       {
-        PC = readWord(r[regA] + disp);
+        pollTerminal();
+        events.schedule({event.time + TERMINAL_POLL_INTERVAL, EventType::TERMINAL_POLL, 0});
       }
       break;
-    case 0b1011:
-      if (r[regB] > r[regC])
+    case EventType::SAMPLE:
+      if (sampler)
       {
-        PC = readWord(r[regA] + disp);
+        sampler->sample();
+        events.schedule({event.time + sampler->getInterval(), EventType::SAMPLE, 0});
       }
       break;
-    default:
-      std::cout << "Emulator error. Invalid instruction modifier." << std::endl;
-      exit(1);
     }
   }
 
-  void executeXchg(uint32_t instruction)
+  if (replay)
   {
-    if (printInstructions)
-    {
-      printXchg(instruction);
-    }
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t regC = ((instruction & 0x0000F000) >> 12);
-    uint32_t temp = r[regB];
-    r[regB] = r[regC];
-    r[regC] = temp;
+    replayEvents();
   }
+  acceptInterrupt();
+}
 
-  void executeArithmOp(uint32_t instruction)
+// Flushes the guest output and passes on one character of input, once the guest
+// has taken the interrupt for the previous one
+void EmulatorCore::pollTerminal()
+{
+  terminal->flush();
+  uint8_t character;
+  if (!replay && !(pendingInterrupts & (1 << CAUSE_TERMINAL)) && terminal->readInput(character))
   {
-    if (printInstructions)
+    mem.writeWord(TERM_IN, character);
+    if (shadow)
     {
-      printArithmOp(instruction);
+      shadow->mem.writeWord(TERM_IN, character);
     }
-    uint16_t mod = ((instruction & 0x0F000000) >> 24);
-    uint16_t regA = ((instruction & 0x00F00000) >> 20);
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t regC = ((instruction & 0x0000F000) >> 12);
-
-    switch (mod)
+    pendingInterrupts |= 1 << CAUSE_TERMINAL;
+    if (recording)
     {
-    case 0b0000:
-      r[regA] = r[regB] + r[regC];
-      break;
-    case 0b0001:
-      r[regA] = r[regB] - r[regC];
-      break;
-    case 0b0010:
-      r[regA] = r[regB] * r[regC];
-      break;
-    case 0b0011:
-      r[regA] = r[regB] / r[regC];
-      break;
-    default:
-      std::cout << "Invalid instruction modifier." << std::endl;
-      exit(1);
-      break;
+      recording->record({instructionCount, LoggedEventType::INPUT, character});
     }
   }
+}
+
+// Enters the handler for the first pending interrupt that isn't masked, the timer goes first.
+// During a replay only the log raises interrupts.
+void EmulatorCore::acceptInterrupt()
+{
+  if (!pendingInterrupts || (STATUS & STATUS_INTERRUPT_MASK) || replay)
+  {
+    return;
+  }
+  uint32_t cause;
+  if ((pendingInterrupts & (1 << CAUSE_TIMER)) && !(STATUS & STATUS_TIMER_MASK))
+  {
+    cause = CAUSE_TIMER;
+  }
+  else if ((pendingInterrupts & (1 << CAUSE_TERMINAL)) && !(STATUS & STATUS_TERMINAL_MASK))
+  {
+    cause = CAUSE_TERMINAL;
+  }
+  else
+  {
+    return;
+  }
+  pendingInterrupts &= ~(1 << cause);
+  raiseInterrupt(cause);
+  if (shadow)
+  {
+    shadow->raiseInterrupt(cause);
+  }
+  if (recording)
+  {
+    recording->record({instructionCount, LoggedEventType::INTERRUPT, (uint8_t)cause});
+  }
+}
 
-  void executeLogOp(uint32_t instruction)
+// Delivers the logged events that are due, in the order they were recorded
+void EmulatorCore::replayEvents()
+{
+  while (replay->getNextTime() <= instructionCount)
   {
-    if (printInstructions)
+    const LoggedEvent &event = replay->takeNext();
+    if (event.type == LoggedEventType::INPUT)
     {
-      printLogOp(instruction);
+      mem.writeWord(TERM_IN, event.data);
+      if (shadow)
+      {
+        shadow->mem.writeWord(TERM_IN, event.data);
+      }
     }
-    uint16_t mod = ((instruction & 0x0F000000) >> 24);
-    uint16_t regA = ((instruction & 0x00F00000) >> 20);
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t regC = ((instruction & 0x0000F000) >> 12);
-
-    switch (mod)
+    else
     {
-    case 0b0000:
-      r[regA] = ~r[regB];
-      break;
-    case 0b0001:
-      r[regA] = r[regB] & r[regC];
-      break;
-    case 0b0010:
-      r[regA] = r[regB] | r[regC];
-      break;
-    case 0b0011:
-      r[regA] = r[regB] ^ r[regC];
-      break;
-    default:
-      std::cout << "Invalid instruction modifier." << std::endl;
-      exit(1);
-      break;
+      pendingInterrupts &= ~(1 << event.data);
+      raiseInterrupt(event.data);
+      if (shadow)
+      {
+        shadow->raiseInterrupt(event.data);
+      }
     }
   }
+}
 
-  void executeShift(uint32_t instruction)
+StopReason EmulatorCore::step()
+{
+  if (run(1) == StopReason::INSTRUCTION_LIMIT)
   {
-    if (printInstructions)
-    {
-      printShift(instruction);
-    }
-    uint16_t mod = ((instruction & 0x0F000000) >> 24);
-    uint16_t regA = ((instruction & 0x00F00000) >> 20);
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t regC = ((instruction & 0x0000F000) >> 12);
+    stopReason = StopReason::NONE;
+  }
+  return stopReason;
+}
 
-    switch (mod)
-    {
-    case 0b0000:
-      r[regA] = r[regB] << r[regC];
-      break;
-    case 0b0001:
-      r[regA] = r[regB] >> r[regC];
-      break;
-    default:
-      std::cout << "Invalid instruction modifier." << std::endl;
-      exit(1);
-      break;
-    }
+// Runs in slices that end at the next event, so the loops only compare the instruction
+// count with sliceEnd and never poll devices
+StopReason EmulatorCore::run(uint64_t maxInstructions)
+{
+  bool resumeAtBreakpoint = stopReason == StopReason::BREAKPOINT;
+  if (stopReason == StopReason::INSTRUCTION_LIMIT || resumeAtBreakpoint)
+  {
+    stop(StopReason::NONE, "");
+  }
+  if (stopReason != StopReason::NONE)
+  {
+    return stopReason;
   }
 
-  void executeStore(uint32_t instruction)
+  uint64_t limit = maxInstructions > UINT64_MAX - instructionCount ? UINT64_MAX : instructionCount + maxInstructions;
+  while (stopReason == StopReason::NONE && instructionCount < limit)
   {
-    if (printInstructions)
+    processEvents();
+    sliceEnd = std::min(limit, events.getNextTime());
+    if (replay)
     {
-      printStore(instruction);
+      sliceEnd = std::min(sliceEnd, replay->getNextTime());
     }
-    uint16_t mod = ((instruction & 0x0F000000) >> 24);
-    uint16_t regA = ((instruction & 0x00F00000) >> 20);
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t regC = ((instruction & 0x0000F000) >> 12);
-    uint16_t disp = (instruction & 0x00000FFF);
-
-    switch (mod)
+    else if (pendingInterrupts)
     {
-    // st mem[reg], mem[reg + literal]
-    case 0b0000:
-      writeWord(r[regA] + r[regB] + disp, r[regC]);
-      break;
-    // push
-    case 0b0010:
-      writeWord(readWord(r[regA] + r[regB] + disp), r[regC]);
-      break;
-    // st mem[literal], mem[symbol]
-    case 0b0001:
-      r[regA] = r[regA] - disp;
-      writeWord(r[regA], r[regC]);
-      break;
-    default:
-      std::cout << "Emulator error. Invalid instruction modifier." << std::endl;
-      exit(1);
+      // A masked interrupt is checked again after every instruction or block
+      sliceEnd = std::min(sliceEnd, instructionCount + 1);
     }
-  }
 
-  void executeLoad(uint32_t instruction)
-  {
-    if (printInstructions)
+    // Skipping would get ahead of the shadow core and hide instructions from the trace,
+    // the profile and breakpoints
+    skipIdleLoops = idleLoopSkipping && !shadow && !trace && !profiler && !cycleModel && breakpoints.empty();
+    if (shadow)
     {
-      printLoad(instruction);
+      runLockstep();
     }
-    uint16_t mod = ((instruction & 0x0F000000) >> 24);
-    uint16_t regA = ((instruction & 0x00F00000) >> 20);
-    uint16_t regB = ((instruction & 0x000F0000) >> 16);
-    uint16_t regC = ((instruction & 0x0000F000) >> 12);
-    int16_t disp = (instruction & 0x00000FFF);
-    if (disp & 0x0800)
+    else if (translated && !trace && !profiler && !cycleModel && !sampler && !replay && breakpoints.empty())
     {
-      disp |= 0xF000; // Set sign bits for negative numbers
+      runTranslated();
     }
-
-    switch (mod)
+    else if (jit && !trace && !profiler && !cycleModel && !sampler && !replay && breakpoints.empty())
     {
-    // ld literal, symbol, mem[literal], mem[symbol], mem[reg], mem[reg + literal]
-    case 0b0010:
-      r[regA] = readWord(r[regB] + r[regC] + disp);
-      break;
-    case 0b0011:
-    // pop
-      r[regA] = readWord(r[regB]);
-      r[regB] = r[regB] + disp;
-      break;
-    case 0b0111:
-    // pop csr
-      csr[regA] = readWord(r[regB]);
-      r[regB] = r[regB] + disp;
-      break;
-    case 0b0000:
-    // csrwr
-      r[regA] = csr[regB];
-      break;
-    case 0b0100:
-    // csrrd
-      csr[regA] = r[regB];
-      break;
-    case 0b0001:
-    // for iret, sp = sp + 4
-      r[regA] = r[regB] + disp;
-      break;
-    default:
-      std::cout << "Emulator error. Invalid instruction modifier." << std::endl;
-      exit(1);
+      runJit();
+    }
+    else
+    {
+      interpret(resumeAtBreakpoint);
     }
+    resumeAtBreakpoint = false;
   }
 
-  void executeInstruction(uint32_t instruction)
+  if (terminal)
   {
-    uint16_t opCode = instruction >> 28;
-    switch (opCode)
-    {
-    case 0b0000:
-      executeHalt();
-      break;
-
-    case 0b0001:
-      executeInt();
-      break;
-
-    case 0b0010:
-      executeCall(instruction);
-      break;
-
-    case 0b0011:
-      executeBranch(instruction);
-      break;
-
-    case 0b0100:
-      executeXchg(instruction);
-      break;
-
-    case 0b0101:
-      executeArithmOp(instruction);
-      break;
-
-    case 0b0110:
-      executeLogOp(instruction);
-      break;
-
-    case 0b0111:
-      executeShift(instruction);
-      break;
-
-    case 0b1000:
-      executeStore(instruction);
-      break;
-
-    case 0b1001:
-      executeLoad(instruction);
-      break;
-
-    default:
-      std::cout << "Emulator error. Invalid opcode." << std::endl;
-      exit(1);
-      break;
-    }
+    terminal->flush();
+  }
+  if (stopReason == StopReason::HALT && shadow)
+  {
+    checkLockstepMemory();
+  }
+  if (stopReason == StopReason::NONE)
+  {
+    stopReason = StopReason::INSTRUCTION_LIMIT;
   }
+  return stopReason;
+}
 
-  void emulate()
+// Copies the guest into the shadow core
+void EmulatorCore::syncShadow()
+{
+  if (!shadow)
   {
-    r[0] = 0x00000000;
-    PC = 0x40000000;
-    while (!stopEmulation)
+    return;
+  }
+  shadow->reset();
+  for (const auto &pageNumber : mem.getPageNumbers())
+  {
+    for (uint32_t offset = 0; offset < Memory::PAGE_SIZE; offset += 4)
     {
-      uint32_t currentInstruction = fetchInstruction();
-      executeInstruction(currentInstruction);
-      r[0] = 0x00000000;
+      uint32_t addr = (pageNumber << Memory::PAGE_BITS) | offset;
+      shadow->mem.writeWord(addr, mem.readWord(addr));
     }
   }
+  memcpy(shadow->r, r, sizeof(r));
+  memcpy(shadow->csr, csr, sizeof(csr));
+}
 
-  void printMemoryContent()
+bool EmulatorCore::checkLockstep(uint32_t blockPc)
+{
+  bool registersMatch = !memcmp(r, shadow->r, sizeof(r)) && !memcmp(csr, shadow->csr, sizeof(csr));
+  if (registersMatch)
   {
-    uint32_t cnt = 0;
-    for (const auto &memLoc : mem)
-    {
-      uint32_t addr = memLoc.first;
-      uint16_t byte = memLoc.second;
-
-      if (!(cnt % 8))
-      {
-        std::cout << std::endl
-                  << std::hex << addr << ": ";
-      }
-
-      std::cout << std::hex << std::setw(2) << std::setfill('0') << byte << " ";
+    return true;
+  }
+  std::ostringstream message;
+  message << "Lockstep mismatch after the block at 0x" << std::hex << blockPc << "." << std::endl;
+  message << "Interpreter:" << std::endl;
+  printState(message);
+  message << "JIT:" << std::endl;
+  shadow->printState(message);
+  std::string text = message.str();
+  text.pop_back(); // The caller ends the line
+  stop(StopReason::LOCKSTEP_MISMATCH, text);
+  return false;
+}
 
-      if (!mem.count(addr + 1))
+bool EmulatorCore::checkLockstepMemory()
+{
+  std::vector<uint32_t> pages = mem.getPageNumbers();
+  std::vector<uint32_t> shadowPages = shadow->mem.getPageNumbers();
+  pages.insert(pages.end(), shadowPages.begin(), shadowPages.end());
+  for (const auto &pageNumber : pages)
+  {
+    for (uint32_t offset = 0; offset < Memory::PAGE_SIZE; ++offset)
+    {
+      uint32_t addr = (pageNumber << Memory::PAGE_BITS) | offset;
+      if (mem.readByte(addr) != shadow->mem.readByte(addr))
       {
-        cnt = 0;
-        continue;
+        std::ostringstream message;
+        message << "Lockstep memory mismatch at 0x" << std::hex << addr << ".";
+        stop(StopReason::LOCKSTEP_MISMATCH, message.str());
+        return false;
       }
-      cnt++;
     }
-    std::cout << std::endl;
   }
+  return true;
+}
 
-  void run()
+// Runs every translated block on the shadow core, then the same instructions in the
+// interpreter, and stops at the first difference in the register files
+void EmulatorCore::runLockstep()
+{
+  uint64_t end = sliceEnd;
+  while (stopReason == StopReason::NONE && instructionCount < end)
   {
-    parseInput();
+    uint32_t blockPc = PC;
+    uint32_t executed = shadow->jit->runBlock();
+    if (!executed)
+    {
+      // Instructions the translator leaves behind run in both cores
+      shadow->interpretInstruction<NoTrace, NoProfile>(decodeInstruction(shadow->readWord(shadow->PC)));
+      executed = 1;
+    }
+    // Device writes end the slice early, the interpreter still has to finish the block
+    uint64_t blockEnd = instructionCount + executed;
+    bool endedEarly = false;
+    while (stopReason == StopReason::NONE && instructionCount < blockEnd)
+    {
+      sliceEnd = blockEnd;
+      interpretLoop<NoTrace, NoProfile, NoBreakpoints>(false);
+      endedEarly |= sliceEnd == 0;
+    }
+    if (!checkLockstep(blockPc) || endedEarly)
+    {
+      return;
+    }
+  }
+}
+
+void EmulatorCore::printState(std::ostream &out) const
+{
+  printRegisters(out, r);
+}
 
-    emulate();
+void EmulatorCore::printRegisters(std::ostream &out, const uint32_t *registers)
+{
+  for (uint16_t i = 0; i < 16; ++i)
+  {
+    std::string label = "r" + std::to_string(i) + "=0x";
+    out << std::setw(6) << std::setfill(' ') << label << std::hex << std::setw(8) << std::setfill('0') << registers[i];
+    out << ((i % 4 == 3) ? "\n" : " ");
+  }
+  out << std::flush;
+}
 
-    // printMemoryContent();
+void EmulatorCore::printMemoryContent(std::ostream &out) const
+{
+  for (const auto &pageNumber : mem.getPageNumbers())
+  {
+    const uint8_t *page = mem.getPage(pageNumber);
+    for (uint32_t offset = 0; offset < Memory::PAGE_SIZE; ++offset)
+    {
+      if (!(offset % 8))
+      {
+        out << std::endl
+            << std::hex << ((pageNumber << Memory::PAGE_BITS) | offset) << ": ";
+      }
+      out << std::hex << std::setw(2) << std::setfill('0') << static_cast<uint16_t>(page[offset]) << " ";
+    }
   }
-};
\ No newline at end of file
+  out << std::endl;
+}
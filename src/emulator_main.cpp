@@ -1,17 +1,372 @@
 #include "../inc/emulator.hpp"
+#include "../inc/batch_runner.hpp"
+#include "../inc/terminal.hpp"
+#include "../inc/profiler.hpp"
+#include "../inc/call_stack_sampler.hpp"
+#include "../inc/symbol_map.hpp"
+#include "../inc/event_log.hpp"
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <unistd.h>
+#include <thread>
+#include <chrono>
+#include <iomanip>
+
+// Writes a report to its file, or to standard output without one
+template <class Report>
+static bool writeReport(const Report &report, const std::string &reportFileName, const SymbolMap &symbols,
+                        const std::string &errorMessage)
+{
+  if (reportFileName.empty())
+  {
+    report.writeReport(std::cout, &symbols);
+    return true;
+  }
+  std::ofstream out(reportFileName);
+  if (!out.is_open())
+  {
+    std::cout << errorMessage << std::endl;
+    return false;
+  }
+  report.writeReport(out, &symbols);
+  return true;
+}
+
+// Writes the profile and the cycle report, and the sampled call stacks to the flamegraph file
+static bool writeReports(const EmulatorCore &core, const std::string &mapFileName, const std::string &reportFileName,
+                         const std::string &cycleReportFileName, const std::string &flamegraphFileName)
+{
+  SymbolMap symbols;
+  if (!mapFileName.empty() && !symbols.load(mapFileName))
+  {
+    std::cout << "Error reading symbol map." << std::endl;
+    return false;
+  }
+  if (core.getProfiler() &&
+      !writeReport(*core.getProfiler(), reportFileName, symbols, "Error opening profile report file."))
+  {
+    return false;
+  }
+  if (core.getCycleModel() &&
+      !writeReport(*core.getCycleModel(), cycleReportFileName, symbols, "Error opening cycle report file."))
+  {
+    return false;
+  }
+  if (core.getSampler())
+  {
+    std::ofstream flamegraph(flamegraphFileName);
+    if (!flamegraph.is_open())
+    {
+      std::cout << "Error opening flamegraph file." << std::endl;
+      return false;
+    }
+    core.getSampler()->writeFoldedStacks(flamegraph, &symbols);
+  }
+  return true;
+}
+
+// The snapshot point is a PC in hex with 0x, which has to fit in 32 bits, or an instruction count
+static bool isSnapshotPoint(const std::string &snapshotAt)
+{
+  bool atPc = snapshotAt.substr(0, 2) == "0x" || snapshotAt.substr(0, 2) == "0X";
+  if (snapshotAt.empty() || !isdigit((unsigned char)snapshotAt[0]))
+  {
+    return false;
+  }
+  try
+  {
+    size_t end = 0;
+    unsigned long long value = std::stoull(snapshotAt, &end, atPc ? 16 : 10);
+    return end == snapshotAt.size() && (!atPc || value <= 0xFFFFFFFF);
+  }
+  catch (const std::logic_error &)
+  {
+    return false;
+  }
+}
+
+// Runs until the snapshot point, a PC given in hex with 0x or an instruction count,
+// and writes the snapshot there. Returns false if it can't be written.
+static bool runToSnapshot(EmulatorCore &core, const std::string &snapshotAt, const std::string &snapshotFileName)
+{
+  bool atPc = snapshotAt.substr(0, 2) == "0x" || snapshotAt.substr(0, 2) == "0X";
+  StopReason reason;
+  if (atPc)
+  {
+    uint32_t pc = std::stoul(snapshotAt, nullptr, 16);
+    core.addBreakpoint(pc);
+    reason = core.run();
+    core.removeBreakpoint(pc);
+  }
+  else
+  {
+    reason = core.run(std::stoull(snapshotAt));
+  }
+  if (reason != (atPc ? StopReason::BREAKPOINT : StopReason::INSTRUCTION_LIMIT))
+  {
+    // The guest stopped first, the rest of the run reports why
+    std::cout << "Snapshot point not reached." << std::endl;
+    return true;
+  }
+  if (!core.saveSnapshot(snapshotFileName))
+  {
+    std::cout << "Error writing snapshot file." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Instructions the guest ran and the rate they ran at, in millions per second of host time
+static void writeStats(const EmulatorCore &core, double seconds)
+{
+  uint64_t count = core.getInstructionCount();
+  std::cout << std::dec << "Executed " << count << " instructions in " << std::fixed << std::setprecision(3) << seconds << " s, ";
+  std::cout << std::setprecision(1) << (seconds > 0 ? count / seconds / 1e6 : 0.0) << " MIPS" << std::endl;
+}
 
 int main(int argc, char** argv)
 {
-  if (argc != 2)
+  std::string inputFileName;
+  std::string manifestFileName;
+  uint32_t threadCount = std::thread::hardware_concurrency();
+  std::string reportFileName;
+  std::string mapFileName;
+  bool useCycleModel = false;
+  std::string cycleReportFileName;
+  std::string cycleConfigFileName;
+  std::string flamegraphFileName;
+  uint64_t sampleInterval = 10000;
+  std::string snapshotAt;
+  std::string snapshotFileName;
+  std::string restoreFileName;
+  std::string recordFileName;
+  std::string replayFileName;
+  bool useJit = false;
+  bool useLanes = false;
+  bool showStats = false;
+  EmulatorCore core;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--jit")
+    {
+      useJit = true;
+      core.setJit();
+    }
+    else if (arg == "--lockstep")
+    {
+      core.setLockstep();
+    }
+    else if (arg == "--no-idle-skip")
+    {
+      core.setIdleLoopSkipping(false);
+    }
+    else if (arg == "--stats")
+    {
+      showStats = true;
+    }
+    else if (arg == "--trace")
+    {
+      core.setTrace(std::cout);
+    }
+    else if (arg == "--profile" || arg.substr(0, 10) == "--profile=")
+    {
+      reportFileName = arg.substr(std::min<size_t>(arg.size(), 10));
+      core.setProfile();
+    }
+    else if (arg == "--cycles" || arg.substr(0, 9) == "--cycles=")
+    {
+      cycleReportFileName = arg.substr(std::min<size_t>(arg.size(), 9));
+      useCycleModel = true;
+    }
+    else if (arg.substr(0, 15) == "--cycle-config=")
+    {
+      cycleConfigFileName = arg.substr(15);
+    }
+    else if (arg.substr(0, 13) == "--flamegraph=")
+    {
+      flamegraphFileName = arg.substr(13);
+    }
+    else if (arg.substr(0, 18) == "--sample-interval=")
+    {
+      try
+      {
+        sampleInterval = std::stoull(arg.substr(18));
+      }
+      catch (const std::logic_error &)
+      {
+        sampleInterval = 0;
+      }
+      if (sampleInterval == 0)
+      {
+        std::cout << "Invalid command." << std::endl;
+        return 1;
+      }
+    }
+    else if (arg.substr(0, 14) == "--snapshot-at=")
+    {
+      snapshotAt = arg.substr(14);
+      if (!isSnapshotPoint(snapshotAt))
+      {
+        std::cout << "Invalid command." << std::endl;
+        return 1;
+      }
+    }
+    else if (arg.substr(0, 15) == "--snapshot-out=")
+    {
+      snapshotFileName = arg.substr(15);
+    }
+    else if (arg.substr(0, 10) == "--restore=")
+    {
+      restoreFileName = arg.substr(10);
+    }
+    else if (arg.substr(0, 9) == "--record=")
+    {
+      recordFileName = arg.substr(9);
+    }
+    else if (arg.substr(0, 9) == "--replay=")
+    {
+      replayFileName = arg.substr(9);
+    }
+    else if (arg.substr(0, 10) == "--symbols=")
+    {
+      mapFileName = arg.substr(10);
+    }
+    else if (arg == "--batch" && i + 1 < argc)
+    {
+      manifestFileName = argv[++i];
+    }
+    else if (arg == "--lanes")
+    {
+      useLanes = true;
+    }
+    else if (arg == "-j" && i + 1 < argc)
+    {
+      try
+      {
+        threadCount = std::stoul(argv[++i]);
+      }
+      catch (const std::logic_error &)
+      {
+        std::cout << "Invalid command." << std::endl;
+        return 1;
+      }
+    }
+    else if (inputFileName.empty())
+    {
+      inputFileName = arg;
+    }
+    else
+    {
+      std::cout << "Invalid command." << std::endl;
+      return 1;
+    }
+  }
+
+  if (!manifestFileName.empty())
+  {
+    if (!inputFileName.empty())
+    {
+      std::cout << "Invalid command." << std::endl;
+      return 1;
+    }
+    BatchRunner runner(threadCount, useJit, useLanes);
+    if (!runner.loadManifest(manifestFileName))
+    {
+      std::cout << "Error reading manifest file." << std::endl;
+      return 1;
+    }
+    runner.run();
+    return runner.printResults(std::cout) ? 1 : 0;
+  }
+
+  // A restored snapshot takes the place of the program image
+  if (inputFileName.empty() == restoreFileName.empty() || useLanes ||
+      snapshotAt.empty() != snapshotFileName.empty() || (!recordFileName.empty() && !replayFileName.empty()))
   {
     std::cout << "Invalid command." << std::endl;
     return 1;
   }
+  if (!flamegraphFileName.empty())
+  {
+    core.setSampling(sampleInterval);
+  }
+  if (useCycleModel)
+  {
+    CycleModel::Config config;
+    if (!cycleConfigFileName.empty() && !config.load(cycleConfigFileName))
+    {
+      std::cout << "Error reading cycle model configuration." << std::endl;
+      return 1;
+    }
+    core.setCycleModel(config);
+  }
+
+  EventLog log;
+  if (!replayFileName.empty())
+  {
+    if (!log.load(replayFileName))
+    {
+      std::cout << "Error reading event log." << std::endl;
+      return 1;
+    }
+    core.setReplay(&log);
+  }
+  else if (!recordFileName.empty())
+  {
+    core.setRecording(&log);
+  }
+
+  Terminal terminal(std::cout);
+  if (replayFileName.empty())
+  {
+    terminal.startInput(STDIN_FILENO);
+  }
+  core.setTerminal(&terminal);
+
+  if (restoreFileName.empty() ? !core.load(inputFileName) : !core.restoreSnapshot(restoreFileName))
+  {
+    std::cout << core.getStopMessage() << std::endl;
+    return 1;
+  }
+
+  if (!snapshotFileName.empty() && !runToSnapshot(core, snapshotAt, snapshotFileName))
+  {
+    return 1;
+  }
 
-  std::string inputFileName = argv[1];
+  auto start = std::chrono::steady_clock::now();
+  StopReason reason = core.run();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  if (!recordFileName.empty() && !log.save(recordFileName))
+  {
+    std::cout << "Error writing event log." << std::endl;
+    return 1;
+  }
+
+  if (reason != StopReason::HALT)
+  {
+    std::cout << "Emulator error. " << core.getStopMessage() << std::endl;
+    writeReports(core, mapFileName, reportFileName, cycleReportFileName, flamegraphFileName);
+    return 1;
+  }
+
+  std::cout << "Emulated processor executed halt instruction" << std::endl;
+  std::cout << "Emulated processor state:" << std::endl;
+  core.printState(std::cout);
+  if (showStats)
+  {
+    writeStats(core, elapsed.count());
+  }
+
+  if (!writeReports(core, mapFileName, reportFileName, cycleReportFileName, flamegraphFileName))
+  {
+    return 1;
+  }
 
-  emulator::setInputFile(inputFileName);  
-  emulator::run();
+  // core.printMemoryContent(std::cout);
 
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,118 @@
+#include "../inc/event_log.hpp"
+#include <fstream>
+#include <iterator>
+
+EventLog::EventLog() : next(0)
+{
+}
+
+void EventLog::clear()
+{
+  events.clear();
+  next = 0;
+}
+
+void EventLog::rewind()
+{
+  next = 0;
+}
+
+const std::vector<LoggedEvent> &EventLog::getEvents() const
+{
+  return events;
+}
+
+static void appendWord(std::vector<char> &data, uint32_t word)
+{
+  for (uint32_t i = 0; i < 4; ++i)
+  {
+    data.push_back((word >> (i * 8)) & 0xFF);
+  }
+}
+
+static uint32_t readWord(const std::vector<char> &data, size_t offset)
+{
+  uint32_t word = 0;
+  for (uint32_t i = 0; i < 4; ++i)
+  {
+    word |= (uint32_t)(uint8_t)data[offset + i] << (i * 8);
+  }
+  return word;
+}
+
+bool EventLog::save(const std::string &logFileName) const
+{
+  std::vector<char> data;
+  appendWord(data, MAGIC);
+  appendWord(data, VERSION);
+  uint64_t previous = 0;
+  for (const auto &event : events)
+  {
+    data.push_back((char)event.type);
+    uint64_t delta = event.time - previous;
+    previous = event.time;
+    do
+    {
+      data.push_back((delta & 0x7F) | (delta > 0x7F ? 0x80 : 0));
+      delta >>= 7;
+    } while (delta);
+    data.push_back(event.data);
+  }
+
+  std::ofstream log(logFileName, std::ios::out | std::ios::binary);
+  if (!log.is_open())
+  {
+    return false;
+  }
+  log.write(data.data(), data.size());
+  return log.good();
+}
+
+bool EventLog::load(const std::string &logFileName)
+{
+  std::ifstream log(logFileName, std::ios::in | std::ios::binary);
+  if (!log.is_open())
+  {
+    return false;
+  }
+  std::vector<char> data((std::istreambuf_iterator<char>(log)), std::istreambuf_iterator<char>());
+  if (data.size() < 8 || readWord(data, 0) != MAGIC || readWord(data, 4) != VERSION)
+  {
+    return false;
+  }
+
+  clear();
+  uint64_t time = 0;
+  size_t offset = 8;
+  while (offset < data.size())
+  {
+    LoggedEventType type = (LoggedEventType)data[offset++];
+    if (type != LoggedEventType::INTERRUPT && type != LoggedEventType::INPUT)
+    {
+      clear();
+      return false;
+    }
+    uint64_t delta = 0;
+    uint32_t shift = 0;
+    uint8_t byte;
+    do
+    {
+      if (offset >= data.size() || shift > 63)
+      {
+        clear();
+        return false;
+      }
+      byte = data[offset++];
+      delta |= (uint64_t)(byte & 0x7F) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    if (offset >= data.size())
+    {
+      clear();
+      return false;
+    }
+    time += delta;
+    events.push_back({time, type, (uint8_t)data[offset++]});
+  }
+  return true;
+}
@@ -0,0 +1,26 @@
+#include "../inc/event_queue.hpp"
+#include <algorithm>
+
+static bool isLater(const Event &left, const Event &right)
+{
+  return left.time > right.time;
+}
+
+void EventQueue::schedule(const Event &event)
+{
+  events.push_back(event);
+  std::push_heap(events.begin(), events.end(), isLater);
+}
+
+Event EventQueue::pop()
+{
+  std::pop_heap(events.begin(), events.end(), isLater);
+  Event event = events.back();
+  events.pop_back();
+  return event;
+}
+
+void EventQueue::clear()
+{
+  events.clear();
+}
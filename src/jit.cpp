@@ -0,0 +1,863 @@
+#include "../inc/jit.hpp"
+#include "../inc/emulator.hpp"
+#include <cstdlib>
+#include <new>
+#include <cstring>
+#include <initializer_list>
+#include <sys/mman.h>
+
+namespace
+{
+  enum HostRegister
+  {
+    EAX = 0,
+    ECX = 1,
+    EDX = 2,
+    EBX = 3,
+    ESI = 6,
+    EDI = 7
+  };
+
+  // Condition codes for jcc
+  enum Condition
+  {
+    ALWAYS = -1,
+    JAE = 0x83,
+    JE = 0x84,
+    JNE = 0x85,
+    JBE = 0x86,
+    JA = 0x87,
+    JLE = 0x8E
+  };
+
+  // x86-64 encoder for the few instruction forms the translator needs.
+  // rbx always holds the address of the guest register file.
+  struct CodeEmitter
+  {
+    std::vector<uint8_t> code;
+
+    void emitByte(uint8_t byte)
+    {
+      code.push_back(byte);
+    }
+
+    void emitBytes(std::initializer_list<uint8_t> bytes)
+    {
+      code.insert(code.end(), bytes);
+    }
+
+    void emitDword(uint32_t value)
+    {
+      for (int i = 0; i < 4; ++i)
+      {
+        emitByte((value >> (8 * i)) & 0xFF);
+      }
+    }
+
+    void emitQword(uint64_t value)
+    {
+      for (int i = 0; i < 8; ++i)
+      {
+        emitByte((value >> (8 * i)) & 0xFF);
+      }
+    }
+
+    // mov reg, [rbx + 4 * index]
+    void loadGuest(HostRegister reg, uint8_t index)
+    {
+      emitBytes({0x8B, (uint8_t)(0x43 | (reg << 3)), (uint8_t)(index * 4)});
+    }
+
+    // mov [rbx + 4 * index], reg
+    void storeGuest(uint8_t index, HostRegister reg)
+    {
+      emitBytes({0x89, (uint8_t)(0x43 | (reg << 3)), (uint8_t)(index * 4)});
+    }
+
+    // mov dword [rbx + 4 * index], value
+    void storeGuestImmediate(uint8_t index, uint32_t value)
+    {
+      emitBytes({0xC7, 0x43, (uint8_t)(index * 4)});
+      emitDword(value);
+    }
+
+    // mov reg, value
+    void moveImmediate(HostRegister reg, uint32_t value)
+    {
+      emitByte(0xB8 + reg);
+      emitDword(value);
+    }
+
+    // movabs reg, value
+    void moveImmediate64(HostRegister reg, uint64_t value)
+    {
+      emitBytes({0x48, (uint8_t)(0xB8 + reg)});
+      emitQword(value);
+    }
+
+    // <op> dst, src for the two operand ALU forms (op r/m32, r32)
+    void aluRegister(uint8_t op, HostRegister dst, HostRegister src)
+    {
+      emitBytes({op, (uint8_t)(0xC0 | (src << 3) | dst)});
+    }
+
+    void moveRegister(HostRegister dst, HostRegister src)
+    {
+      aluRegister(0x89, dst, src);
+    }
+
+    // add reg, value
+    void addImmediate(HostRegister reg, int32_t value)
+    {
+      if (value == 0)
+      {
+        return;
+      }
+      emitBytes({0x81, (uint8_t)(0xC0 | reg)});
+      emitDword(value);
+    }
+
+    // Emits a jump with a 32 bit displacement, returns the position to patch with bind()
+    size_t jump(Condition condition)
+    {
+      if (condition == ALWAYS)
+      {
+        emitByte(0xE9);
+      }
+      else
+      {
+        emitBytes({0x0F, (uint8_t)condition});
+      }
+      size_t patch = code.size();
+      emitDword(0);
+      return patch;
+    }
+
+    // Makes the jump at patch land on the current position
+    void bind(size_t patch)
+    {
+      uint32_t displacement = code.size() - (patch + 4);
+      memcpy(&code[patch], &displacement, 4);
+    }
+
+    // movabs rax, function; call rax
+    void callFunction(void *function)
+    {
+      moveImmediate64(EAX, (uint64_t)function);
+      emitBytes({0xFF, 0xD0});
+    }
+  };
+}
+
+Jit::Jit(Memory &mem, uint32_t *r, uint32_t *csr, WriteHandler writeWord, void *writeContext)
+    : mem(mem), r(r), csr(csr), writeWord(writeWord), writeContext(writeContext), codeSize(0), flushCount(0), exitRequested(false), returnStackTop(0)
+{
+  void *buffer = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffer == MAP_FAILED)
+  {
+    throw std::bad_alloc();
+  }
+  codeBuffer = static_cast<uint8_t *>(buffer);
+  memset(returnStack, 0, sizeof(returnStack));
+  blockTable = static_cast<BlockFunction **>(calloc(Memory::PAGE_COUNT, sizeof(BlockFunction *)));
+  coveredWords = static_cast<uint64_t **>(calloc(Memory::PAGE_COUNT, sizeof(uint64_t *)));
+  if (!blockTable || !coveredWords)
+  {
+    throw std::bad_alloc();
+  }
+}
+
+Jit::~Jit()
+{
+  flush();
+  free(blockTable);
+  free(coveredWords);
+  munmap(codeBuffer, CODE_BUFFER_SIZE);
+}
+
+void Jit::flush()
+{
+  // The code buffer itself is left intact, a block that caused the flush is still allowed to return
+  for (const auto &pageNumber : allocatedPages)
+  {
+    free(blockTable[pageNumber]);
+    blockTable[pageNumber] = nullptr;
+    free(coveredWords[pageNumber]);
+    coveredWords[pageNumber] = nullptr;
+  }
+  allocatedPages.clear();
+  pendingLinks.clear();
+  returnStackTop = 0;
+  memset(returnStack, 0, sizeof(returnStack));
+  codeSize = 0;
+  ++flushCount;
+}
+
+Jit::BlockFunction *Jit::getBlockEntry(uint32_t pc)
+{
+  if (pc & 0x3)
+  {
+    return nullptr;
+  }
+  uint32_t pageNumber = pc >> Memory::PAGE_BITS;
+  if (!blockTable[pageNumber])
+  {
+    blockTable[pageNumber] = static_cast<BlockFunction *>(calloc(Memory::PAGE_SIZE / 4, sizeof(BlockFunction)));
+    coveredWords[pageNumber] = static_cast<uint64_t *>(calloc(Memory::PAGE_SIZE / 4 / 64, sizeof(uint64_t)));
+    if (!blockTable[pageNumber] || !coveredWords[pageNumber])
+    {
+      throw std::bad_alloc();
+    }
+    allocatedPages.push_back(pageNumber);
+  }
+  return &blockTable[pageNumber][(pc & Memory::PAGE_MASK) >> 2];
+}
+
+void Jit::markCovered(uint32_t addr)
+{
+  getBlockEntry(addr);
+  uint32_t word = (addr & Memory::PAGE_MASK) >> 2;
+  coveredWords[addr >> Memory::PAGE_BITS][word >> 6] |= 1ull << (word & 0x3F);
+}
+
+uint32_t Jit::readWordHelper(Jit *jit, uint32_t addr)
+{
+  return jit->mem.readWord(addr);
+}
+
+// Returns 1 if the write dropped the translated code or requested an exit, the running block must then exit
+uint32_t Jit::writeWordHelper(Jit *jit, uint32_t addr, uint32_t word)
+{
+  uint32_t flushCount = jit->flushCount;
+  jit->writeWord(jit->writeContext, addr, word);
+  return jit->flushCount != flushCount || jit->exitRequested;
+}
+
+// Blocks for instructions that must be interpreted, they leave the budget untouched
+static int64_t interpretBlock(int64_t budget)
+{
+  return budget;
+}
+
+bool Jit::isTranslatable(const DecodedInstruction &instruction)
+{
+  switch (instruction.operation)
+  {
+  case isa::Operation::CALL:
+  case isa::Operation::JMP:
+  case isa::Operation::BEQ:
+  case isa::Operation::BNE:
+  case isa::Operation::BGT:
+  case isa::Operation::XCHG:
+  case isa::Operation::ADD:
+  case isa::Operation::SUB:
+  case isa::Operation::MUL:
+  case isa::Operation::DIV:
+  case isa::Operation::NOT:
+  case isa::Operation::AND:
+  case isa::Operation::OR:
+  case isa::Operation::XOR:
+  case isa::Operation::SHL:
+  case isa::Operation::SHR:
+  case isa::Operation::STORE:
+  case isa::Operation::PUSH:
+  case isa::Operation::STORE_INDIRECT:
+  case isa::Operation::ADD_DISP:
+  case isa::Operation::LOAD:
+  case isa::Operation::POP:
+    return true;
+  case isa::Operation::CSR_READ:
+    return instruction.regB < 3;
+  case isa::Operation::CSR_WRITE:
+  case isa::Operation::POP_CSR:
+    return instruction.regA < 3;
+  default:
+    return false;
+  }
+}
+
+// Returns true and the branch target if the literal pool word the instruction jumps through can
+// be treated as a constant. The word is marked as translated, so overwriting it drops the block.
+bool Jit::getConstantTarget(uint8_t regA, uint8_t regB, int32_t disp, uint32_t nextPc, uint32_t &target)
+{
+  if (regA != 15 || regB != 0)
+  {
+    return false;
+  }
+  uint32_t addr = nextPc + disp;
+  if (addr & 0x3)
+  {
+    return false;
+  }
+  markCovered(addr);
+  target = mem.readWord(addr);
+  return true;
+}
+
+Jit::BlockFunction Jit::compileBlock(uint32_t startPc)
+{
+  CodeEmitter emitter;
+  uint8_t *const *pageTable = mem.getPageTable();
+  uint8_t *const *writeTable = mem.getWriteTable();
+  // Jumps to other blocks, patched once the block is placed in the code buffer
+  std::vector<std::pair<size_t, uint32_t>> links;
+
+  // Reads a guest register, pc reads as the address of the next instruction
+  auto readRegister = [&](HostRegister reg, uint8_t index, uint32_t nextPc)
+  {
+    if (index == 15)
+    {
+      emitter.moveImmediate(reg, nextPc);
+    }
+    else
+    {
+      emitter.loadGuest(reg, index);
+    }
+  };
+
+  // eax = r[indexA] + r[indexB] + disp
+  auto computeAddress = [&](uint8_t indexA, uint8_t indexB, int32_t disp, uint32_t nextPc)
+  {
+    readRegister(EAX, indexA, nextPc);
+    if (indexB != 0)
+    {
+      readRegister(ECX, indexB, nextPc);
+      emitter.aluRegister(0x01, EAX, ECX);
+    }
+    emitter.addImmediate(EAX, disp);
+  };
+
+  // eax = mem[eax], the fast path handles words within an allocated page
+  auto readMemory = [&]()
+  {
+    emitter.moveRegister(EDX, EAX);
+    emitter.emitBytes({0xC1, 0xEA, Memory::PAGE_BITS}); // shr edx, 12
+    emitter.moveImmediate64(ECX, (uint64_t)pageTable);
+    emitter.emitBytes({0x48, 0x8B, 0x0C, 0xD1}); // mov rcx, [rcx + rdx * 8]
+    emitter.emitBytes({0x48, 0x85, 0xC9});       // test rcx, rcx
+    size_t noPage = emitter.jump(JE);
+    emitter.moveRegister(EDX, EAX);
+    emitter.emitBytes({0x81, 0xE2});
+    emitter.emitDword(Memory::PAGE_MASK); // and edx, PAGE_MASK
+    emitter.emitBytes({0x81, 0xFA});
+    emitter.emitDword(Memory::PAGE_SIZE - 4); // cmp edx, PAGE_SIZE - 4
+    size_t crossing = emitter.jump(JA);
+    emitter.emitBytes({0x8B, 0x04, 0x11}); // mov eax, [rcx + rdx]
+    size_t done = emitter.jump(ALWAYS);
+    emitter.bind(noPage);
+    emitter.bind(crossing);
+    emitter.moveRegister(ESI, EAX);
+    emitter.moveImmediate64(EDI, (uint64_t)this);
+    emitter.callFunction((void *)readWordHelper);
+    emitter.bind(done);
+  };
+
+  // mem[eax] = edi, afterwards eax is nonzero if the block must exit.
+  // Words that belong to translated blocks, device registers and pages that are still
+  // shared with a base image always take the slow path.
+  auto writeMemory = [&]()
+  {
+    emitter.emitByte(0x3D);
+    emitter.emitDword(EmulatorCore::MMIO_START); // cmp eax, MMIO_START
+    size_t device = emitter.jump(JAE);
+    emitter.moveRegister(EDX, EAX);
+    emitter.emitBytes({0xC1, 0xEA, Memory::PAGE_BITS}); // shr edx, 12
+    emitter.moveImmediate64(ECX, (uint64_t)coveredWords);
+    emitter.emitBytes({0x48, 0x83, 0x3C, 0xD1, 0x00}); // cmp qword [rcx + rdx * 8], 0
+    size_t codePage = emitter.jump(JNE);
+    emitter.moveImmediate64(ECX, (uint64_t)writeTable);
+    emitter.emitBytes({0x48, 0x8B, 0x0C, 0xD1}); // mov rcx, [rcx + rdx * 8]
+    emitter.emitBytes({0x48, 0x85, 0xC9});       // test rcx, rcx
+    size_t noPage = emitter.jump(JE);
+    emitter.moveRegister(EDX, EAX);
+    emitter.emitBytes({0x81, 0xE2});
+    emitter.emitDword(Memory::PAGE_MASK); // and edx, PAGE_MASK
+    emitter.emitBytes({0x81, 0xFA});
+    emitter.emitDword(Memory::PAGE_SIZE - 4); // cmp edx, PAGE_SIZE - 4
+    size_t crossing = emitter.jump(JA);
+    emitter.emitBytes({0x89, 0x3C, 0x11}); // mov [rcx + rdx], edi
+    emitter.aluRegister(0x31, EAX, EAX);  // xor eax, eax
+    size_t done = emitter.jump(ALWAYS);
+    emitter.bind(device);
+    emitter.bind(codePage);
+    emitter.bind(noPage);
+    emitter.bind(crossing);
+    emitter.moveRegister(EDX, EDI);
+    emitter.moveImmediate64(EDI, (uint64_t)this);
+    emitter.moveRegister(ESI, EAX);
+    emitter.callFunction((void *)writeWordHelper);
+    emitter.bind(done);
+  };
+
+  // Charges the executed instructions to the budget in r12
+  auto chargeBudget = [&](uint32_t executed)
+  {
+    emitter.emitBytes({0x49, 0x81, 0xEC}); // sub r12, executed
+    emitter.emitDword(executed);
+  };
+
+  // Returns the remaining budget to the dispatcher, r[15] must already hold the next pc
+  auto returnToDispatcher = [&]()
+  {
+    emitter.emitBytes({0x4C, 0x89, 0xE0});       // mov rax, r12
+    emitter.emitBytes({0x48, 0x83, 0xC4, 0x08}); // add rsp, 8
+    emitter.emitBytes({0x41, 0x5C});             // pop r12
+    emitter.emitByte(0x5B);                      // pop rbx
+    emitter.emitByte(0xC3);                      // ret
+  };
+
+  auto exitBlock = [&](uint32_t executed)
+  {
+    chargeBudget(executed);
+    returnToDispatcher();
+  };
+
+  // Continues straight into the block at target while the budget lasts. Until that block is
+  // translated the jump lands on the return to the dispatcher and is patched later.
+  auto chainBlock = [&](uint32_t executed, uint32_t target)
+  {
+    emitter.storeGuestImmediate(15, target);
+    chargeBudget(executed);
+    size_t exhausted = emitter.jump(JLE);
+    size_t link = emitter.jump(ALWAYS);
+    links.push_back({link, target});
+    emitter.bind(link);
+    emitter.bind(exhausted);
+    returnToDispatcher();
+  };
+
+  // Leaves the block after a write if that write dropped the translated code
+  auto exitIfFlushed = [&](uint32_t executed, uint32_t nextPc)
+  {
+    emitter.emitBytes({0x85, 0xC0}); // test eax, eax
+    size_t notFlushed = emitter.jump(JE);
+    emitter.storeGuestImmediate(15, nextPc);
+    exitBlock(executed);
+    emitter.bind(notFlushed);
+  };
+
+  // Pushes the return address of a call onto the shadow return stack, with the block table
+  // entry of the return address, so the matching ret can continue without the dispatcher
+  auto pushReturnAddress = [&](uint32_t returnPc)
+  {
+    emitter.moveImmediate64(ECX, (uint64_t)&returnStackTop);
+    emitter.emitBytes({0x8B, 0x11});             // mov edx, [rcx]
+    emitter.addImmediate(EDX, 1);
+    emitter.emitBytes({0x83, 0xE2, RETURN_STACK_SIZE - 1}); // and edx, RETURN_STACK_SIZE - 1
+    emitter.emitBytes({0x89, 0x11});             // mov [rcx], edx
+    emitter.emitBytes({0xC1, 0xE2, 0x04});       // shl edx, 4
+    emitter.moveImmediate64(ECX, (uint64_t)returnStack);
+    emitter.emitBytes({0xC7, 0x04, 0x11});       // mov dword [rcx + rdx], returnPc
+    emitter.emitDword(returnPc);
+    emitter.moveImmediate64(EAX, (uint64_t)getBlockEntry(returnPc));
+    emitter.emitBytes({0x48, 0x89, 0x44, 0x11, 0x08}); // mov [rcx + rdx + 8], rax
+  };
+
+  // Continues at the pc in eax if it matches the top of the shadow return stack. A ret whose
+  // stack slot was overwritten simply misses and goes through the dispatcher.
+  auto returnThroughStack = [&](uint32_t executed)
+  {
+    emitter.moveImmediate64(ECX, (uint64_t)&returnStackTop);
+    emitter.emitBytes({0x8B, 0x11});             // mov edx, [rcx]
+    emitter.emitBytes({0x8D, 0x72, 0xFF});       // lea esi, [rdx - 1]
+    emitter.emitBytes({0x83, 0xE6, RETURN_STACK_SIZE - 1}); // and esi, RETURN_STACK_SIZE - 1
+    emitter.emitBytes({0x89, 0x31});             // mov [rcx], esi
+    emitter.emitBytes({0xC1, 0xE2, 0x04});       // shl edx, 4
+    emitter.moveImmediate64(ECX, (uint64_t)returnStack);
+    emitter.emitBytes({0x3B, 0x04, 0x11});       // cmp eax, [rcx + rdx]
+    size_t mismatch = emitter.jump(JNE);
+    emitter.emitBytes({0x48, 0x8B, 0x4C, 0x11, 0x08}); // mov rcx, [rcx + rdx + 8]
+    emitter.emitBytes({0x48, 0x8B, 0x09});       // mov rcx, [rcx]
+    emitter.emitBytes({0x48, 0x85, 0xC9});       // test rcx, rcx
+    size_t notTranslated = emitter.jump(JE);
+    emitter.moveImmediate64(EDX, (uint64_t)interpretBlock);
+    emitter.emitBytes({0x48, 0x39, 0xD1});       // cmp rcx, rdx
+    size_t interpreted = emitter.jump(JE);
+    chargeBudget(executed);
+    size_t exhausted = emitter.jump(JLE);
+    emitter.emitBytes({0x48, 0x83, 0xC1, BODY_OFFSET}); // add rcx, BODY_OFFSET
+    emitter.emitBytes({0xFF, 0xE1});             // jmp rcx
+    emitter.bind(mismatch);
+    emitter.bind(notTranslated);
+    emitter.bind(interpreted);
+    chargeBudget(executed);
+    emitter.bind(exhausted);
+    returnToDispatcher();
+  };
+
+  // Prologue, translated blocks that chain into this one skip it and continue at BODY_OFFSET
+  emitter.emitByte(0x53);                      // push rbx
+  emitter.emitBytes({0x41, 0x54});             // push r12
+  emitter.emitBytes({0x48, 0x83, 0xEC, 0x08}); // sub rsp, 8
+  emitter.moveImmediate64(EBX, (uint64_t)r);
+  emitter.emitBytes({0x49, 0x89, 0xFC}); // mov r12, rdi
+
+  uint32_t pc = startPc;
+  uint32_t executed = 0;
+  bool blockEnded = false;
+  while (!blockEnded && executed < MAX_BLOCK_INSTRUCTIONS)
+  {
+    DecodedInstruction instruction = EmulatorCore::decodeInstruction(mem.readWord(pc));
+    if (!isTranslatable(instruction))
+    {
+      break;
+    }
+    markCovered(pc);
+    uint32_t nextPc = pc + 4;
+    uint8_t regA = instruction.regA;
+    uint8_t regB = instruction.regB;
+    uint8_t regC = instruction.regC;
+    int32_t disp = instruction.disp;
+    bool writesPc = false;
+    bool writesR0 = false;
+    uint32_t target;
+    ++executed;
+
+    switch (instruction.operation)
+    {
+    case isa::Operation::CALL:
+    {
+      bool constantTarget = getConstantTarget(regA, regB, disp, nextPc, target);
+      readRegister(EAX, 14, nextPc);
+      emitter.addImmediate(EAX, -4);
+      emitter.storeGuest(14, EAX);
+      emitter.moveImmediate(EDI, nextPc);
+      writeMemory();
+      if (constantTarget)
+      {
+        exitIfFlushed(executed, target);
+        pushReturnAddress(nextPc);
+        chainBlock(executed, target);
+      }
+      else
+      {
+        computeAddress(regA, regB, disp, nextPc);
+        readMemory();
+        emitter.storeGuest(15, EAX);
+        exitBlock(executed);
+      }
+      blockEnded = true;
+      break;
+    }
+    case isa::Operation::JMP:
+    case isa::Operation::BEQ:
+    case isa::Operation::BNE:
+    case isa::Operation::BGT:
+    {
+      size_t notTaken = 0;
+      if (instruction.operation != isa::Operation::JMP)
+      {
+        readRegister(EAX, regB, nextPc);
+        readRegister(ECX, regC, nextPc);
+        emitter.aluRegister(0x39, EAX, ECX); // cmp eax, ecx
+        if (instruction.operation == isa::Operation::BEQ)
+        {
+          notTaken = emitter.jump(JNE);
+        }
+        else if (instruction.operation == isa::Operation::BNE)
+        {
+          notTaken = emitter.jump(JE);
+        }
+        else
+        {
+          notTaken = emitter.jump(JBE);
+        }
+      }
+      if (getConstantTarget(regA, 0, disp, nextPc, target))
+      {
+        chainBlock(executed, target);
+      }
+      else
+      {
+        computeAddress(regA, 0, disp, nextPc);
+        readMemory();
+        emitter.storeGuest(15, EAX);
+        exitBlock(executed);
+      }
+      if (instruction.operation != isa::Operation::JMP)
+      {
+        emitter.bind(notTaken);
+        chainBlock(executed, nextPc);
+      }
+      blockEnded = true;
+      break;
+    }
+    case isa::Operation::XCHG:
+      readRegister(EAX, regB, nextPc);
+      readRegister(ECX, regC, nextPc);
+      emitter.storeGuest(regB, ECX);
+      emitter.storeGuest(regC, EAX);
+      writesPc = regB == 15 || regC == 15;
+      writesR0 = regB == 0 || regC == 0;
+      break;
+    // arithmetic, logic and shift operations
+    case isa::Operation::ADD:
+    case isa::Operation::SUB:
+    case isa::Operation::MUL:
+    case isa::Operation::DIV:
+    case isa::Operation::NOT:
+    case isa::Operation::AND:
+    case isa::Operation::OR:
+    case isa::Operation::XOR:
+    case isa::Operation::SHL:
+    case isa::Operation::SHR:
+      readRegister(EAX, regB, nextPc);
+      readRegister(ECX, regC, nextPc);
+      switch (instruction.operation)
+      {
+      case isa::Operation::ADD:
+        emitter.aluRegister(0x01, EAX, ECX); // add
+        break;
+      case isa::Operation::SUB:
+        emitter.aluRegister(0x29, EAX, ECX); // sub
+        break;
+      case isa::Operation::MUL:
+        emitter.emitBytes({0x0F, 0xAF, 0xC1}); // imul eax, ecx
+        break;
+      case isa::Operation::DIV:
+        emitter.aluRegister(0x31, EDX, EDX); // xor edx, edx
+        emitter.emitBytes({0xF7, 0xF1});      // div ecx
+        break;
+      case isa::Operation::NOT:
+        emitter.emitBytes({0xF7, 0xD0}); // not eax
+        break;
+      case isa::Operation::AND:
+        emitter.aluRegister(0x21, EAX, ECX); // and
+        break;
+      case isa::Operation::OR:
+        emitter.aluRegister(0x09, EAX, ECX); // or
+        break;
+      case isa::Operation::XOR:
+        emitter.aluRegister(0x31, EAX, ECX); // xor
+        break;
+      case isa::Operation::SHL:
+        emitter.emitBytes({0xD3, 0xE0}); // shl eax, cl
+        break;
+      default:
+        emitter.emitBytes({0xD3, 0xE8}); // shr eax, cl
+        break;
+      }
+      emitter.storeGuest(regA, EAX);
+      writesPc = regA == 15;
+      writesR0 = regA == 0;
+      break;
+    // st mem[reg], mem[reg + literal]
+    case isa::Operation::STORE:
+      computeAddress(regA, regB, disp, nextPc);
+      readRegister(EDI, regC, nextPc);
+      writeMemory();
+      exitIfFlushed(executed, nextPc);
+      break;
+    // st mem[literal], mem[symbol]
+    case isa::Operation::STORE_INDIRECT:
+      computeAddress(regA, regB, disp, nextPc);
+      readMemory();
+      readRegister(EDI, regC, nextPc);
+      writeMemory();
+      exitIfFlushed(executed, nextPc);
+      break;
+    case isa::Operation::PUSH:
+      readRegister(EAX, regA, nextPc);
+      emitter.addImmediate(EAX, -disp);
+      emitter.storeGuest(regA, EAX);
+      if (regA == 15)
+      {
+        writesPc = true;
+      }
+      if (regC == regA)
+      {
+        emitter.moveRegister(EDI, EAX);
+      }
+      else
+      {
+        readRegister(EDI, regC, nextPc);
+      }
+      writeMemory();
+      if (!writesPc)
+      {
+        exitIfFlushed(executed, nextPc);
+      }
+      writesR0 = regA == 0;
+      break;
+    // ld literal, symbol, mem[literal], mem[symbol], mem[reg], mem[reg + literal]
+    case isa::Operation::LOAD:
+      computeAddress(regB, regC, disp, nextPc);
+      readMemory();
+      emitter.storeGuest(regA, EAX);
+      writesPc = regA == 15;
+      writesR0 = regA == 0;
+      break;
+    case isa::Operation::POP:
+    case isa::Operation::POP_CSR:
+      readRegister(EAX, regB, nextPc);
+      readMemory();
+      if (instruction.operation == isa::Operation::POP)
+      {
+        emitter.storeGuest(regA, EAX);
+        writesPc = regA == 15;
+        writesR0 = regA == 0;
+      }
+      else
+      {
+        emitter.moveImmediate64(ECX, (uint64_t)&csr[regA]);
+        emitter.emitBytes({0x89, 0x01}); // mov [rcx], eax
+      }
+      // ret, the new pc stays in eax for the shadow return stack
+      if (instruction.operation == isa::Operation::POP && regA == 15 && regB == 14)
+      {
+        emitter.loadGuest(ECX, 14);
+        emitter.addImmediate(ECX, disp);
+        emitter.storeGuest(14, ECX);
+        returnThroughStack(executed);
+        blockEnded = true;
+        break;
+      }
+      if (regB == 15 && !(instruction.operation == isa::Operation::POP && regA == 15))
+      {
+        emitter.moveImmediate(EAX, nextPc);
+      }
+      else
+      {
+        emitter.loadGuest(EAX, regB);
+      }
+      emitter.addImmediate(EAX, disp);
+      emitter.storeGuest(regB, EAX);
+      writesPc = writesPc || regB == 15;
+      writesR0 = writesR0 || regB == 0;
+      break;
+    case isa::Operation::CSR_READ:
+      emitter.moveImmediate64(ECX, (uint64_t)&csr[regB]);
+      emitter.emitBytes({0x8B, 0x01}); // mov eax, [rcx]
+      emitter.storeGuest(regA, EAX);
+      writesPc = regA == 15;
+      writesR0 = regA == 0;
+      break;
+    case isa::Operation::CSR_WRITE:
+      readRegister(EAX, regB, nextPc);
+      emitter.moveImmediate64(ECX, (uint64_t)&csr[regA]);
+      emitter.emitBytes({0x89, 0x01}); // mov [rcx], eax
+      break;
+    // r[regA] = r[regB] + disp
+    case isa::Operation::ADD_DISP:
+      readRegister(EAX, regB, nextPc);
+      emitter.addImmediate(EAX, disp);
+      emitter.storeGuest(regA, EAX);
+      writesPc = regA == 15;
+      writesR0 = regA == 0;
+      break;
+    default:
+      break;
+    }
+
+    if (writesR0)
+    {
+      emitter.storeGuestImmediate(0, 0);
+    }
+    if (writesPc && !blockEnded)
+    {
+      exitBlock(executed);
+      blockEnded = true;
+    }
+    pc = nextPc;
+  }
+
+  if (executed == 0)
+  {
+    return interpretBlock;
+  }
+  if (!blockEnded)
+  {
+    chainBlock(executed, pc);
+  }
+
+  if (codeSize + emitter.code.size() > CODE_BUFFER_SIZE)
+  {
+    // Coverage of the block being compiled is dropped as well, so translate it again
+    flush();
+    return compileBlock(startPc);
+  }
+  uint8_t *block = codeBuffer + codeSize;
+  memcpy(block, emitter.code.data(), emitter.code.size());
+  codeSize += emitter.code.size();
+
+  for (const auto &link : links)
+  {
+    BlockFunction *entry = getBlockEntry(link.second);
+    if (entry && *entry && *entry != interpretBlock)
+    {
+      patchLink(block + link.first, reinterpret_cast<uint8_t *>(*entry));
+    }
+    else if (entry && !*entry)
+    {
+      pendingLinks[link.second].push_back(block + link.first);
+    }
+  }
+  return reinterpret_cast<BlockFunction>(block);
+}
+
+void Jit::patchLink(uint8_t *link, uint8_t *block)
+{
+  uint32_t displacement = (block + BODY_OFFSET) - (link + 4);
+  memcpy(link, &displacement, 4);
+}
+
+Jit::BlockFunction Jit::getBlock(uint32_t pc)
+{
+  BlockFunction *entry = getBlockEntry(pc);
+  if (!entry)
+  {
+    return interpretBlock;
+  }
+  if (*entry)
+  {
+    return *entry;
+  }
+  BlockFunction block = compileBlock(pc);
+  // Compiling may have flushed the block table
+  *getBlockEntry(pc) = block;
+  auto pending = pendingLinks.find(pc);
+  if (pending != pendingLinks.end())
+  {
+    if (block != interpretBlock)
+    {
+      for (const auto &link : pending->second)
+      {
+        patchLink(link, reinterpret_cast<uint8_t *>(block));
+      }
+    }
+    pendingLinks.erase(pending);
+  }
+  return block;
+}
+
+uint32_t Jit::runBlock()
+{
+  // A budget of one stops at the first chained jump
+  uint32_t executed = 1 - getBlock(r[15])(1);
+  exitRequested = false;
+  return executed;
+}
+
+void Jit::requestExit()
+{
+  exitRequested = true;
+}
+
+uint64_t Jit::run(uint64_t maxInstructions)
+{
+  int64_t budget = maxInstructions > INT64_MAX ? INT64_MAX : maxInstructions;
+  int64_t remaining = budget;
+  exitRequested = false;
+  while (remaining > 0)
+  {
+    int64_t left = getBlock(r[15])(remaining);
+    bool stalled = left == remaining;
+    remaining = left;
+    if (stalled || exitRequested)
+    {
+      break;
+    }
+  }
+  exitRequested = false;
+  return budget - remaining;
+}
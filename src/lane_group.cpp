@@ -0,0 +1,562 @@
+#include "../inc/lane_group.hpp"
+#include <algorithm>
+#include <cstring>
+
+LaneGroup::LaneGroup() : laneCount(0), writtenPages(Memory::PAGE_COUNT)
+{
+  reset(nullptr, 0);
+}
+
+void LaneGroup::reset(std::shared_ptr<const Memory> image, uint32_t laneCount)
+{
+  this->image = image;
+  this->laneCount = laneCount;
+  memset(r, 0, sizeof(r));
+  memset(csr, 0, sizeof(csr));
+  memset(&instructionCount, 0, sizeof(instructionCount));
+  running = 0;
+  memset(&runningMask, 0, sizeof(runningMask));
+  for (uint32_t lane = 0; lane < LANES; ++lane)
+  {
+    // Lanes past laneCount drop their pages
+    memories[lane].setBase(lane < laneCount ? image : nullptr);
+    r[15][lane] = EmulatorCore::START_ADDRESS;
+    limit[lane] = INT64_MAX;
+    if (lane < laneCount)
+    {
+      running |= 1u << lane;
+      runningMask[lane] = -1;
+    }
+    stopReasons[lane] = StopReason::NONE;
+    stopMessages[lane].clear();
+    unsupported[lane] = false;
+    outputs[lane].clear();
+  }
+  std::fill(writtenPages.begin(), writtenPages.end(), 0);
+  decodeCache.clear();
+}
+
+void LaneGroup::setMaxInstructions(uint32_t lane, uint64_t maxInstructions)
+{
+  limit[lane] = maxInstructions > INT64_MAX ? INT64_MAX : maxInstructions;
+}
+
+void LaneGroup::setRegister(uint32_t lane, uint16_t index, uint32_t value)
+{
+  r[index][lane] = value;
+}
+
+Memory &LaneGroup::getMemory(uint32_t lane)
+{
+  return memories[lane];
+}
+
+StopReason LaneGroup::getStopReason(uint32_t lane) const
+{
+  return stopReasons[lane];
+}
+
+const std::string &LaneGroup::getStopMessage(uint32_t lane) const
+{
+  return stopMessages[lane];
+}
+
+bool LaneGroup::isUnsupported(uint32_t lane) const
+{
+  return unsupported[lane];
+}
+
+uint64_t LaneGroup::getInstructionCount(uint32_t lane) const
+{
+  return instructionCount[lane];
+}
+
+const std::string &LaneGroup::getOutput(uint32_t lane) const
+{
+  return outputs[lane];
+}
+
+void LaneGroup::printState(uint32_t lane, std::ostream &out) const
+{
+  uint32_t registers[16];
+  for (uint16_t i = 0; i < 16; ++i)
+  {
+    registers[i] = r[i][lane];
+  }
+  EmulatorCore::printRegisters(out, registers);
+}
+
+void LaneGroup::stopLane(uint32_t lane, StopReason reason, const std::string &message)
+{
+  stopReasons[lane] = reason;
+  stopMessages[lane] = message;
+  running &= ~(1u << lane);
+  runningMask[lane] = 0;
+}
+
+void LaneGroup::stopUnsupported(uint32_t lane)
+{
+  unsupported[lane] = true;
+  stopLane(lane, StopReason::NONE, "");
+}
+
+// Stops the lanes that reached their limit, returns how many steps the others can take at least
+uint64_t LaneGroup::stopAtLimits()
+{
+  uint64_t steps = UINT64_MAX;
+  for (uint32_t lane = 0; lane < LANES; ++lane)
+  {
+    if (!(running & (1u << lane)))
+    {
+      continue;
+    }
+    if (instructionCount[lane] >= limit[lane])
+    {
+      stopLane(lane, StopReason::INSTRUCTION_LIMIT, "");
+    }
+    else
+    {
+      steps = std::min<uint64_t>(steps, limit[lane] - instructionCount[lane]);
+    }
+  }
+  return steps;
+}
+
+// Decodes the instruction at pc on the first visit. Running lanes that hold a different word
+// there than the lowest one at pc can't share the decoded instruction and stop as unsupported.
+// Returns nullptr if no lane can execute it.
+const DecodedInstruction *LaneGroup::fetchInstruction(uint32_t pc)
+{
+  DecodedInstruction *instruction = decodeCache.getEntry(pc);
+  if (instruction && instruction->execute)
+  {
+    return instruction;
+  }
+  int32_t first = -1;
+  uint32_t word = 0;
+  for (uint32_t lane = 0; lane < LANES; ++lane)
+  {
+    if (!(running & (1u << lane)))
+    {
+      continue;
+    }
+    if (!instruction && r[15][lane] == pc)
+    {
+      stopUnsupported(lane);
+    }
+    else if (instruction && first < 0 && r[15][lane] == pc)
+    {
+      first = lane;
+      word = memories[lane].readWord(pc);
+    }
+  }
+  if (first < 0)
+  {
+    return nullptr;
+  }
+  for (uint32_t lane = 0; lane < LANES; ++lane)
+  {
+    if (running & (1u << lane) && memories[lane].readWord(pc) != word)
+    {
+      stopUnsupported(lane);
+    }
+  }
+  *instruction = EmulatorCore::decodeInstruction(word);
+  return instruction;
+}
+
+uint32_t LaneGroup::readWord(uint32_t lane, uint32_t addr)
+{
+  return memories[lane].readWord(addr);
+}
+
+void LaneGroup::writeWord(uint32_t lane, uint32_t addr, uint32_t word)
+{
+  memories[lane].writeWord(addr, word);
+  writtenPages[addr >> Memory::PAGE_BITS] = 1;
+  writtenPages[(addr + 3) >> Memory::PAGE_BITS] = 1;
+  if (decodeCache.isDecoded(addr) || decodeCache.isDecoded(addr + 3))
+  {
+    // The other lanes still have the decoded instruction in their memory
+    stopUnsupported(lane);
+  }
+  if (addr == EmulatorCore::TERM_OUT)
+  {
+    outputs[lane].push_back(word);
+  }
+  else if (addr == EmulatorCore::TIM_CFG)
+  {
+    stopUnsupported(lane);
+  }
+}
+
+void LaneGroup::pushWord(uint32_t lane, uint32_t value)
+{
+  r[14][lane] -= 4;
+  writeWord(lane, r[14][lane], value);
+}
+
+void LaneGroup::raiseInterrupt(uint32_t lane, uint32_t cause)
+{
+  pushWord(lane, csr[0][lane]);
+  pushWord(lane, r[15][lane]);
+  csr[2][lane] = cause;
+  csr[0][lane] &= ~0x1;
+  r[15][lane] = csr[1][lane];
+}
+
+// A word at an address that is the same in every lane. Without a store by any lane to its
+// page it's the image's word in every lane too, so one read serves all of them.
+bool LaneGroup::readUniform(uint32_t addr, uint32_t &word) const
+{
+  if (writtenPages[addr >> Memory::PAGE_BITS] || writtenPages[(addr + 3) >> Memory::PAGE_BITS])
+  {
+    return false;
+  }
+  word = image ? image->readWord(addr) : 0;
+  return true;
+}
+
+// Instructions that access memory, executed lane by lane like EmulatorCore does
+void LaneGroup::executeMemory(const DecodedInstruction &instruction, uint32_t lanes)
+{
+  uint16_t a = instruction.regA;
+  uint16_t b = instruction.regB;
+  uint16_t c = instruction.regC;
+  int32_t disp = instruction.disp;
+  uint32_t lane;
+  switch (instruction.operation)
+  {
+  case isa::Operation::CALL:
+    for (; lanes; lanes &= lanes - 1)
+    {
+      lane = __builtin_ctz(lanes);
+      pushWord(lane, r[15][lane]);
+      r[15][lane] = readWord(lane, r[a][lane] + r[b][lane] + disp);
+    }
+    break;
+  // The caller left only the lanes that take the branch
+  case isa::Operation::JMP:
+  case isa::Operation::BEQ:
+  case isa::Operation::BNE:
+  case isa::Operation::BGT:
+    for (; lanes; lanes &= lanes - 1)
+    {
+      lane = __builtin_ctz(lanes);
+      r[15][lane] = readWord(lane, r[a][lane] + disp);
+    }
+    break;
+  // st mem[reg + literal]
+  case isa::Operation::STORE:
+    for (; lanes; lanes &= lanes - 1)
+    {
+      lane = __builtin_ctz(lanes);
+      writeWord(lane, r[a][lane] + r[b][lane] + disp, r[c][lane]);
+    }
+    break;
+  case isa::Operation::PUSH:
+    for (; lanes; lanes &= lanes - 1)
+    {
+      lane = __builtin_ctz(lanes);
+      r[a][lane] -= disp;
+      writeWord(lane, r[a][lane], r[c][lane]);
+    }
+    break;
+  // st mem[literal]
+  case isa::Operation::STORE_INDIRECT:
+    for (; lanes; lanes &= lanes - 1)
+    {
+      lane = __builtin_ctz(lanes);
+      writeWord(lane, readWord(lane, r[a][lane] + r[b][lane] + disp), r[c][lane]);
+    }
+    break;
+  case isa::Operation::LOAD:
+    for (; lanes; lanes &= lanes - 1)
+    {
+      lane = __builtin_ctz(lanes);
+      r[a][lane] = readWord(lane, r[b][lane] + r[c][lane] + disp);
+    }
+    break;
+  case isa::Operation::POP:
+    for (; lanes; lanes &= lanes - 1)
+    {
+      lane = __builtin_ctz(lanes);
+      r[a][lane] = readWord(lane, r[b][lane]);
+      r[b][lane] += disp;
+    }
+    break;
+  case isa::Operation::POP_CSR:
+    for (; lanes; lanes &= lanes - 1)
+    {
+      lane = __builtin_ctz(lanes);
+      if (a > 2)
+      {
+        stopUnsupported(lane);
+        continue;
+      }
+      csr[a][lane] = readWord(lane, r[b][lane]);
+      r[b][lane] += disp;
+    }
+    break;
+  // A division by zero faults the same way as on a core
+  case isa::Operation::DIV:
+    for (; lanes; lanes &= lanes - 1)
+    {
+      lane = __builtin_ctz(lanes);
+      r[a][lane] = r[b][lane] / r[c][lane];
+    }
+    break;
+  default:
+    for (; lanes; lanes &= lanes - 1)
+    {
+      stopLane(__builtin_ctz(lanes), StopReason::INVALID_MODIFIER, "Invalid instruction modifier.");
+    }
+    break;
+  }
+}
+
+// Bit i is set if lane i of mask is
+static inline uint32_t laneBits(const int32_t *mask, uint32_t laneCount)
+{
+  uint32_t bits = 0;
+  for (uint32_t lane = 0; lane < laneCount; ++lane)
+  {
+    bits |= (mask[lane] & 1) << lane;
+  }
+  return bits;
+}
+
+// r0 always reads 0 and PC reads as the address of the next instruction, in every lane
+static inline bool isUniform(uint16_t reg)
+{
+  return reg == 0 || reg == 15;
+}
+
+static inline uint32_t uniformValue(uint16_t reg, uint32_t pc)
+{
+  return reg == 15 ? pc + 4 : 0;
+}
+
+// The loop is compiled once for every vector extension in the list and the best one the
+// host supports is picked when the emulator starts
+__attribute__((target_clones("avx512f", "avx2", "default"))) void LaneGroup::run()
+{
+  uint64_t untilLimit = stopAtLimits();
+  for (const auto &memory : memories)
+  {
+    for (const auto &pageNumber : memory.getAllocatedPages())
+    {
+      writtenPages[pageNumber] = 1;
+    }
+  }
+  uint32_t pc = 0;
+  LaneMask mask = {};
+  uint32_t lanes = 0;
+  bool branches = true;
+  bool converged = false;
+
+  while (running)
+  {
+    // While every running lane is at the same PC straight-line code needs no search
+    if (converged && lanes == running && !branches)
+    {
+      pc += 4;
+    }
+    else
+    {
+      LaneWord pcs = runningMask ? r[15] : ~LaneWord{};
+      pc = UINT32_MAX;
+      for (uint32_t lane = 0; lane < LANES; ++lane)
+      {
+        pc = std::min<uint32_t>(pc, pcs[lane]);
+      }
+      mask = (r[15] == pc) & runningMask;
+      lanes = laneBits((const int32_t *)&mask, LANES);
+    }
+
+    const DecodedInstruction *instruction = fetchInstruction(pc);
+    // Lanes at pc that can't execute it stopped
+    mask &= runningMask;
+    lanes &= running;
+    converged = lanes == running;
+    branches = true;
+    if (instruction && lanes)
+    {
+      uint16_t a = instruction->regA;
+      uint16_t b = instruction->regB;
+      uint16_t c = instruction->regC;
+      uint32_t word;
+      r[15] = mask ? r[15] + 4 : r[15];
+      LaneWord result;
+      LaneMask taken;
+      branches = a == 15;
+      switch (instruction->operation)
+      {
+      case isa::Operation::HALT:
+        for (uint32_t bits = lanes; bits; bits &= bits - 1)
+        {
+          stopLane(__builtin_ctz(bits), StopReason::HALT, "");
+        }
+        break;
+      case isa::Operation::INT:
+        for (uint32_t bits = lanes; bits; bits &= bits - 1)
+        {
+          raiseInterrupt(__builtin_ctz(bits), EmulatorCore::CAUSE_SOFTWARE);
+        }
+        branches = true;
+        break;
+      case isa::Operation::JMP:
+      case isa::Operation::BEQ:
+      case isa::Operation::BNE:
+      case isa::Operation::BGT:
+        branches = true;
+        switch (instruction->operation)
+        {
+        case isa::Operation::JMP:
+          taken = mask;
+          break;
+        case isa::Operation::BEQ:
+          taken = mask & (r[b] == r[c]);
+          break;
+        case isa::Operation::BNE:
+          taken = mask & (r[b] != r[c]);
+          break;
+        default:
+          taken = mask & (r[b] > r[c]);
+          break;
+        }
+        // Branch targets normally come from the literal pool after the branch
+        if (isUniform(a) && readUniform(uniformValue(a, pc) + instruction->disp, word))
+        {
+          r[15] = taken ? LaneWord{} + word : r[15];
+        }
+        else
+        {
+          executeMemory(*instruction, laneBits((const int32_t *)&taken, LANES));
+        }
+        break;
+      case isa::Operation::XCHG:
+        result = r[b];
+        r[b] = mask ? r[c] : r[b];
+        r[c] = mask ? result : r[c];
+        branches = b == 15 || c == 15;
+        break;
+      case isa::Operation::ADD:
+      case isa::Operation::SUB:
+      case isa::Operation::MUL:
+      case isa::Operation::NOT:
+      case isa::Operation::AND:
+      case isa::Operation::OR:
+      case isa::Operation::XOR:
+      case isa::Operation::SHL:
+      case isa::Operation::SHR:
+        switch (instruction->operation)
+        {
+        case isa::Operation::ADD:
+          result = r[b] + r[c];
+          break;
+        case isa::Operation::SUB:
+          result = r[b] - r[c];
+          break;
+        case isa::Operation::MUL:
+          result = r[b] * r[c];
+          break;
+        case isa::Operation::NOT:
+          result = ~r[b];
+          break;
+        case isa::Operation::AND:
+          result = r[b] & r[c];
+          break;
+        case isa::Operation::OR:
+          result = r[b] | r[c];
+          break;
+        case isa::Operation::XOR:
+          result = r[b] ^ r[c];
+          break;
+        // Shift counts wrap at 32 like the host's scalar shifts
+        case isa::Operation::SHL:
+          result = r[b] << (r[c] & 31);
+          break;
+        default:
+          result = r[b] >> (r[c] & 31);
+          break;
+        }
+        r[a] = mask ? result : r[a];
+        break;
+      case isa::Operation::CSR_READ:
+        if (b > 2)
+        {
+          for (uint32_t bits = lanes; bits; bits &= bits - 1)
+          {
+            stopUnsupported(__builtin_ctz(bits));
+          }
+          break;
+        }
+        r[a] = mask ? csr[b] : r[a];
+        break;
+      case isa::Operation::ADD_DISP:
+        r[a] = mask ? r[b] + (uint32_t)instruction->disp : r[a];
+        break;
+      case isa::Operation::LOAD:
+        // ld $literal
+        if (isUniform(b) && isUniform(c) &&
+            readUniform(uniformValue(b, pc) + uniformValue(c, pc) + instruction->disp, word))
+        {
+          r[a] = mask ? LaneWord{} + word : r[a];
+        }
+        else
+        {
+          executeMemory(*instruction, lanes);
+        }
+        break;
+      case isa::Operation::CSR_WRITE:
+        if (a > 2)
+        {
+          for (uint32_t bits = lanes; bits; bits &= bits - 1)
+          {
+            stopUnsupported(__builtin_ctz(bits));
+          }
+          break;
+        }
+        csr[a] = mask ? r[b] : csr[a];
+        branches = false;
+        break;
+      case isa::Operation::POP:
+      case isa::Operation::POP_CSR:
+        executeMemory(*instruction, lanes);
+        branches |= b == 15;
+        break;
+      case isa::Operation::CALL:
+        executeMemory(*instruction, lanes);
+        branches = true;
+        break;
+      // div goes lane by lane
+      case isa::Operation::DIV:
+      case isa::Operation::STORE:
+      case isa::Operation::PUSH:
+      case isa::Operation::STORE_INDIRECT:
+        executeMemory(*instruction, lanes);
+        break;
+      case isa::Operation::INVALID_MODIFIER:
+        for (uint32_t bits = lanes; bits; bits &= bits - 1)
+        {
+          stopLane(__builtin_ctz(bits), StopReason::INVALID_MODIFIER, "Invalid instruction modifier.");
+        }
+        break;
+      default:
+        for (uint32_t bits = lanes; bits; bits &= bits - 1)
+        {
+          stopLane(__builtin_ctz(bits), StopReason::INVALID_OPCODE, "Invalid opcode.");
+        }
+        break;
+      }
+      r[0] = LaneWord{};
+    }
+    instructionCount -= __builtin_convertvector(mask, LaneCount);
+
+    if (!--untilLimit)
+    {
+      untilLimit = stopAtLimits();
+    }
+  }
+}
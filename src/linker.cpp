@@ -3,14 +3,18 @@
 #include <vector>
 #include <unordered_map>
 #include <map>
+#include <deque>
 #include "../inc/linker.hpp"
 #include "../inc/symbol.hpp"
 #include "../inc/relocation.hpp"
 #include "../inc/section_info.hpp"
+#include "../inc/program_image.hpp"
+#include "../inc/object_file.hpp"
 
 namespace linker
 {
-  std::vector<std::ifstream> inputFiles;
+  // Stay mapped until the output is written, the sections point into them
+  std::deque<ObjectFile> inputFiles;
   std::ofstream outputFile;
   std::unordered_map<std::string, uint32_t> placeSections;
 
@@ -23,6 +27,8 @@ namespace linker
 
   std::map<uint32_t, uint16_t> mem;
 
+  std::string mapFileName;
+
   void setHex()
   {
     isHex = true;
@@ -33,20 +39,28 @@ namespace linker
     isRelocatable = true;
   }
 
+  void setBinary()
+  {
+    isBinary = true;
+  }
+
+  void setMapFile(std::string fileName)
+  {
+    mapFileName = fileName;
+  }
+
   void setIOFiles(std::string outputFileName, std::vector<std::string> inputFileNames)
   {
     for (const auto &inputFileName : inputFileNames)
     {
-      std::ifstream inputFile;
-      inputFile.open(inputFileName);
-      if (!inputFile.is_open())
+      inputFiles.emplace_back();
+      if (!inputFiles.back().load(inputFileName))
       {
         std::cout << "Error opening input file." << std::endl;
         exit(1);
       }
-      inputFiles.push_back(std::move(inputFile));
     }
-    outputFile.open(outputFileName);
+    outputFile.open(outputFileName, isBinary ? std::ios::out | std::ios::binary : std::ios::out);
 
     if (!outputFile.is_open())
     {
@@ -90,12 +104,15 @@ namespace linker
       std::cout << "address(" << std::hex << sections[sectionName].address << ") ";
       std::cout << "size(" << std::dec << sections[sectionName].size << ")" << std::endl;
       uint16_t i = 0;
-      for (const auto &mem : sections[sectionName].data)
+      for (const auto &piece : sections[sectionName].pieces)
       {
-        std::cout << std::hex << std::setw(2) << std::setfill('0') << mem << " ";
-        ++i;
-        if (!(i % 8))
-          std::cout << std::endl;
+        for (uint32_t offset = 0; offset < piece.size; ++offset)
+        {
+          std::cout << std::hex << std::setw(2) << std::setfill('0') << (uint16_t)piece.data[offset] << " ";
+          ++i;
+          if (!(i % 8))
+            std::cout << std::endl;
+        }
       }
       std::cout << std::endl;
     }
@@ -148,65 +165,18 @@ namespace linker
     }
   }
 
+  // Sections with the same name are merged in the order of the input files. Symbols and
+  // relocations of a later file are moved by the size the section had before it.
   void parseInputFiles()
   {
-    uint16_t sectionNum = 0;
-
-    for (auto &inputFile : inputFiles)
+    for (const auto &inputFile : inputFiles)
     {
-      std::string currentWord = "";
-
-      while (currentWord != "Name")
+      for (uint32_t i = 0; i < inputFile.getSymbolCount(); ++i)
       {
-        inputFile >> currentWord;
-      }
-      // Parse symbol table
-      while (true)
-      {
-        uint32_t value;
-        uint16_t size;
-        SymbolType type;
-        ScopeType scope;
-        std::string section;
-        std::string name;
-
-        // value
-        inputFile >> currentWord;
-        if ((currentWord.substr(0, 2) == "#.") || inputFile.eof())
-        {
-          break;
-        }
-        value = std::stoul(currentWord, nullptr, 16);
-
-        // size
-        inputFile >> currentWord;
-        size = stoi(currentWord);
-
-        // type
-        inputFile >> currentWord;
-        if (currentWord == "NOTYPE")
-        {
-          type = SymbolType::NOTYPE;
-        }
-        else if (currentWord == "SECTION")
-        {
-          type = SymbolType::SECTION;
-        }
-
-        // scope
-        inputFile >> currentWord;
-        if (currentWord == "GLOBAL")
-        {
-          scope = ScopeType::GLOBAL;
-        }
-        else if (currentWord == "LOCAL")
-        {
-          scope = ScopeType::LOCAL;
-        }
-
-        // section
-        inputFile >> currentWord;
-        section = currentWord;
+        const ObjectSymbol &symbol = inputFile.getSymbol(i);
+        uint32_t value = symbol.value;
+        SymbolType type = (SymbolType)symbol.type;
+        std::string section = inputFile.getString(symbol.section);
 
         // Section merging update
         if (sections.count(section) > 0 && type != SymbolType::SECTION)
@@ -219,81 +189,34 @@ namespace linker
           value += sections[section].size;
         }
 
-        // name
-        inputFile >> currentWord;
-        name = currentWord;
-
-        addSymbol(value, size, type, scope, section, name);
+        addSymbol(value, symbol.size, type, (ScopeType)symbol.scope, section, inputFile.getString(symbol.name));
       }
 
-      // Parse memory content
-      while (true)
+      for (uint32_t i = 0; i < inputFile.getSectionCount(); ++i)
       {
-        if ((currentWord.substr(0, 7) == "#.rela.") || inputFile.eof())
-        {
-          break;
-        }
-        std::string sectionName = currentWord.substr(2, std::string::npos);
+        const ObjectSection &objectSection = inputFile.getSection(i);
+        std::string sectionName = inputFile.getString(objectSection.name);
 
         if (!sections.count(sectionName))
         {
           parsedSections.push_back(sectionName);
         }
+        SectionInfo &section = sections[sectionName];
+        uint32_t base = section.size;
+        section.pieces.push_back({inputFile.getSectionData(objectSection), objectSection.size});
+        section.size += objectSection.size;
 
-        inputFile >> currentWord;
-        while (currentWord[0] != '#')
-        {
-          sections[sectionName].data.push_back(stoul(currentWord, nullptr, 16));
-          inputFile >> currentWord;
-        }
-      }
-
-      // Parse relocation tables
-      while (!inputFile.eof())
-      {
-        std::string sectionName = currentWord.substr(7, std::string::npos);
-        inputFile >> currentWord; // Offset
-        inputFile >> currentWord; // Symbol
-        inputFile >> currentWord; // Addend
-
-        uint32_t base = 0;
-
-        // Section merging update
-        if (relocationTables.count(sectionName))
-        {
-          base += sections[sectionName].size;
-        }
-        sections[sectionName].size = sections[sectionName].data.size();
-
-        // Create a relocation tables entry in case it's empty
-        relocationTables[sectionName];
-
-        while (inputFile >> currentWord)
+        std::vector<Relocation> &relocationTable = relocationTables[sectionName];
+        for (uint32_t j = 0; j < objectSection.relocationCount; ++j)
         {
-          // Read section relocation data
-          if (currentWord.substr(0, 2) == "#.")
-          {
-            break;
-          }
-
-          uint32_t offset;
-          std::string symbolName;
-          uint32_t addend;
-
-          offset = stoul(currentWord, nullptr, 16);
-          offset += base;
-
-          inputFile >> currentWord;
-          symbolName = currentWord;
-
-          inputFile >> currentWord;
-          addend = stoi(currentWord);
+          const ObjectRelocation &rel = inputFile.getRelocation(objectSection.relocationIndex + j);
+          std::string symbolName = inputFile.getString(rel.symbol);
+          uint32_t addend = rel.addend;
           if (symbolTable[symbolName].scope == ScopeType::LOCAL)
           {
             addend += base;
           }
-
-          relocationTables[sectionName].push_back({offset, symbolName, addend});
+          relocationTable.push_back({rel.offset + base, symbolName, addend});
         }
       }
     }
@@ -370,34 +293,34 @@ namespace linker
     }
   }
 
-  void resolveReferences()
+  void createMemoryContent()
   {
-    for (const auto &sectionRel : relocationTables)
+    for (const auto &section : sections)
     {
-      std::string sectionName = sectionRel.first;
-      for (const auto &rel : sectionRel.second)
+      uint32_t addr = section.second.address;
+      for (const auto &piece : section.second.pieces)
       {
-        uint32_t value = symbolTable[rel.symbolName].value + rel.addend;
-        uint16_t byte4 = (value & 0xFF000000) >> 24;
-        uint16_t byte3 = (value & 0x00FF0000) >> 16;
-        uint16_t byte2 = (value & 0x0000FF00) >> 8;
-        uint16_t byte1 = (value & 0x000000FF);
-        sections[sectionName].data[rel.offset] = byte1;
-        sections[sectionName].data[rel.offset + 1] = byte2;
-        sections[sectionName].data[rel.offset + 2] = byte3;
-        sections[sectionName].data[rel.offset + 3] = byte4;
+        for (uint32_t offset = 0; offset < piece.size; ++offset)
+        {
+          mem[addr++] = piece.data[offset];
+        }
       }
     }
   }
 
-  void createMemoryContent()
+  // Patches mem, the input files are only read
+  void resolveReferences()
   {
-    for (const auto &section : sections)
+    for (const auto &sectionRel : relocationTables)
     {
-      uint32_t addr = section.second.address;
-      for (uint32_t offset = 0; offset < section.second.data.size(); ++offset)
+      uint32_t addr = sections[sectionRel.first].address;
+      for (const auto &rel : sectionRel.second)
       {
-        mem[addr + offset] = section.second.data[offset];
+        uint32_t value = symbolTable[rel.symbolName].value + rel.addend;
+        mem[addr + rel.offset] = value & 0xFF;
+        mem[addr + rel.offset + 1] = (value >> 8) & 0xFF;
+        mem[addr + rel.offset + 2] = (value >> 16) & 0xFF;
+        mem[addr + rel.offset + 3] = (value >> 24) & 0xFF;
       }
     }
   }
@@ -428,14 +351,95 @@ namespace linker
     outputFile << std::endl;
   }
 
+  // One line per label, section symbols are left out since a label usually starts the section
+  void outputSymbolMap()
+  {
+    std::ofstream mapFile(mapFileName);
+    if (!mapFile.is_open())
+    {
+      std::cout << "Error opening map file." << std::endl;
+      exit(1);
+    }
+    std::multimap<uint32_t, std::string> labels;
+    for (const auto &symbol : symbolTable)
+    {
+      if (symbol.second.type != SymbolType::SECTION)
+      {
+        labels.insert({symbol.second.value, symbol.first});
+      }
+    }
+    for (const auto &label : labels)
+    {
+      mapFile << std::hex << std::setw(8) << std::setfill('0') << label.first << " " << label.second << std::endl;
+    }
+  }
+
+  void outputWord(uint32_t word)
+  {
+    char bytes[4] = {(char)(word & 0xFF), (char)((word >> 8) & 0xFF), (char)((word >> 16) & 0xFF), (char)((word >> 24) & 0xFF)};
+    outputFile.write(bytes, 4);
+  }
+
+  // Writes every contiguous run of memory as one range of the binary image
+  void outputBinaryImage()
+  {
+    std::vector<ProgramImageRange> ranges;
+    for (const auto &memLoc : mem)
+    {
+      if (ranges.empty() || memLoc.first != ranges.back().address + ranges.back().size)
+      {
+        ranges.push_back({memLoc.first, 0, 0, 0});
+      }
+      ranges.back().size++;
+    }
+
+    uint32_t offset = sizeof(ProgramImageHeader) + ranges.size() * sizeof(ProgramImageRange);
+    for (auto &range : ranges)
+    {
+      range.offset = offset;
+      offset += range.size;
+    }
+
+    outputWord(PROGRAM_IMAGE_MAGIC);
+    outputWord(PROGRAM_IMAGE_VERSION);
+    outputWord(ranges.size());
+    outputWord(0);
+    for (const auto &range : ranges)
+    {
+      outputWord(range.address);
+      outputWord(range.size);
+      outputWord(range.offset);
+      outputWord(0);
+    }
+    // The ranges follow the order of mem, so the data is all of mem in order
+    std::vector<char> data;
+    data.reserve(mem.size());
+    for (const auto &memLoc : mem)
+    {
+      data.push_back(memLoc.second);
+    }
+    outputFile.write(data.data(), data.size());
+  }
+
   void link()
   {
     parseInputFiles();
     mapSections();
     updateSymbolTable();
-    resolveReferences();
     createMemoryContent();
-    outputMemoryContent();
+    resolveReferences();
+    if (isBinary)
+    {
+      outputBinaryImage();
+    }
+    else
+    {
+      outputMemoryContent();
+    }
+    if (!mapFileName.empty())
+    {
+      outputSymbolMap();
+    }
 
     // outputSymbolTable();
     // printSections();
@@ -8,6 +8,7 @@
 
 bool linker::isHex = false;
 bool linker::isRelocatable = false;
+bool linker::isBinary = false;
 
 int main(int argc, char **argv)
 {
@@ -42,6 +43,10 @@ int main(int argc, char **argv)
       uint32_t sectionAddress = std::stoul(arg.substr(pos + 1, std::string::npos), nullptr, 16);
       linker::addPlaceSection(sectionName, sectionAddress);
     }
+    else if (arg.substr(0, 5) == "-map=")
+    {
+      linker::setMapFile(arg.substr(5));
+    }
     else if (arg == "-hex")
     {
       linker::setHex();
@@ -50,6 +55,10 @@ int main(int argc, char **argv)
     {
       linker::setRelocatable();
     }
+    else if (arg == "-binary")
+    {
+      linker::setBinary();
+    }
     else
     {
       if (outputFileName.empty())
@@ -79,14 +88,14 @@ int main(int argc, char **argv)
     std::cout << "Error. No input files specified." << std::endl;
     exit(1);
   }
-  if (linker::isHex && linker::isRelocatable)
+  if (linker::isHex + linker::isRelocatable + linker::isBinary > 1)
   {
-    std::cout << "Error. Only one of the -hex and -relocatable options can be specified." << std::endl;
+    std::cout << "Error. Only one of the -hex, -binary and -relocatable options can be specified." << std::endl;
     exit(1);
   }
-  if (!linker::isHex && !linker::isRelocatable)
+  if (!linker::isHex && !linker::isRelocatable && !linker::isBinary)
   {
-    std::cout << "Error. One of the -hex and -relocatable options must be specified." << std::endl;
+    std::cout << "Error. One of the -hex, -binary and -relocatable options must be specified." << std::endl;
     exit(1);
   }
 
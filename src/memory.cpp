@@ -0,0 +1,114 @@
+#include "../inc/memory.hpp"
+#include <cstdlib>
+#include <new>
+#include <cstring>
+#include <algorithm>
+
+Memory::Memory()
+{
+  // calloc leaves the untouched parts of the large tables as shared zero pages
+  pageTable = static_cast<uint8_t **>(calloc(PAGE_COUNT, sizeof(uint8_t *)));
+  writeTable = static_cast<uint8_t **>(calloc(PAGE_COUNT, sizeof(uint8_t *)));
+  if (!pageTable || !writeTable)
+  {
+    free(pageTable);
+    free(writeTable);
+    throw std::bad_alloc();
+  }
+}
+
+Memory::~Memory()
+{
+  clear();
+  free(pageTable);
+  free(writeTable);
+}
+
+void Memory::clear()
+{
+  for (const auto &pageNumber : allocatedPages)
+  {
+    free(pageTable[pageNumber]);
+    pageTable[pageNumber] = base ? base->pageTable[pageNumber] : nullptr;
+    writeTable[pageNumber] = nullptr;
+  }
+  allocatedPages.clear();
+}
+
+std::vector<uint32_t> Memory::getPageNumbers() const
+{
+  std::vector<uint32_t> pages = basePages;
+  pages.insert(pages.end(), allocatedPages.begin(), allocatedPages.end());
+  std::sort(pages.begin(), pages.end());
+  pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+  return pages;
+}
+
+void Memory::setBase(std::shared_ptr<const Memory> base)
+{
+  clear();
+  for (const auto &pageNumber : basePages)
+  {
+    pageTable[pageNumber] = nullptr;
+  }
+  this->base = base;
+  basePages = base ? base->getPageNumbers() : std::vector<uint32_t>();
+  for (const auto &pageNumber : basePages)
+  {
+    pageTable[pageNumber] = base->pageTable[pageNumber];
+  }
+}
+
+std::shared_ptr<const Memory> Memory::share()
+{
+  std::shared_ptr<Memory> image(new Memory());
+  image->setBase(base);
+  for (const auto &pageNumber : allocatedPages)
+  {
+    image->pageTable[pageNumber] = pageTable[pageNumber];
+    image->writeTable[pageNumber] = pageTable[pageNumber];
+    image->allocatedPages.push_back(pageNumber);
+    writeTable[pageNumber] = nullptr;
+  }
+  // The page table already points at every page of the new base
+  allocatedPages.clear();
+  base = image;
+  basePages = image->getPageNumbers();
+  return image;
+}
+
+void Memory::writeBlock(uint32_t addr, const uint8_t *data, uint32_t size)
+{
+  while (size)
+  {
+    uint8_t *page = writeTable[addr >> PAGE_BITS];
+    if (!page)
+    {
+      page = allocatePage(addr >> PAGE_BITS);
+    }
+    uint32_t offset = addr & PAGE_MASK;
+    uint32_t chunk = PAGE_SIZE - offset < size ? PAGE_SIZE - offset : size;
+    memcpy(page + offset, data, chunk);
+    addr += chunk;
+    data += chunk;
+    size -= chunk;
+  }
+}
+
+// A page still shared with the base is copied, everything else starts out as zero
+uint8_t *Memory::allocatePage(uint32_t pageNumber)
+{
+  uint8_t *page = static_cast<uint8_t *>(calloc(PAGE_SIZE, 1));
+  if (!page)
+  {
+    throw std::bad_alloc();
+  }
+  if (pageTable[pageNumber])
+  {
+    memcpy(page, pageTable[pageNumber], PAGE_SIZE);
+  }
+  pageTable[pageNumber] = page;
+  writeTable[pageNumber] = page;
+  allocatedPages.push_back(pageNumber);
+  return page;
+}
@@ -0,0 +1,43 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "../inc/object_file.hpp"
+
+// Converts object files between the binary format and the text dump
+int main(int argc, char **argv)
+{
+  bool isBinary = false;
+  if ((argc == 5) && (std::string(argv[1]) == "-binary"))
+  {
+    isBinary = true;
+    --argc;
+    ++argv;
+  }
+  if ((argc != 4) || (std::string(argv[1]) != "-o"))
+  {
+    std::cout << "Invalid command." << std::endl;
+    return 1;
+  }
+
+  ObjectFile objectFile;
+  if (!objectFile.load(argv[3]))
+  {
+    std::cout << "Error opening input file." << std::endl;
+    return 1;
+  }
+  std::ofstream outputFile(argv[2], isBinary ? std::ios::out | std::ios::binary : std::ios::out);
+  if (!outputFile.is_open())
+  {
+    std::cout << "Error opening output file." << std::endl;
+    return 1;
+  }
+  if (isBinary)
+  {
+    objectFile.writeBinary(outputFile);
+  }
+  else
+  {
+    objectFile.writeText(outputFile);
+  }
+  return 0;
+}
@@ -0,0 +1,389 @@
+#include "../inc/object_file.hpp"
+#include "../inc/object_writer.hpp"
+#include "../inc/symbol.hpp"
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ObjectFile::ObjectFile() : data(nullptr), size(0), mapped(false)
+{
+}
+
+ObjectFile::~ObjectFile()
+{
+  unload();
+}
+
+void ObjectFile::unload()
+{
+  if (mapped && data)
+  {
+    munmap(const_cast<char *>(data), size);
+  }
+  data = nullptr;
+  size = 0;
+  mapped = false;
+  buffer.clear();
+}
+
+bool ObjectFile::load(const std::string &fileName)
+{
+  unload();
+  int fd = open(fileName.c_str(), O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) < 0)
+  {
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return false;
+  }
+  if (info.st_size == 0)
+  {
+    close(fd);
+    return false;
+  }
+  void *image = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED)
+  {
+    return false;
+  }
+  data = static_cast<const char *>(image);
+  size = info.st_size;
+  mapped = true;
+  if (size >= sizeof(ObjectFileHeader) && getHeader().magic == OBJECT_FILE_MAGIC)
+  {
+    if (isValid())
+    {
+      return true;
+    }
+    unload();
+    return false;
+  }
+
+  // Not the binary format, try the text dump
+  std::istringstream input(std::string(data, size));
+  unload();
+  return convertText(input);
+}
+
+bool ObjectFile::load(const char *image, size_t imageSize)
+{
+  unload();
+  if (imageSize >= sizeof(ObjectFileHeader) && *reinterpret_cast<const uint32_t *>(image) == OBJECT_FILE_MAGIC)
+  {
+    buffer.assign(image, imageSize);
+    data = buffer.data();
+    size = buffer.size();
+    if (isValid())
+    {
+      return true;
+    }
+    unload();
+    return false;
+  }
+  std::istringstream input(std::string(image, imageSize));
+  return convertText(input);
+}
+
+const ObjectFileHeader &ObjectFile::getHeader() const
+{
+  return *reinterpret_cast<const ObjectFileHeader *>(data);
+}
+
+uint32_t ObjectFile::getSectionCount() const
+{
+  return getHeader().sectionCount;
+}
+
+const ObjectSection &ObjectFile::getSection(uint32_t index) const
+{
+  return reinterpret_cast<const ObjectSection *>(data + getHeader().sectionOffset)[index];
+}
+
+const uint8_t *ObjectFile::getSectionData(const ObjectSection &section) const
+{
+  return reinterpret_cast<const uint8_t *>(data + section.offset);
+}
+
+uint32_t ObjectFile::getSymbolCount() const
+{
+  return getHeader().symbolCount;
+}
+
+const ObjectSymbol &ObjectFile::getSymbol(uint32_t index) const
+{
+  return reinterpret_cast<const ObjectSymbol *>(data + getHeader().symbolOffset)[index];
+}
+
+const ObjectRelocation &ObjectFile::getRelocation(uint32_t index) const
+{
+  return reinterpret_cast<const ObjectRelocation *>(data + getHeader().relocationOffset)[index];
+}
+
+const char *ObjectFile::getString(uint32_t offset) const
+{
+  return data + getHeader().stringTableOffset + offset;
+}
+
+// Checks every offset once, so the getters don't have to
+bool ObjectFile::isValid() const
+{
+  if (size < sizeof(ObjectFileHeader))
+  {
+    return false;
+  }
+  const ObjectFileHeader &header = getHeader();
+  auto fits = [&](uint32_t offset, uint32_t count, uint32_t recordSize)
+  {
+    return !(offset % 4) && (uint64_t)offset + (uint64_t)count * recordSize <= size;
+  };
+  if (header.magic != OBJECT_FILE_MAGIC || header.version != OBJECT_FILE_VERSION ||
+      !fits(header.sectionOffset, header.sectionCount, sizeof(ObjectSection)) ||
+      !fits(header.symbolOffset, header.symbolCount, sizeof(ObjectSymbol)) ||
+      !fits(header.relocationOffset, header.relocationCount, sizeof(ObjectRelocation)) ||
+      !fits(header.stringTableOffset, header.stringTableSize, 1))
+  {
+    return false;
+  }
+  // The last string is terminated, so is every string that starts inside the table
+  if (header.stringTableSize && data[header.stringTableOffset + header.stringTableSize - 1] != '\0')
+  {
+    return false;
+  }
+  auto isString = [&](uint32_t offset)
+  {
+    return offset < header.stringTableSize;
+  };
+
+  for (uint32_t i = 0; i < header.symbolCount; ++i)
+  {
+    const ObjectSymbol &symbol = getSymbol(i);
+    if (!isString(symbol.name) || !isString(symbol.section) ||
+        symbol.type > (uint8_t)SymbolType::SECTION || symbol.scope > (uint8_t)ScopeType::GLOBAL)
+    {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < header.sectionCount; ++i)
+  {
+    const ObjectSection &section = getSection(i);
+    if (!isString(section.name) || (uint64_t)section.offset + section.size > size ||
+        (uint64_t)section.relocationIndex + section.relocationCount > header.relocationCount)
+    {
+      return false;
+    }
+    for (uint32_t j = 0; j < section.relocationCount; ++j)
+    {
+      const ObjectRelocation &relocation = getRelocation(section.relocationIndex + j);
+      if (!isString(relocation.symbol) || (uint64_t)relocation.offset + 4 > section.size)
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void ObjectFile::writeBinary(std::ostream &out) const
+{
+  out.write(data, size);
+}
+
+// Two hex digits and a space for every byte, eight bytes to a line
+static void writeSectionData(std::ostream &out, const uint8_t *bytes, uint32_t count)
+{
+  static const char digits[] = "0123456789abcdef";
+  std::string text(count * 3 + count / 8, ' ');
+  char *next = &text[0];
+  for (uint32_t offset = 0; offset < count; ++offset)
+  {
+    next[0] = digits[bytes[offset] >> 4];
+    next[1] = digits[bytes[offset] & 0xF];
+    next += 3;
+    if (!((offset + 1) % 8))
+    {
+      *next++ = '\n';
+    }
+  }
+  out.write(text.data(), text.size());
+}
+
+void ObjectFile::writeText(std::ostream &out) const
+{
+  out << "#.symtab" << '\n';
+  out << std::setw(10) << std::left << std::setfill(' ') << "Value";
+  out << std::setw(10) << std::left << std::setfill(' ') << "Size";
+  out << std::setw(10) << std::left << std::setfill(' ') << "Type";
+  out << std::setw(10) << std::left << std::setfill(' ') << "Scope";
+  out << std::setw(20) << std::left << std::setfill(' ') << "Section";
+  out << std::setw(20) << std::left << std::setfill(' ') << "Name";
+  out << '\n';
+  for (uint32_t i = 0; i < getSymbolCount(); ++i)
+  {
+    const ObjectSymbol &symbol = getSymbol(i);
+    out << std::setw(8) << std::right << std::setfill('0') << std::hex << symbol.value << "  ";
+    out << std::setw(10) << std::left << std::setfill(' ') << symbol.size;
+    out << std::setw(10) << std::left << std::setfill(' ') << SymbolTypeToString((SymbolType)symbol.type);
+    out << std::setw(10) << std::left << std::setfill(' ') << ScopeTypeToString((ScopeType)symbol.scope);
+    out << std::setw(20) << std::left << std::setfill(' ') << getString(symbol.section);
+    out << std::setw(20) << std::left << std::setfill(' ') << getString(symbol.name);
+    out << '\n';
+  }
+
+  for (uint32_t i = 0; i < getSectionCount(); ++i)
+  {
+    if (i > 0 && getSection(i - 1).size % 8)
+    {
+      out << '\n';
+    }
+    const ObjectSection &section = getSection(i);
+    out << "#." << getString(section.name) << '\n';
+    writeSectionData(out, getSectionData(section), section.size);
+  }
+
+  for (uint32_t i = 0; i < getSectionCount(); ++i)
+  {
+    const ObjectSection &section = getSection(i);
+    out << '\n';
+    out << "#.rela." << getString(section.name) << '\n';
+    out << std::setw(10) << std::left << std::setfill(' ') << "Offset";
+    out << std::setw(20) << std::left << std::setfill(' ') << "Symbol";
+    out << std::setw(10) << std::left << std::setfill(' ') << "Addend";
+    for (uint32_t j = 0; j < section.relocationCount; ++j)
+    {
+      const ObjectRelocation &relocation = getRelocation(section.relocationIndex + j);
+      out << '\n';
+      out << std::setw(8) << std::right << std::setfill('0') << std::hex << relocation.offset << "  ";
+      out << std::setw(20) << std::left << std::setfill(' ') << getString(relocation.symbol);
+      out << std::setw(10) << std::left << std::setfill(' ') << std::dec << relocation.addend;
+    }
+  }
+}
+
+static bool parseNumber(const std::string &word, int base, uint32_t &value)
+{
+  char *end;
+  unsigned long number = std::strtoul(word.c_str(), &end, base);
+  if (word.empty() || *end != '\0' || number > 0xFFFFFFFF)
+  {
+    return false;
+  }
+  value = number;
+  return true;
+}
+
+static bool isHeading(const std::string &word)
+{
+  return word.substr(0, 2) == "#.";
+}
+
+// Reads the text dump back into the binary format. Words are separated by whitespace, the
+// symbol table ends at the first section heading and the sections at the first #.rela. table.
+bool ObjectFile::convertText(std::istream &input)
+{
+  ObjectWriter writer;
+  std::string word;
+  while (word != "Name")
+  {
+    if (!(input >> word))
+    {
+      return false;
+    }
+  }
+
+  bool more = true;
+  while ((more = (bool)(input >> word)) && !isHeading(word))
+  {
+    uint32_t value;
+    uint32_t symbolSize;
+    std::string type;
+    std::string scope;
+    std::string section;
+    std::string name;
+    if (!parseNumber(word, 16, value) || !(input >> word) || !parseNumber(word, 16, symbolSize) ||
+        symbolSize > 0xFFFF || !(input >> type >> scope >> section >> name))
+    {
+      return false;
+    }
+    Symbol symbol = {value, (uint16_t)symbolSize, SymbolType::NOTYPE, ScopeType::LOCAL, section};
+    if (type == "SECTION")
+    {
+      symbol.type = SymbolType::SECTION;
+    }
+    else if (type != "NOTYPE")
+    {
+      return false;
+    }
+    if (scope == "GLOBAL")
+    {
+      symbol.scope = ScopeType::GLOBAL;
+    }
+    else if (scope != "LOCAL")
+    {
+      return false;
+    }
+    writer.addSymbol(name, symbol);
+  }
+
+  // The writer doesn't copy the bytes, they are kept here until the file is built
+  std::deque<std::vector<uint8_t>> sectionData;
+  std::unordered_map<std::string, uint32_t> sectionIndex;
+  while (more && word.substr(0, 7) != "#.rela.")
+  {
+    std::string name = word.substr(2);
+    sectionData.emplace_back();
+    while ((more = (bool)(input >> word)) && !isHeading(word))
+    {
+      uint32_t byte;
+      if (!parseNumber(word, 16, byte) || byte > 0xFF)
+      {
+        return false;
+      }
+      sectionData.back().push_back(byte);
+    }
+    sectionIndex[name] = writer.addSection(name, sectionData.back().data(), sectionData.back().size());
+  }
+
+  while (more)
+  {
+    auto section = sectionIndex.find(word.substr(7));
+    if (section == sectionIndex.end() || !(input >> word >> word >> word)) // Offset Symbol Addend
+    {
+      return false;
+    }
+    while ((more = (bool)(input >> word)) && !isHeading(word))
+    {
+      Relocation relocation;
+      if (!parseNumber(word, 16, relocation.offset) || !(input >> relocation.symbolName >> word) ||
+          !parseNumber(word, 10, relocation.addend))
+      {
+        return false;
+      }
+      writer.addRelocation(section->second, relocation);
+    }
+    if (more && word.substr(0, 7) != "#.rela.")
+    {
+      return false;
+    }
+  }
+
+  buffer = writer.build();
+  data = buffer.data();
+  size = buffer.size();
+  if (isValid())
+  {
+    return true;
+  }
+  unload();
+  return false;
+}
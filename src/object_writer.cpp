@@ -0,0 +1,156 @@
+#include "../inc/object_writer.hpp"
+#include "../inc/object_file.hpp"
+#include <unordered_map>
+
+uint32_t ObjectWriter::addSection(const std::string &name, const uint8_t *data, uint32_t size)
+{
+  sections.push_back({name, data, size, {}});
+  return sections.size() - 1;
+}
+
+void ObjectWriter::addRelocation(uint32_t section, const Relocation &relocation)
+{
+  sections[section].relocations.push_back(relocation);
+}
+
+void ObjectWriter::addSymbol(const std::string &name, const Symbol &symbol)
+{
+  symbols.push_back({name, symbol});
+}
+
+static void appendWord(std::string &out, uint32_t word)
+{
+  char bytes[4] = {(char)(word & 0xFF), (char)((word >> 8) & 0xFF), (char)((word >> 16) & 0xFF), (char)((word >> 24) & 0xFF)};
+  out.append(bytes, 4);
+}
+
+static void appendHalf(std::string &out, uint16_t half)
+{
+  char bytes[2] = {(char)(half & 0xFF), (char)((half >> 8) & 0xFF)};
+  out.append(bytes, 2);
+}
+
+static uint32_t alignWord(uint32_t offset)
+{
+  return (offset + 3) & ~3u;
+}
+
+// Everything up to the section data
+std::string ObjectWriter::buildTables() const
+{
+  std::string strings;
+  std::unordered_map<std::string, uint32_t> stringOffsets;
+  auto intern = [&](const std::string &value)
+  {
+    auto it = stringOffsets.find(value);
+    if (it != stringOffsets.end())
+    {
+      return it->second;
+    }
+    uint32_t offset = strings.size();
+    strings.append(value);
+    strings.push_back('\0');
+    stringOffsets[value] = offset;
+    return offset;
+  };
+  for (const auto &symbol : symbols)
+  {
+    intern(symbol.first);
+    intern(symbol.second.section);
+  }
+  for (const auto &section : sections)
+  {
+    intern(section.name);
+  }
+  uint32_t relocationCount = 0;
+  for (const auto &section : sections)
+  {
+    for (const auto &relocation : section.relocations)
+    {
+      intern(relocation.symbolName);
+    }
+    relocationCount += section.relocations.size();
+  }
+  strings.resize(alignWord(strings.size()), '\0');
+
+  ObjectFileHeader header;
+  header.magic = OBJECT_FILE_MAGIC;
+  header.version = OBJECT_FILE_VERSION;
+  header.sectionCount = sections.size();
+  header.sectionOffset = sizeof(ObjectFileHeader);
+  header.symbolCount = symbols.size();
+  header.symbolOffset = header.sectionOffset + header.sectionCount * sizeof(ObjectSection);
+  header.relocationCount = relocationCount;
+  header.relocationOffset = header.symbolOffset + header.symbolCount * sizeof(ObjectSymbol);
+  header.stringTableOffset = header.relocationOffset + header.relocationCount * sizeof(ObjectRelocation);
+  header.stringTableSize = strings.size();
+
+  std::string out;
+  out.reserve(header.stringTableOffset + header.stringTableSize);
+  appendWord(out, header.magic);
+  appendWord(out, header.version);
+  appendWord(out, header.sectionCount);
+  appendWord(out, header.sectionOffset);
+  appendWord(out, header.symbolCount);
+  appendWord(out, header.symbolOffset);
+  appendWord(out, header.relocationCount);
+  appendWord(out, header.relocationOffset);
+  appendWord(out, header.stringTableOffset);
+  appendWord(out, header.stringTableSize);
+
+  uint32_t dataOffset = header.stringTableOffset + header.stringTableSize;
+  uint32_t relocationIndex = 0;
+  for (const auto &section : sections)
+  {
+    appendWord(out, stringOffsets[section.name]);
+    appendWord(out, dataOffset);
+    appendWord(out, section.size);
+    appendWord(out, relocationIndex);
+    appendWord(out, section.relocations.size());
+    dataOffset += alignWord(section.size);
+    relocationIndex += section.relocations.size();
+  }
+  for (const auto &symbol : symbols)
+  {
+    appendWord(out, symbol.second.value);
+    appendWord(out, stringOffsets[symbol.first]);
+    appendWord(out, stringOffsets[symbol.second.section]);
+    appendHalf(out, symbol.second.size);
+    out.push_back((char)symbol.second.type);
+    out.push_back((char)symbol.second.scope);
+  }
+  for (const auto &section : sections)
+  {
+    for (const auto &relocation : section.relocations)
+    {
+      appendWord(out, relocation.offset);
+      appendWord(out, stringOffsets[relocation.symbolName]);
+      appendWord(out, relocation.addend);
+    }
+  }
+  out.append(strings);
+  return out;
+}
+
+std::string ObjectWriter::build() const
+{
+  std::string out = buildTables();
+  for (const auto &section : sections)
+  {
+    out.append(reinterpret_cast<const char *>(section.data), section.size);
+    out.resize(alignWord(out.size()), '\0');
+  }
+  return out;
+}
+
+void ObjectWriter::write(std::ostream &out) const
+{
+  static const char padding[4] = {};
+  std::string tables = buildTables();
+  out.write(tables.data(), tables.size());
+  for (const auto &section : sections)
+  {
+    out.write(reinterpret_cast<const char *>(section.data), section.size);
+    out.write(padding, alignWord(section.size) - section.size);
+  }
+}
@@ -0,0 +1,239 @@
+#include "../inc/profiler.hpp"
+#include "../inc/symbol_map.hpp"
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+Profiler::Profiler()
+{
+  pageTable = static_cast<Counters **>(calloc(Memory::PAGE_COUNT, sizeof(Counters *)));
+  if (!pageTable)
+  {
+    throw std::bad_alloc();
+  }
+  memset(operationCounts, 0, sizeof(operationCounts));
+}
+
+Profiler::~Profiler()
+{
+  clear();
+  free(pageTable);
+}
+
+void Profiler::clear()
+{
+  for (const auto &pageNumber : allocatedPages)
+  {
+    free(pageTable[pageNumber]);
+    pageTable[pageNumber] = nullptr;
+  }
+  allocatedPages.clear();
+  memset(operationCounts, 0, sizeof(operationCounts));
+}
+
+Profiler::Counters *Profiler::allocatePage(uint32_t pageNumber)
+{
+  Counters *page = static_cast<Counters *>(calloc(COUNTERS_PER_PAGE, sizeof(Counters)));
+  if (!page)
+  {
+    throw std::bad_alloc();
+  }
+  pageTable[pageNumber] = page;
+  allocatedPages.push_back(pageNumber);
+  return page;
+}
+
+const Profiler::Counters *Profiler::findCounters(uint32_t addr) const
+{
+  const Counters *page = pageTable[addr >> Memory::PAGE_BITS];
+  return page ? &page[(addr & Memory::PAGE_MASK) >> 2] : nullptr;
+}
+
+uint64_t Profiler::getOperationCount(isa::Operation operation) const
+{
+  return operationCounts[(uint32_t)operation];
+}
+
+uint64_t Profiler::getExecutedCount(uint32_t pc) const
+{
+  const Counters *counters = findCounters(pc);
+  return counters ? counters->executed : 0;
+}
+
+uint64_t Profiler::getTakenCount(uint32_t pc) const
+{
+  const Counters *counters = findCounters(pc);
+  return counters ? counters->taken : 0;
+}
+
+static void writePercent(std::ostream &out, uint64_t count, uint64_t total)
+{
+  out << std::fixed << std::setprecision(2) << std::setw(8) << std::right << (total ? 100.0 * count / total : 0.0) << "%";
+}
+
+static void writeLocation(std::ostream &out, const SymbolMap *symbols, uint32_t addr)
+{
+  if (symbols)
+  {
+    out << "  " << symbols->symbolize(addr);
+  }
+  out << std::endl;
+}
+
+void Profiler::writeReport(std::ostream &out, const SymbolMap *symbols) const
+{
+  struct Instruction
+  {
+    uint32_t pc;
+    const Counters *counters;
+  };
+  struct Loop
+  {
+    uint32_t start;
+    uint32_t end;
+    uint64_t iterations;
+    uint64_t instructions;
+  };
+
+  if (symbols && symbols->empty())
+  {
+    symbols = nullptr;
+  }
+
+  // Every executed instruction in address order
+  std::vector<uint32_t> pages = allocatedPages;
+  std::sort(pages.begin(), pages.end());
+  std::vector<Instruction> executed;
+  uint64_t total = 0;
+  for (const auto &pageNumber : pages)
+  {
+    for (uint32_t i = 0; i < COUNTERS_PER_PAGE; ++i)
+    {
+      const Counters *counters = &pageTable[pageNumber][i];
+      if (counters->executed)
+      {
+        executed.push_back({(pageNumber << Memory::PAGE_BITS) | (i << 2), counters});
+        total += counters->executed;
+      }
+    }
+  }
+
+  out << std::setfill(' ') << "Profile: " << std::dec << total << " instructions executed" << std::endl;
+
+  out << std::endl
+      << "Instructions by opcode:" << std::endl;
+  for (uint32_t operation = 0; operation < isa::OPERATION_COUNT; ++operation)
+  {
+    if (operationCounts[operation])
+    {
+      out << "  " << std::setw(16) << std::left << isa::getName((isa::Operation)operation);
+      out << std::setw(14) << std::right << std::dec << operationCounts[operation];
+      writePercent(out, operationCounts[operation], total);
+      out << std::endl;
+    }
+  }
+
+  std::vector<Instruction> hottest = executed;
+  std::stable_sort(hottest.begin(), hottest.end(), [](const Instruction &a, const Instruction &b)
+                   { return a.counters->executed > b.counters->executed; });
+  out << std::endl
+      << "Hottest instructions:" << std::endl;
+  for (uint32_t i = 0; i < hottest.size() && i < REPORT_LENGTH; ++i)
+  {
+    out << "  " << std::setw(8) << std::setfill('0') << std::right << std::hex << hottest[i].pc << std::setfill(' ');
+    out << std::setw(14) << std::dec << hottest[i].counters->executed;
+    writePercent(out, hottest[i].counters->executed, total);
+    writeLocation(out, symbols, hottest[i].pc);
+  }
+
+  out << std::endl
+      << "Branches:" << std::endl;
+  uint32_t branchCount = 0;
+  for (const auto &instruction : hottest)
+  {
+    const Counters *counters = instruction.counters;
+    if (!counters->conditional)
+    {
+      continue;
+    }
+    if (branchCount++ == REPORT_LENGTH)
+    {
+      break;
+    }
+    out << "  " << std::setw(8) << std::setfill('0') << std::right << std::hex << instruction.pc << std::setfill(' ');
+    out << std::setw(14) << std::dec << counters->taken << " taken";
+    out << std::setw(14) << counters->executed - counters->taken << " not taken";
+    writeLocation(out, symbols, instruction.pc);
+  }
+
+  // A taken branch to a lower address closes a loop, its instructions are the ones between
+  // the two addresses, so code called from the loop isn't included
+  std::vector<Loop> loops;
+  for (const auto &instruction : executed)
+  {
+    const Counters *counters = instruction.counters;
+    if (counters->taken && counters->target <= instruction.pc)
+    {
+      Loop loop = {counters->target, instruction.pc, counters->taken, 0};
+      for (uint32_t pc = loop.start; pc <= loop.end && pc >= loop.start; pc += 4)
+      {
+        loop.instructions += getExecutedCount(pc);
+      }
+      loops.push_back(loop);
+    }
+  }
+  std::stable_sort(loops.begin(), loops.end(), [](const Loop &a, const Loop &b)
+                   { return a.instructions > b.instructions; });
+  out << std::endl
+      << "Hottest loops:" << std::endl;
+  for (uint32_t i = 0; i < loops.size() && i < REPORT_LENGTH; ++i)
+  {
+    out << "  " << std::setw(8) << std::setfill('0') << std::right << std::hex << loops[i].start;
+    out << "-" << std::setw(8) << loops[i].end << std::setfill(' ');
+    out << std::setw(14) << std::dec << loops[i].instructions;
+    writePercent(out, loops[i].instructions, total);
+    out << std::setw(14) << loops[i].iterations << " iterations";
+    writeLocation(out, symbols, loops[i].start);
+  }
+
+  if (!symbols)
+  {
+    return;
+  }
+
+  // Instructions before the first symbol are left out
+  struct Function
+  {
+    int symbol;
+    uint64_t instructions;
+    uint64_t calls;
+  };
+  std::vector<Function> functions;
+  for (const auto &instruction : executed)
+  {
+    int symbol = symbols->find(instruction.pc);
+    if (symbol < 0)
+    {
+      continue;
+    }
+    if (functions.empty() || functions.back().symbol != symbol)
+    {
+      const Counters *entry = findCounters(symbols->getEntry(symbol).address);
+      functions.push_back({symbol, 0, entry ? entry->calls : 0});
+    }
+    functions.back().instructions += instruction.counters->executed;
+  }
+  std::stable_sort(functions.begin(), functions.end(), [](const Function &a, const Function &b)
+                   { return a.instructions > b.instructions; });
+  out << std::endl
+      << "Hottest functions:" << std::endl;
+  for (uint32_t i = 0; i < functions.size() && i < REPORT_LENGTH; ++i)
+  {
+    out << "  " << std::setw(16) << std::left << symbols->getEntry(functions[i].symbol).name << std::right;
+    out << std::setw(14) << std::dec << functions[i].instructions;
+    writePercent(out, functions[i].instructions, total);
+    out << std::setw(14) << functions[i].calls << " calls" << std::endl;
+  }
+}
@@ -0,0 +1,21 @@
+#include "../inc/string_pool.hpp"
+
+StringId StringPool::intern(const std::string &value)
+{
+  auto result = ids.emplace(value, values.size());
+  if (result.second)
+  {
+    values.push_back(value);
+  }
+  return result.first->second;
+}
+
+const std::string &StringPool::get(StringId id) const
+{
+  return values[id];
+}
+
+uint32_t StringPool::size() const
+{
+  return values.size();
+}
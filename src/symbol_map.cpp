@@ -0,0 +1,80 @@
+#include "../inc/symbol_map.hpp"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+bool SymbolMap::load(const std::string &mapFileName)
+{
+  std::ifstream input(mapFileName);
+  if (!input.is_open())
+  {
+    return false;
+  }
+  return load(input);
+}
+
+bool SymbolMap::load(std::istream &input)
+{
+  std::string address;
+  std::string name;
+  while (input >> address >> name)
+  {
+    size_t end = 0;
+    unsigned long value = 0;
+    try
+    {
+      value = std::stoul(address, &end, 16);
+    }
+    catch (const std::logic_error &)
+    {
+    }
+    if (!end || end != address.size() || value > 0xFFFFFFFF)
+    {
+      entries.clear();
+      return false;
+    }
+    entries.push_back({(uint32_t)value, name});
+  }
+  if (!input.eof())
+  {
+    entries.clear();
+    return false;
+  }
+  std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b)
+                   { return a.address < b.address; });
+  return true;
+}
+
+bool SymbolMap::empty() const
+{
+  return entries.empty();
+}
+
+int SymbolMap::find(uint32_t addr) const
+{
+  auto next = std::upper_bound(entries.begin(), entries.end(), addr, [](uint32_t addr, const Entry &entry)
+                               { return addr < entry.address; });
+  return (int)(next - entries.begin()) - 1;
+}
+
+const SymbolMap::Entry &SymbolMap::getEntry(int index) const
+{
+  return entries[index];
+}
+
+std::string SymbolMap::symbolize(uint32_t addr) const
+{
+  std::ostringstream out;
+  int index = find(addr);
+  if (index < 0)
+  {
+    out << std::hex << addr;
+    return out.str();
+  }
+  out << entries[index].name;
+  if (addr != entries[index].address)
+  {
+    out << "+0x" << std::hex << addr - entries[index].address;
+  }
+  return out.str();
+}
@@ -0,0 +1,96 @@
+#include "../inc/terminal.hpp"
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+
+Terminal::Terminal(std::ostream &out) : out(out), outputSize(0), inputFd(-1), restoreTty(false)
+{
+  wakePipe[0] = -1;
+  wakePipe[1] = -1;
+}
+
+Terminal::~Terminal()
+{
+  if (inputThread.joinable())
+  {
+    char wake = 0;
+    if (::write(wakePipe[1], &wake, 1) < 0)
+    {
+      inputThread.detach();
+    }
+    else
+    {
+      inputThread.join();
+    }
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+  }
+  if (restoreTty)
+  {
+    tcsetattr(inputFd, TCSANOW, &savedTty);
+  }
+  flush();
+}
+
+void Terminal::startInput(int fd)
+{
+  if (inputThread.joinable() || pipe(wakePipe) < 0)
+  {
+    return;
+  }
+  inputFd = fd;
+  if (isatty(fd) && tcgetattr(fd, &savedTty) == 0)
+  {
+    struct termios tty = savedTty;
+    tty.c_lflag &= ~(ICANON | ECHO);
+    tty.c_cc[VMIN] = 1;
+    tty.c_cc[VTIME] = 0;
+    restoreTty = tcsetattr(fd, TCSANOW, &tty) == 0;
+  }
+  inputThread = std::thread(&Terminal::readInputLoop, this, fd);
+}
+
+void Terminal::readInputLoop(int fd)
+{
+  struct pollfd fds[2] = {{fd, POLLIN, 0}, {wakePipe[0], POLLIN, 0}};
+  while (true)
+  {
+    if (poll(fds, 2, -1) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return;
+    }
+    if (fds[1].revents)
+    {
+      return;
+    }
+    if (!fds[0].revents)
+    {
+      continue;
+    }
+    uint8_t characters[64];
+    ssize_t count = read(fd, characters, sizeof(characters));
+    if (count <= 0)
+    {
+      return;
+    }
+    // Like a real device, input that arrives while the ring is full is lost
+    for (ssize_t i = 0; i < count; ++i)
+    {
+      input.push(characters[i]);
+    }
+  }
+}
+
+void Terminal::flush()
+{
+  if (outputSize)
+  {
+    out.write(outputBuffer, outputSize);
+    out.flush();
+    outputSize = 0;
+  }
+}
@@ -0,0 +1,95 @@
+#include "../inc/trace_writer.hpp"
+
+TraceWriter::TraceWriter(std::ostream &out) : out(out), size(0)
+{
+}
+
+TraceWriter::~TraceWriter()
+{
+  flush();
+}
+
+TraceWriter &TraceWriter::text(const char *text)
+{
+  while (*text)
+  {
+    reserve();
+    for (uint32_t i = 0; *text && i < MAX_PIECE_SIZE; ++i)
+    {
+      buffer[size++] = *text++;
+    }
+  }
+  return *this;
+}
+
+TraceWriter &TraceWriter::reg(uint8_t index)
+{
+  reserve();
+  buffer[size++] = '%';
+  buffer[size++] = 'r';
+  if (index >= 10)
+  {
+    buffer[size++] = '1';
+    index -= 10;
+  }
+  buffer[size++] = '0' + index;
+  return *this;
+}
+
+TraceWriter &TraceWriter::hex(uint32_t value)
+{
+  static const char digits[] = "0123456789abcdef";
+  reserve();
+  buffer[size++] = '0';
+  buffer[size++] = 'x';
+  int shift = 28;
+  while (shift > 0 && !(value >> shift))
+  {
+    shift -= 4;
+  }
+  for (; shift >= 0; shift -= 4)
+  {
+    buffer[size++] = digits[(value >> shift) & 0xF];
+  }
+  return *this;
+}
+
+TraceWriter &TraceWriter::dec(int32_t value)
+{
+  reserve();
+  uint32_t magnitude = value;
+  if (value < 0)
+  {
+    buffer[size++] = '-';
+    magnitude = -static_cast<uint32_t>(value);
+  }
+  char digits[10];
+  uint32_t count = 0;
+  do
+  {
+    digits[count++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+  while (count)
+  {
+    buffer[size++] = digits[--count];
+  }
+  return *this;
+}
+
+TraceWriter &TraceWriter::endLine()
+{
+  reserve();
+  buffer[size++] = '\n';
+  return *this;
+}
+
+void TraceWriter::flush()
+{
+  if (size)
+  {
+    out.write(buffer, size);
+    out.flush();
+    size = 0;
+  }
+}
@@ -0,0 +1,54 @@
+#include "../inc/emulator.hpp"
+#include "../inc/terminal.hpp"
+#include "../inc/translated_program.hpp"
+#include <sstream>
+#include <memory>
+#include <unistd.h>
+
+// Entry point of a translated program, runs the image it embeds like the emulator would.
+// --interpret leaves the translated code out, for comparing against it.
+int main(int argc, char **argv)
+{
+  bool interpret = false;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--interpret")
+    {
+      interpret = true;
+    }
+    else
+    {
+      std::cout << "Invalid command." << std::endl;
+      return 1;
+    }
+  }
+
+  std::unique_ptr<TranslatedProgram> program(createTranslatedProgram());
+  EmulatorCore core;
+  Terminal terminal(std::cout);
+  terminal.startInput(STDIN_FILENO);
+  core.setTerminal(&terminal);
+
+  std::istringstream image(program->getImage());
+  if (!core.load(image))
+  {
+    std::cout << core.getStopMessage() << std::endl;
+    return 1;
+  }
+  if (!interpret)
+  {
+    core.setTranslatedProgram(program.get());
+  }
+
+  if (core.run() != StopReason::HALT)
+  {
+    std::cout << "Emulator error. " << core.getStopMessage() << std::endl;
+    return 1;
+  }
+
+  std::cout << "Emulated processor executed halt instruction" << std::endl;
+  std::cout << "Emulated processor state:" << std::endl;
+  core.printState(std::cout);
+  return 0;
+}
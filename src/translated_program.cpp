@@ -0,0 +1,58 @@
+#include "../inc/translated_program.hpp"
+#include <algorithm>
+
+TranslatedProgram::TranslatedProgram(const std::string &image, const CoveredWord *coveredWords,
+                                     size_t coveredWordCount, uint32_t blockCount)
+    : mem(nullptr), r(nullptr), csr(nullptr), blockValid(blockCount, 1), exitRequested(false), image(image),
+      coveredWords(coveredWords, coveredWords + coveredWordCount), codePages(Memory::PAGE_COUNT, 0),
+      writeHandler(nullptr), writeContext(nullptr)
+{
+  for (const auto &word : this->coveredWords)
+  {
+    codePages[word.addr >> Memory::PAGE_BITS] = 1;
+  }
+}
+
+TranslatedProgram::~TranslatedProgram()
+{
+}
+
+void TranslatedProgram::attach(Memory &mem, uint32_t *r, uint32_t *csr, WriteHandler writeWord, void *writeContext)
+{
+  this->mem = &mem;
+  this->r = r;
+  this->csr = csr;
+  writeHandler = writeWord;
+  this->writeContext = writeContext;
+}
+
+void TranslatedProgram::invalidate(uint32_t addr)
+{
+  addr &= ~0x3u;
+  if (!codePages[addr >> Memory::PAGE_BITS])
+  {
+    return;
+  }
+  auto range = std::equal_range(coveredWords.begin(), coveredWords.end(), CoveredWord{addr, 0},
+                                [](const CoveredWord &a, const CoveredWord &b)
+                                { return a.addr < b.addr; });
+  for (auto word = range.first; word != range.second; ++word)
+  {
+    if (blockValid[word->block])
+    {
+      blockValid[word->block] = 0;
+      // The running block may be one of them
+      exitRequested = true;
+    }
+  }
+}
+
+void TranslatedProgram::requestExit()
+{
+  exitRequested = true;
+}
+
+const std::string &TranslatedProgram::getImage() const
+{
+  return image;
+}
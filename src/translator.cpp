@@ -0,0 +1,626 @@
+#include "../inc/translator.hpp"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+static std::string hex(uint32_t value)
+{
+  std::ostringstream text;
+  text << "0x" << std::hex << std::setw(8) << std::setfill('0') << value << "u";
+  return text.str();
+}
+
+static std::string reg(uint8_t index)
+{
+  return "r" + std::to_string(index);
+}
+
+// " + disp" as an unsigned offset, empty for 0
+static std::string offset(int32_t disp)
+{
+  if (disp == 0)
+  {
+    return "";
+  }
+  return (disp < 0 ? " - " : " + ") + std::to_string(disp < 0 ? -disp : disp) + "u";
+}
+
+static std::string label(uint32_t addr)
+{
+  std::ostringstream text;
+  text << "block_" << std::hex << std::setw(8) << std::setfill('0') << addr;
+  return text.str();
+}
+
+Translator::Translator() : mem(nullptr)
+{
+}
+
+bool Translator::load(const std::string &inputFileName)
+{
+  std::ifstream input(inputFileName, std::ios::binary);
+  if (!input.is_open())
+  {
+    return false;
+  }
+  image.assign((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+  std::istringstream imageInput(image);
+  if (!core.load(imageInput))
+  {
+    return false;
+  }
+  mem = &core.getMemory();
+  return true;
+}
+
+// Halt, int and invalid instructions are left to the interpreter
+bool Translator::isTranslatable(const DecodedInstruction &instruction)
+{
+  switch (instruction.operation)
+  {
+  case isa::Operation::HALT:
+  case isa::Operation::INT:
+  case isa::Operation::INVALID_MODIFIER:
+  case isa::Operation::INVALID_OPCODE:
+    return false;
+  default:
+    return true;
+  }
+}
+
+// One bit for every register the instruction writes, calls and branches write only pc
+uint16_t Translator::getWrittenRegisters(const DecodedInstruction &instruction)
+{
+  switch (instruction.operation)
+  {
+  case isa::Operation::CALL:
+  case isa::Operation::JMP:
+  case isa::Operation::BEQ:
+  case isa::Operation::BNE:
+  case isa::Operation::BGT:
+    return 1 << 15;
+  case isa::Operation::XCHG:
+    return (1 << instruction.regB) | (1 << instruction.regC);
+  case isa::Operation::PUSH:
+  case isa::Operation::ADD:
+  case isa::Operation::SUB:
+  case isa::Operation::MUL:
+  case isa::Operation::DIV:
+  case isa::Operation::NOT:
+  case isa::Operation::AND:
+  case isa::Operation::OR:
+  case isa::Operation::XOR:
+  case isa::Operation::SHL:
+  case isa::Operation::SHR:
+  case isa::Operation::CSR_READ:
+  case isa::Operation::ADD_DISP:
+  case isa::Operation::LOAD:
+    return 1 << instruction.regA;
+  case isa::Operation::POP:
+    return (1 << instruction.regA) | (1 << instruction.regB);
+  case isa::Operation::POP_CSR:
+    return 1 << instruction.regB;
+  default:
+    return 0;
+  }
+}
+
+bool Translator::isBlockEnd(const DecodedInstruction &instruction)
+{
+  return getWrittenRegisters(instruction) & (1 << 15);
+}
+
+bool Translator::isLoaded(uint32_t addr) const
+{
+  return mem->getPage(addr >> Memory::PAGE_BITS);
+}
+
+// The word read from a literal pool, at an address made only of pc, r0 and the displacement.
+// Calls, branches, ld and st mem[x] read one.
+bool Translator::getLiteral(const DecodedInstruction &instruction, uint32_t pc, uint32_t &addr, uint32_t &value) const
+{
+  uint8_t regA;
+  uint8_t regB;
+  switch (instruction.operation)
+  {
+  case isa::Operation::CALL:
+  case isa::Operation::STORE_INDIRECT:
+    regA = instruction.regA;
+    regB = instruction.regB;
+    break;
+  case isa::Operation::JMP:
+  case isa::Operation::BEQ:
+  case isa::Operation::BNE:
+  case isa::Operation::BGT:
+    regA = instruction.regA;
+    regB = 0;
+    break;
+  case isa::Operation::LOAD:
+    regA = instruction.regB;
+    regB = instruction.regC;
+    break;
+  default:
+    return false;
+  }
+  if ((regA != 0 && regA != 15) || (regB != 0 && regB != 15))
+  {
+    return false;
+  }
+  addr = (regA == 15 ? pc + 4 : 0) + (regB == 15 ? pc + 4 : 0) + instruction.disp;
+  if (addr >= EmulatorCore::MMIO_START - 3 || !isLoaded(addr) || !isLoaded(addr + 3))
+  {
+    return false;
+  }
+  value = mem->readWord(addr);
+  return true;
+}
+
+void Translator::addLeader(uint32_t addr)
+{
+  if (!(addr & 0x3) && isLoaded(addr) && leaders.insert(addr).second)
+  {
+    pending.push_back(addr);
+  }
+}
+
+// Follows the instructions from pc to the end of the block, adding every target it finds
+void Translator::explore(uint32_t pc)
+{
+  // Registers loaded from a literal pool, for the handler address given to csrwr
+  uint32_t literals[16];
+  uint16_t knownLiterals = 0;
+  while (isLoaded(pc) && explored.insert(pc).second)
+  {
+    DecodedInstruction instruction = EmulatorCore::decodeInstruction(mem->readWord(pc));
+    if (!isTranslatable(instruction))
+    {
+      // An interrupt returns right after int
+      if (instruction.operation == isa::Operation::INT)
+      {
+        addLeader(pc + 4);
+      }
+      return;
+    }
+    uint32_t addr;
+    uint32_t value;
+    bool isLiteral = getLiteral(instruction, pc, addr, value);
+    switch (instruction.operation)
+    {
+    case isa::Operation::CALL:
+      if (isLiteral)
+      {
+        addLeader(value);
+      }
+      addLeader(pc + 4);
+      return;
+    case isa::Operation::JMP:
+    case isa::Operation::BEQ:
+    case isa::Operation::BNE:
+    case isa::Operation::BGT:
+      if (isLiteral)
+      {
+        addLeader(value);
+      }
+      if (instruction.operation != isa::Operation::JMP)
+      {
+        addLeader(pc + 4);
+      }
+      return;
+    case isa::Operation::CSR_WRITE:
+      if (instruction.regA == 1 && (knownLiterals & (1 << instruction.regB)))
+      {
+        addLeader(literals[instruction.regB]);
+      }
+      break;
+    default:
+      break;
+    }
+    uint16_t written = getWrittenRegisters(instruction);
+    knownLiterals &= ~written;
+    if (isLiteral && instruction.operation == isa::Operation::LOAD)
+    {
+      literals[instruction.regA] = value;
+      knownLiterals |= 1 << instruction.regA;
+    }
+    if (written & (1 << 15))
+    {
+      return;
+    }
+    pc += 4;
+  }
+}
+
+void Translator::translate(uint32_t entry)
+{
+  addLeader(entry);
+  while (!pending.empty())
+  {
+    uint32_t pc = pending.back();
+    pending.pop_back();
+    explore(pc);
+  }
+
+  // Blocks end at the next leader, leaders added here come after the current one
+  for (auto leader = leaders.begin(); leader != leaders.end(); ++leader)
+  {
+    Block block{*leader, 0, {}};
+    uint32_t pc = *leader;
+    while (isLoaded(pc))
+    {
+      DecodedInstruction instruction = EmulatorCore::decodeInstruction(mem->readWord(pc));
+      if (!isTranslatable(instruction))
+      {
+        break;
+      }
+      block.coveredWords.push_back(pc);
+      uint32_t addr;
+      uint32_t value;
+      if (getLiteral(instruction, pc, addr, value))
+      {
+        block.coveredWords.push_back(addr & ~0x3u);
+        block.coveredWords.push_back((addr + 3) & ~0x3u);
+      }
+      ++block.length;
+      pc += 4;
+      if (isBlockEnd(instruction) || leaders.count(pc))
+      {
+        break;
+      }
+      if (block.length == MAX_BLOCK_INSTRUCTIONS)
+      {
+        leaders.insert(pc);
+        break;
+      }
+    }
+    if (block.length)
+    {
+      blockIndex[block.start] = blocks.size();
+      blocks.push_back(block);
+    }
+  }
+}
+
+uint32_t Translator::getBlockCount() const
+{
+  return blocks.size();
+}
+
+uint32_t Translator::getInstructionCount() const
+{
+  uint32_t count = 0;
+  for (const auto &block : blocks)
+  {
+    count += block.length;
+  }
+  return count;
+}
+
+// Continues at target, through a goto if it has a block
+void Translator::writeJump(std::ostream &out, const std::string &indent, uint32_t target) const
+{
+  if (blockIndex.count(target))
+  {
+    out << indent << "goto " << label(target) << ";" << std::endl;
+    return;
+  }
+  out << indent << "pc = " << hex(target) << ";" << std::endl;
+  out << indent << "goto leave;" << std::endl;
+}
+
+void Translator::writeInstruction(std::ostream &out, const Block &block, uint32_t pc, uint32_t index) const
+{
+  DecodedInstruction instruction = EmulatorCore::decodeInstruction(mem->readWord(pc));
+  std::string a = reg(instruction.regA);
+  std::string b = reg(instruction.regB);
+  std::string c = reg(instruction.regC);
+  std::string disp = offset(instruction.disp);
+  uint32_t literalAddr;
+  uint32_t literal;
+  bool isLiteral = getLiteral(instruction, pc, literalAddr, literal);
+  bool isLast = index + 1 == block.length;
+
+  std::ostringstream body;
+  bool stores = false;
+  switch (instruction.operation)
+  {
+  case isa::Operation::CALL:
+    body << "  r14 = r14 - 4u;" << std::endl;
+    body << "  mustExit = writeWord(r14, r15);" << std::endl;
+    stores = true;
+    if (!isLiteral)
+    {
+      body << "  r15 = readWord(" << a << " + " << b << disp << ");" << std::endl;
+    }
+    break;
+  case isa::Operation::XCHG:
+    body << "  temp = " << b << ";" << std::endl;
+    body << "  " << b << " = " << c << ";" << std::endl;
+    body << "  " << c << " = temp;" << std::endl;
+    break;
+  case isa::Operation::NOT:
+    body << "  " << a << " = ~" << b << ";" << std::endl;
+    break;
+  case isa::Operation::ADD:
+  case isa::Operation::SUB:
+  case isa::Operation::MUL:
+  case isa::Operation::DIV:
+  case isa::Operation::AND:
+  case isa::Operation::OR:
+  case isa::Operation::XOR:
+  {
+    static const char *const operators[] = {"+", "-", "*", "/", "~", "&", "|", "^"};
+    const char *op = operators[(uint32_t)instruction.operation - (uint32_t)isa::Operation::ADD];
+    body << "  " << a << " = " << b << " " << op << " " << c << ";" << std::endl;
+    break;
+  }
+  // Shift counts are taken modulo 32 like the host does for the interpreter
+  case isa::Operation::SHL:
+  case isa::Operation::SHR:
+    body << "  " << a << " = " << b << (instruction.operation == isa::Operation::SHL ? " << " : " >> ") << "(" << c
+         << " & 31u);" << std::endl;
+    break;
+  case isa::Operation::STORE:
+    body << "  mustExit = writeWord(" << a << " + " << b << disp << ", " << c << ");" << std::endl;
+    stores = true;
+    break;
+  case isa::Operation::PUSH:
+    body << "  " << a << " = " << a << offset(-instruction.disp) << ";" << std::endl;
+    body << "  mustExit = writeWord(" << a << ", " << c << ");" << std::endl;
+    stores = true;
+    break;
+  case isa::Operation::STORE_INDIRECT:
+    if (isLiteral)
+    {
+      body << "  mustExit = writeWord(" << hex(literal) << ", " << c << ");" << std::endl;
+    }
+    else
+    {
+      body << "  mustExit = writeWord(readWord(" << a << " + " << b << disp << "), " << c << ");" << std::endl;
+    }
+    stores = true;
+    break;
+  case isa::Operation::CSR_READ:
+    body << "  " << a << " = csr[" << (int)instruction.regB << "];" << std::endl;
+    break;
+  case isa::Operation::ADD_DISP:
+    body << "  " << a << " = " << b << disp << ";" << std::endl;
+    break;
+  case isa::Operation::LOAD:
+    if (isLiteral)
+    {
+      body << "  " << a << " = " << hex(literal) << ";" << std::endl;
+    }
+    else
+    {
+      body << "  " << a << " = readWord(" << b << " + " << c << disp << ");" << std::endl;
+    }
+    break;
+  case isa::Operation::POP:
+    body << "  " << a << " = readWord(" << b << ");" << std::endl;
+    body << "  " << b << " = " << b << disp << ";" << std::endl;
+    break;
+  case isa::Operation::CSR_WRITE:
+    body << "  csr[" << (int)instruction.regA << "] = " << b << ";" << std::endl;
+    break;
+  case isa::Operation::POP_CSR:
+    body << "  csr[" << (int)instruction.regA << "] = readWord(" << b << ");" << std::endl;
+    body << "  " << b << " = " << b << disp << ";" << std::endl;
+    break;
+  default:
+    // Branches are written after the body
+    break;
+  }
+
+  const char *name = isa::getName(instruction.operation);
+  out << "  // " << std::hex << std::setw(8) << std::setfill('0') << pc << std::dec << ": " << name << std::endl;
+
+  // Reads of pc see the address of the next instruction
+  std::string text = body.str();
+  std::string reads = text;
+  for (size_t write = reads.find("  r15 = "); write != std::string::npos; write = reads.find("  r15 = "))
+  {
+    reads.erase(write, 8);
+  }
+  bool readsPc = reads.find("r15") != std::string::npos;
+  bool isBranch = instruction.operation >= isa::Operation::JMP && instruction.operation <= isa::Operation::BGT;
+  if (isBranch)
+  {
+    readsPc = (!isLiteral && instruction.regA == 15) ||
+              (instruction.operation != isa::Operation::JMP && (instruction.regB == 15 || instruction.regC == 15));
+  }
+  if (readsPc)
+  {
+    out << "  r15 = " << hex(pc + 4) << ";" << std::endl;
+  }
+  out << text;
+  uint16_t written = getWrittenRegisters(instruction);
+  if (written & 1)
+  {
+    out << "  r0 = 0;" << std::endl;
+  }
+  bool jumps = written & (1 << 15);
+
+  if (stores)
+  {
+    out << "  if (mustExit)" << std::endl;
+    out << "  {" << std::endl;
+    if (!isLast)
+    {
+      out << "    budget += " << block.length - index - 1 << ";" << std::endl;
+    }
+    if (instruction.operation == isa::Operation::CALL && isLiteral)
+    {
+      out << "    pc = " << hex(literal) << ";" << std::endl;
+    }
+    else
+    {
+      out << "    pc = " << (jumps ? std::string("r15") : hex(pc + 4)) << ";" << std::endl;
+    }
+    out << "    goto leave;" << std::endl;
+    out << "  }" << std::endl;
+  }
+
+  if (instruction.operation == isa::Operation::CALL && isLiteral)
+  {
+    writeJump(out, "  ", literal);
+  }
+  else if (isBranch)
+  {
+    static const char *const conditions[] = {"==", "!=", ">"};
+    std::string target = "readWord(" + a + disp + ")";
+    if (instruction.operation == isa::Operation::JMP)
+    {
+      if (isLiteral)
+      {
+        writeJump(out, "  ", literal);
+      }
+      else
+      {
+        out << "  pc = " << target << ";" << std::endl;
+        out << "  goto dispatch;" << std::endl;
+      }
+      return;
+    }
+    out << "  if (" << b << " " << conditions[(uint32_t)instruction.operation - (uint32_t)isa::Operation::BEQ] << " " << c << ")" << std::endl;
+    out << "  {" << std::endl;
+    if (isLiteral)
+    {
+      writeJump(out, "    ", literal);
+    }
+    else
+    {
+      out << "    pc = " << target << ";" << std::endl;
+      out << "    goto dispatch;" << std::endl;
+    }
+    out << "  }" << std::endl;
+    writeJump(out, "  ", pc + 4);
+  }
+  else if (jumps)
+  {
+    out << "  pc = r15;" << std::endl;
+    out << "  goto dispatch;" << std::endl;
+  }
+  else if (isLast)
+  {
+    writeJump(out, "  ", pc + 4);
+  }
+}
+
+void Translator::writeBlock(std::ostream &out, const Block &block) const
+{
+  out << label(block.start) << ":" << std::endl;
+  out << "  if (budget < " << block.length << " || !blockValid[" << blockIndex.at(block.start) << "])" << std::endl;
+  out << "  {" << std::endl;
+  out << "    pc = " << hex(block.start) << ";" << std::endl;
+  out << "    goto leave;" << std::endl;
+  out << "  }" << std::endl;
+  out << "  budget -= " << block.length << ";" << std::endl;
+  for (uint32_t i = 0; i < block.length; ++i)
+  {
+    writeInstruction(out, block, block.start + i * 4, i);
+  }
+  out << std::endl;
+}
+
+void Translator::write(std::ostream &out) const
+{
+  std::vector<std::pair<uint32_t, uint32_t>> coveredWords;
+  for (uint32_t i = 0; i < blocks.size(); ++i)
+  {
+    for (const auto &addr : blocks[i].coveredWords)
+    {
+      coveredWords.push_back({addr, i});
+    }
+  }
+  std::sort(coveredWords.begin(), coveredWords.end());
+  coveredWords.erase(std::unique(coveredWords.begin(), coveredWords.end()), coveredWords.end());
+
+  out << "// Generated by the translator from a linked program image, " << blocks.size() << " blocks and "
+      << getInstructionCount() << " instructions" << std::endl;
+  out << "#include \"translated_program.hpp\"" << std::endl;
+  out << std::endl;
+  out << "namespace" << std::endl;
+  out << "{" << std::endl;
+  out << std::endl;
+
+  out << "const unsigned char programImage[] = {";
+  for (size_t i = 0; i < image.size(); ++i)
+  {
+    out << (i % 16 ? " " : "\n  ") << (unsigned)(uint8_t)image[i] << ",";
+  }
+  out << "\n};" << std::endl;
+  out << std::endl;
+
+  out << "const TranslatedProgram::CoveredWord programCoveredWords[] = {" << std::endl;
+  for (const auto &word : coveredWords)
+  {
+    out << "  {" << hex(word.first) << ", " << word.second << "}," << std::endl;
+  }
+  // A program without blocks still needs an array that isn't empty
+  out << "  {0, 0}," << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+
+  out << "class TranslatedGuest : public TranslatedProgram" << std::endl;
+  out << "{" << std::endl;
+  out << "public:" << std::endl;
+  out << "  TranslatedGuest()" << std::endl;
+  out << "      : TranslatedProgram(std::string((const char *)programImage, sizeof(programImage)), programCoveredWords, "
+      << coveredWords.size() << ", " << blocks.size() << ")" << std::endl;
+  out << "  {" << std::endl;
+  out << "  }" << std::endl;
+  out << std::endl;
+  out << "  uint64_t run(uint64_t maxInstructions) override;" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+
+  out << "uint64_t TranslatedGuest::run(uint64_t maxInstructions)" << std::endl;
+  out << "{" << std::endl;
+  out << "  uint64_t budget = maxInstructions;" << std::endl;
+  out << "  uint32_t pc = r[15];" << std::endl;
+  out << "  uint32_t r0 = 0;" << std::endl;
+  for (uint32_t i = 1; i < 15; ++i)
+  {
+    out << "  uint32_t r" << i << " = r[" << i << "];" << std::endl;
+  }
+  out << "  uint32_t r15;" << std::endl;
+  out << "  uint32_t temp;" << std::endl;
+  out << "  bool mustExit;" << std::endl;
+  out << "  exitRequested = false;" << std::endl;
+  out << std::endl;
+
+  out << "dispatch:" << std::endl;
+  out << "  switch (pc)" << std::endl;
+  out << "  {" << std::endl;
+  for (const auto &block : blocks)
+  {
+    out << "  case " << hex(block.start) << ":" << std::endl;
+    out << "    goto " << label(block.start) << ";" << std::endl;
+  }
+  out << "  default:" << std::endl;
+  out << "    goto leave;" << std::endl;
+  out << "  }" << std::endl;
+  out << std::endl;
+
+  for (const auto &block : blocks)
+  {
+    writeBlock(out, block);
+  }
+
+  out << "leave:" << std::endl;
+  for (uint32_t i = 1; i < 15; ++i)
+  {
+    out << "  r[" << i << "] = r" << i << ";" << std::endl;
+  }
+  out << "  r[15] = pc;" << std::endl;
+  out << "  return maxInstructions - budget;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "TranslatedProgram *createTranslatedProgram()" << std::endl;
+  out << "{" << std::endl;
+  out << "  return new TranslatedGuest();" << std::endl;
+  out << "}" << std::endl;
+}
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "../inc/translator.hpp"
+
+int main(int argc, char **argv)
+{
+  std::string inputFileName;
+  std::string outputFileName;
+  uint32_t entry = EmulatorCore::START_ADDRESS;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "-o" && i + 1 < argc)
+    {
+      outputFileName = argv[++i];
+    }
+    else if (arg.substr(0, 7) == "-entry=")
+    {
+      entry = std::stoul(arg.substr(7), nullptr, 16);
+    }
+    else if (inputFileName.empty())
+    {
+      inputFileName = arg;
+    }
+    else
+    {
+      std::cout << "Invalid command." << std::endl;
+      return 1;
+    }
+  }
+  if (inputFileName.empty() || outputFileName.empty())
+  {
+    std::cout << "Invalid command." << std::endl;
+    return 1;
+  }
+
+  Translator translator;
+  if (!translator.load(inputFileName))
+  {
+    std::cout << "Error reading program image." << std::endl;
+    return 1;
+  }
+  translator.translate(entry);
+
+  std::ofstream output(outputFileName);
+  if (!output.is_open())
+  {
+    std::cout << "Error opening output file." << std::endl;
+    return 1;
+  }
+  translator.write(output);
+  if (!output)
+  {
+    std::cout << "Error writing output file." << std::endl;
+    return 1;
+  }
+  std::cout << "Translated " << translator.getInstructionCount() << " instructions in " << translator.getBlockCount()
+            << " blocks." << std::endl;
+  return 0;
+}
@@ -0,0 +1,24 @@
+ASSEMBLER=assembler
+
+# A million lines in 4000 sections, each with its own literal pool and forward references
+awk 'BEGIN {
+  print ".extern ext"
+  for (s = 0; s < 4000; ++s) {
+    print ".section code" s
+    print "f" s ": ld $0x" sprintf("%x", s * 7919) ", %r1"
+    for (i = 0; i < 41; ++i) {
+      print "  ld [%r1 + " i * 4 "], %r2"
+      print "  add %r2, %r3"
+      print "  st %r3, data" s
+      print "  beq %r2, %r3, next" s
+      print "  push %r2"
+      print "  call f" (s + 1) % 4000
+    }
+    print "next" s ": pop %r2"
+    print "  ret"
+    print "data" s ": .word 0, ext, f" s
+    print "  .skip 16"
+    print "  .ascii \"code" s "\""
+  }
+}' > tests/assembler-bench/lines.s
+time ${ASSEMBLER} -o lines.o assembler-bench/lines.s
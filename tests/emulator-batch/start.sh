@@ -0,0 +1,26 @@
+ASSEMBLER=assembler
+LINKER=linker
+EMULATOR=emulator
+
+for i in 1 2 3 4 5 6; do
+  ${ASSEMBLER} -o test$i.o emulator-tests/test$i.s
+  ${LINKER} -hex \
+    -place=my_code@0x40000000 \
+    -o test$i.hex \
+    test$i.o
+done
+${ASSEMBLER} -o loop.o emulator-bench/loop.s
+${LINKER} -hex \
+  -place=my_code@0x40000000 \
+  -o loop.hex \
+  loop.o
+${EMULATOR} --batch tests/emulator-batch/manifest.txt -j 4
+${EMULATOR} --jit --batch tests/emulator-batch/manifest.txt -j 4
+${ASSEMBLER} -o sweep.o emulator-batch/sweep.s
+${LINKER} -hex \
+  -place=my_code@0x40000000 \
+  -o sweep.hex \
+  sweep.o
+${EMULATOR} --lanes --batch tests/emulator-batch/manifest.txt -j 4
+time ${EMULATOR} --batch tests/emulator-batch/sweep.txt -j 1
+time ${EMULATOR} --lanes --batch tests/emulator-batch/sweep.txt -j 1
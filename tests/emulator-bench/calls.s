@@ -0,0 +1,22 @@
+# Call/return throughput benchmark
+# Executes 3000000 calls to a short subroutine
+
+.section my_code
+
+my_start:
+  ld $0xFFFFFEFE, %sp
+  ld $0, %r1
+  ld $1, %r2
+  ld $3000000, %r3
+loop:
+  call increment
+  bne %r1, %r3, loop
+  halt
+
+increment:
+  push %r4
+  add %r2, %r1
+  pop %r4
+  ret
+
+.end
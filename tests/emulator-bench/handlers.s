@@ -0,0 +1,32 @@
+# Interrupt handler benchmark
+# Raises 1000000 software interrupts, the handler saves registers, updates a counter in
+# memory and returns with iret, the idioms the emulator fuses
+
+.section my_code
+
+my_start:
+  ld $0xFFFFFEFE, %sp
+  ld $handler, %r1
+  csrwr %r1, %handler
+  ld $1000000, %r3
+loop:
+  int
+  ld counter, %r1
+  bne %r1, %r3, loop
+  halt
+
+handler:
+  push %r2
+  push %r4
+  ld counter, %r2
+  ld $1, %r4
+  add %r4, %r2
+  st %r2, counter
+  pop %r4
+  pop %r2
+  iret
+
+counter:
+  .word 0
+
+.end
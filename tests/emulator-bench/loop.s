@@ -0,0 +1,17 @@
+# Instruction throughput benchmark
+# Executes 2 + 3 * 10000000 instructions before halting
+
+.section my_code
+
+my_start:
+  ld $0, %r1
+  ld $1, %r2
+  ld $10000000, %r3
+  ld $0x1000, %r4
+loop:
+  add %r2, %r1
+  st %r1, [%r4]
+  bne %r1, %r3, loop
+  halt
+
+.end
@@ -0,0 +1,14 @@
+ASSEMBLER=assembler
+LINKER=linker
+EMULATOR=emulator
+
+${ASSEMBLER} -o calls.o emulator-bench/calls.s
+${LINKER} -hex \
+  -place=my_code@0x40000000 \
+  -map=calls.map \
+  -o calls.hex \
+  calls.o
+${EMULATOR} --profile --symbols=calls.map calls.hex
+${EMULATOR} --flamegraph=calls.folded --symbols=calls.map calls.hex
+${EMULATOR} --cycles --symbols=calls.map calls.hex
+${EMULATOR} --cycles=calls.cycles --cycle-config=tests/emulator-profile/cycles.cfg calls.hex
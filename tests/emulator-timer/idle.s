@@ -0,0 +1,36 @@
+# file: idle.s
+# Waits for ten timer interrupts in a loop that only polls a counter in memory.
+# The loop makes no stores, so the emulator can skip ahead to every interrupt.
+# Halts with r1 = 10.
+
+.global my_start
+
+.section my_code
+my_start:
+    ld $0xFFFFFEFE, %sp
+    ld $handler, %r1
+    csrwr %r1, %handler
+    ld $10, %r2
+
+    ld $0x0, %r1
+    st %r1, 0xFFFFFF10 # tim_cfg
+wait:
+    ld counter, %r1
+    bne %r1, %r2, wait
+    halt
+
+handler:
+    push %r1
+    push %r2
+    ld counter, %r1
+    ld $1, %r2
+    add %r2, %r1
+    st %r1, counter
+    pop %r2
+    pop %r1
+    iret
+
+counter:
+.word 0
+
+.end
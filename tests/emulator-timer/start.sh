@@ -0,0 +1,21 @@
+ASSEMBLER=assembler
+LINKER=linker
+EMULATOR=emulator
+
+${ASSEMBLER} -o timer.o emulator-timer/timer.s
+${LINKER} -hex \
+  -place=my_code@0x40000000 \
+  -o timer.hex \
+  timer.o
+${EMULATOR} timer.hex
+${EMULATOR} --jit timer.hex
+${EMULATOR} --snapshot-at=7000000 --snapshot-out=timer.snap timer.hex
+${EMULATOR} --restore=timer.snap
+
+${ASSEMBLER} -o idle.o emulator-timer/idle.s
+${LINKER} -hex \
+  -place=my_code@0x40000000 \
+  -o idle.hex \
+  idle.o
+${EMULATOR} idle.hex
+${EMULATOR} --no-idle-skip idle.hex
@@ -0,0 +1,37 @@
+# file: timer.s
+# Counts timer interrupts with the shortest period and halts after the third one.
+# r5 holds the number of interrupts, r6 the number of wait loop iterations.
+
+.global my_start
+
+.section my_code
+my_start:
+    ld $0xFFFFFEFE, %sp
+    ld $handler, %r1
+    csrwr %r1, %handler
+    ld $0, %r5
+    ld $0, %r6
+
+    ld $0x0, %r1
+    st %r1, 0xFFFFFF10 # tim_cfg
+wait:
+    ld $1, %r2
+    add %r2, %r6
+    ld $3, %r2
+    bne %r5, %r2, wait
+    halt
+
+handler:
+    push %r1
+    push %r2
+    csrrd %cause, %r1
+    ld $2, %r2
+    bne %r1, %r2, finish
+    ld $1, %r2
+    add %r2, %r5
+finish:
+    pop %r2
+    pop %r1
+    iret
+
+.end
@@ -10,4 +10,5 @@ ${LINKER} -hex \
   -place=my_code@0x40000000 \
   -o program.hex \
   main.o isr_terminal.o isr_timer.o handler.o
-${EMULATOR} program.hex
\ No newline at end of file
+${EMULATOR} --record=program.log program.hex
+${EMULATOR} --replay=program.log program.hex
\ No newline at end of file
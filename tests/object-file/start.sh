@@ -0,0 +1,28 @@
+ASSEMBLER=assembler
+LINKER=linker
+OBJDUMP=objdump
+
+# The binary object and the text dump round-trip to the same bytes
+${ASSEMBLER} -o main.o nivo-a/main.s
+${ASSEMBLER} -text -o main.txt nivo-a/main.s
+${OBJDUMP} -o main.dump main.o
+cmp main.txt main.dump
+${OBJDUMP} -binary -o main_text.o main.txt
+cmp main.o main_text.o
+
+# The linker takes either format
+${ASSEMBLER} -o test1.o linker-tests/test1.s
+${ASSEMBLER} -o test2.o linker-tests/test2.s
+${ASSEMBLER} -o test3.o linker-tests/test3.s
+${ASSEMBLER} -o test4.o linker-tests/test4.s
+${ASSEMBLER} -text -o test2_text.o linker-tests/test2.s
+${ASSEMBLER} -text -o test4_text.o linker-tests/test4.s
+${LINKER} -hex \
+  -place=code1@0x40000000 \
+  -o binary.hex \
+  test1.o test2.o test3.o test4.o
+${LINKER} -hex \
+  -place=code1@0x40000000 \
+  -o text.hex \
+  test1.o test2_text.o test3.o test4_text.o
+cmp binary.hex text.hex
@@ -0,0 +1,36 @@
+# Translator benchmark
+# Counts the Collatz steps of every number from 300000 down to 1, the step count ends up in r2.
+# The branches depend on the data, so most blocks end in a conditional branch.
+
+.section my_code
+
+my_start:
+  ld $300000, %r1
+  ld $0, %r2
+  ld $1, %r3
+  ld $3, %r5
+  ld $0, %r6
+next_number:
+  beq %r1, %r6, done
+  ld $0, %r7
+  add %r1, %r7
+steps:
+  beq %r7, %r3, number_done
+  ld $1, %r4
+  and %r7, %r4
+  beq %r4, %r6, even
+  mul %r5, %r7
+  add %r3, %r7
+  jmp counted
+even:
+  shr %r3, %r7
+counted:
+  add %r3, %r2
+  jmp steps
+number_done:
+  sub %r3, %r1
+  jmp next_number
+done:
+  halt
+
+.end
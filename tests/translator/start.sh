@@ -0,0 +1,35 @@
+ASSEMBLER=assembler
+LINKER=linker
+TRANSLATOR=translator
+EMULATOR=emulator
+
+${ASSEMBLER} -o collatz.o translator/collatz.s
+${LINKER} -hex \
+  -place=my_code@0x40000000 \
+  -o collatz.hex \
+  collatz.o
+${TRANSLATOR} -o collatz.cpp collatz.hex
+make compile_translated PROGRAM=collatz
+time ${EMULATOR} collatz.hex
+time ${EMULATOR} --jit collatz.hex
+time ./collatz
+
+${ASSEMBLER} -o timer.o emulator-timer/timer.s
+${LINKER} -hex \
+  -place=my_code@0x40000000 \
+  -o timer.hex \
+  timer.o
+${TRANSLATOR} -o timer.cpp timer.hex
+make compile_translated PROGRAM=timer
+${EMULATOR} timer.hex
+./timer
+
+${ASSEMBLER} -o xchg.o translator/xchg.s
+${LINKER} -hex \
+  -place=my_code@0x40000000 \
+  -o xchg.hex \
+  xchg.o
+${TRANSLATOR} -o xchg.cpp xchg.hex
+make compile_translated PROGRAM=xchg
+${EMULATOR} xchg.hex
+./xchg
@@ -0,0 +1,12 @@
+# xchg with a nonzero modifier, written as a word since the assembler only makes modifier 0.
+# The translated program has to swap r1 and r2 like the emulator does.
+
+.section my_code
+
+my_start:
+  ld $0x11, %r1
+  ld $0x22, %r2
+  .word 0x41012000 # xchg %r1, %r2 with modifier 1
+  halt
+
+.end